@@ -0,0 +1,287 @@
+// Headless benchmark of every RealSenseCamType's capture path, fed by a SyntheticCamera so it needs no device
+// (or DirectShow graph). Run it from the Filters.dll output directory with
+//     rundll32 Filters.dll,RunBenchmark [frames per type] [output file]
+// which writes JSON (default benchmark.json, 300 frames) with the startup and reconnect times, frame rate, per-stage percentiles,
+// CPU time and peak memory for each type, and for the point cloud types the frame rate and draw and output times
+// at each of the large output sizes.
+// PortableBenchmark.cpp times the parts that build without Windows (the pixel kernels and the CPU renderer, including
+// its thread scaling) as a standalone executable.
+
+#include "RealSenseCam.h"
+#include "SyntheticCamera.h"
+
+#include <psapi.h>
+#include <algorithm>
+#include <cstdio>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+#pragma comment(lib, "psapi")
+
+static const int WarmUpFrames = 15;			// not counted, while the pipeline fills and the caches warm up
+static const int DefaultFrameCount = 300;
+
+static const char* const TypeNames[] = { "IR", "Color", "ColorizedDepth", "ColorAlignedDepth", "PointCloud", "PointCloudIR", "PointCloudColor", "ColorYuy2" };
+static const char* const StageNames[] = { "acquire", "calculate", "draw", "output" };
+
+// a point cloud type streamed at one of the large output sizes
+struct ResolutionResult
+{
+	SIZE size;
+	double fps = 0.0;
+	double drawMilliseconds = 0.0;			// medians
+	double outputMilliseconds = 0.0;		// conversion into the output frame
+};
+
+struct BenchmarkResult
+{
+	RealSenseCamType type;
+	std::string error;						// empty if it ran
+	int frames = 0;
+	double seconds = 0.0;
+	double cpuSeconds = 0.0;				// all threads, user and kernel
+	size_t peakWorkingSetBytes = 0;			// of the whole process so far
+	size_t frameArenaBytes = 0;
+	double configureMilliseconds = 0.0;		// all the filter's constructor does with the camera now
+	double firstFrameMilliseconds = 0.0;	// Init (opening the camera, warming the renderer) to the first frame out
+	double resizeMilliseconds = 0.0;		// point cloud types: reconnecting at another output size up to its first frame,
+	double reopenMilliseconds = 0.0;		// in place (SetOutputSize) and by closing and opening the camera again
+	std::vector<double> frameMilliseconds;	// GetCamFrame, end to end
+	std::vector<double> stageMilliseconds[(int)FrameStage::Count];
+	std::vector<ResolutionResult> resolutions;
+};
+
+static double Median(std::vector<double> samples)
+{
+	std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+	return samples[samples.size() / 2];
+}
+
+static double CpuSeconds()
+{
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER kernelTicks = { kernel.dwLowDateTime, kernel.dwHighDateTime };
+	ULARGE_INTEGER userTicks = { user.dwLowDateTime, user.dwHighDateTime };
+	return (kernelTicks.QuadPart + userTicks.QuadPart) / 1.0e7;
+}
+
+/// <summary>
+/// stream one type from a synthetic camera with the streams that type asks for, timing each output frame
+/// </summary>
+static BenchmarkResult RunType(RealSenseCamType type, int frameCount)
+{
+	BenchmarkResult result;
+	result.type = type;
+
+	bool depth = type != RealSenseCamType::IR && type != RealSenseCamType::Color && type != RealSenseCamType::ColorYuy2;
+	bool infrared = type == RealSenseCamType::IR || type == RealSenseCamType::PointCloudIR;
+	rs2_format colorFormat = RS2_FORMAT_ANY;
+	if (type == RealSenseCamType::Color || type == RealSenseCamType::ColorAlignedDepth || type == RealSenseCamType::PointCloudColor)
+		colorFormat = RS2_FORMAT_RGB8;
+	else if (type == RealSenseCamType::ColorYuy2)
+		colorFormat = RS2_FORMAT_YUYV;
+
+	try
+	{
+		SyntheticCamera camera(depth, infrared, colorFormat);
+		camera.Start();
+
+		LARGE_INTEGER frequency, begin, start, end;
+		QueryPerformanceFrequency(&frequency);
+		double millisecondsPerTick = 1000.0 / frequency.QuadPart;
+
+		// startup, as the filter does it: Configure when it's made, Init when the graph runs
+		RealSenseCam realSenseCam;
+		QueryPerformanceCounter(&start);
+		realSenseCam.Configure(type);
+		QueryPerformanceCounter(&end);
+		result.configureMilliseconds = (end.QuadPart - start.QuadPart) * millisecondsPerTick;
+
+		int frameSize = realSenseCam.GetOutputWidth() * realSenseCam.GetOutputHeight() * realSenseCam.GetOutputBytesPerPixel();
+		int resizedFrameSize = frameSize / 4;
+		std::vector<BYTE> frameBuffer(frameSize);
+		QueryPerformanceCounter(&start);
+		if (FAILED(realSenseCam.Init(type, camera.GetContext(), camera.GetSerialNumber())))
+		{
+			realSenseCam.UnInit();
+			result.error = "Init failed";
+			return result;
+		}
+		realSenseCam.GetCamFrame(frameBuffer.data(), frameSize);
+		QueryPerformanceCounter(&end);
+		result.firstFrameMilliseconds = (end.QuadPart - start.QuadPart) * millisecondsPerTick;
+
+		for (int i = 0; i < WarmUpFrames; i++)
+			realSenseCam.GetCamFrame(frameBuffer.data(), frameSize);
+		double cpuBegin = CpuSeconds();
+		QueryPerformanceCounter(&begin);
+		for (int i = 0; i < frameCount; i++)
+		{
+			QueryPerformanceCounter(&start);
+			realSenseCam.GetCamFrame(frameBuffer.data(), frameSize);
+			QueryPerformanceCounter(&end);
+
+			result.frameMilliseconds.push_back((end.QuadPart - start.QuadPart) * millisecondsPerTick);
+			for (int stage = 0; stage < (int)FrameStage::Count; stage++)
+				result.stageMilliseconds[stage].push_back(realSenseCam.GetStageTicks((FrameStage)stage) * millisecondsPerTick);
+		}
+		result.frames = frameCount;
+		result.seconds = (end.QuadPart - begin.QuadPart) / (double)frequency.QuadPart;
+		result.cpuSeconds = CpuSeconds() - cpuBegin;
+		result.frameArenaBytes = realSenseCam.GetFrameArena().GetBytesAllocated();
+
+		PROCESS_MEMORY_COUNTERS memoryCounters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters)))
+			result.peakWorkingSetBytes = memoryCounters.PeakWorkingSetSize;
+
+		// a pin reconnect at half the size, as the filter now does it and as a full UnInit/Init would
+		QueryPerformanceCounter(&start);
+		if (SUCCEEDED(realSenseCam.SetOutputSize(realSenseCam.GetOutputWidth() / 2, realSenseCam.GetOutputHeight() / 2)))
+		{
+			realSenseCam.GetCamFrame(frameBuffer.data(), resizedFrameSize);
+			QueryPerformanceCounter(&end);
+			result.resizeMilliseconds = (end.QuadPart - start.QuadPart) * millisecondsPerTick;
+
+			QueryPerformanceCounter(&start);
+			realSenseCam.UnInit();
+			if (SUCCEEDED(realSenseCam.Init(type, camera.GetContext(), camera.GetSerialNumber())))
+				realSenseCam.GetCamFrame(frameBuffer.data(), resizedFrameSize);
+			QueryPerformanceCounter(&end);
+			result.reopenMilliseconds = (end.QuadPart - start.QuadPart) * millisecondsPerTick;
+		}
+
+		// and the large output sizes, a quarter as many frames each
+		for (int i = 0; realSenseCam.IsPointCloudType() && i < (int)ARRAYSIZE(PointCloudOutputSizes); i++)
+		{
+			ResolutionResult resolution;
+			resolution.size = PointCloudOutputSizes[i];
+			realSenseCam.SetOutputSize(resolution.size.cx, resolution.size.cy);
+			int resolutionFrameSize = resolution.size.cx * resolution.size.cy * realSenseCam.GetOutputBytesPerPixel();
+			frameBuffer.resize(resolutionFrameSize);
+			for (int frame = 0; frame < WarmUpFrames; frame++)
+				realSenseCam.GetCamFrame(frameBuffer.data(), resolutionFrameSize);
+
+			int resolutionFrameCount = std::max(1, frameCount / 4);
+			std::vector<double> drawMilliseconds, outputMilliseconds;
+			QueryPerformanceCounter(&begin);
+			for (int frame = 0; frame < resolutionFrameCount; frame++)
+			{
+				realSenseCam.GetCamFrame(frameBuffer.data(), resolutionFrameSize);
+				drawMilliseconds.push_back(realSenseCam.GetStageTicks(FrameStage::Draw) * millisecondsPerTick);
+				outputMilliseconds.push_back(realSenseCam.GetStageTicks(FrameStage::Output) * millisecondsPerTick);
+			}
+			QueryPerformanceCounter(&end);
+			resolution.fps = resolutionFrameCount * (double)frequency.QuadPart / (end.QuadPart - begin.QuadPart);
+			resolution.drawMilliseconds = Median(drawMilliseconds);
+			resolution.outputMilliseconds = Median(outputMilliseconds);
+			result.resolutions.push_back(resolution);
+		}
+
+		// the camera has to outlive the pipeline that streams from it
+		realSenseCam.UnInit();
+		camera.Stop();
+	}
+	catch (const std::exception& ex)
+	{
+		result.error = ex.what();
+	}
+	return result;
+}
+
+static void WritePercentiles(FILE* file, const char* name, std::vector<double> samples, bool last)
+{
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) { return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))]; };
+	fprintf(file, "        \"%s\": { \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+		name, percentile(0.5), percentile(0.9), percentile(0.99), samples.back(), last ? "" : ",");
+}
+
+static void WriteResult(FILE* file, const BenchmarkResult& result, bool last)
+{
+	fprintf(file, "    {\n      \"type\": \"%s\",\n", TypeNames[(int)result.type]);
+	if (!result.error.empty())
+	{
+		// keep the quotes and backslashes of the message out of the JSON
+		std::string error = result.error;
+		std::replace(error.begin(), error.end(), '"', '\'');
+		std::replace(error.begin(), error.end(), '\\', '/');
+		fprintf(file, "      \"error\": \"%s\"\n    }%s\n", error.c_str(), last ? "" : ",");
+		return;
+	}
+
+	fprintf(file, "      \"frames\": %d,\n", result.frames);
+	fprintf(file, "      \"fps\": %.2f,\n", result.frames / result.seconds);
+	fprintf(file, "      \"cpuSeconds\": %.3f,\n", result.cpuSeconds);
+	fprintf(file, "      \"cpuPerFrameMilliseconds\": %.3f,\n", result.cpuSeconds * 1000.0 / result.frames);
+	fprintf(file, "      \"peakWorkingSetKB\": %u,\n", (unsigned int)(result.peakWorkingSetBytes >> 10));
+	fprintf(file, "      \"frameArenaKB\": %u,\n", (unsigned int)(result.frameArenaBytes >> 10));
+	fprintf(file, "      \"configureMilliseconds\": %.3f,\n", result.configureMilliseconds);
+	fprintf(file, "      \"firstFrameMilliseconds\": %.3f,\n", result.firstFrameMilliseconds);
+	if (result.resizeMilliseconds > 0.0)
+	{
+		fprintf(file, "      \"resizeMilliseconds\": %.3f,\n", result.resizeMilliseconds);
+		fprintf(file, "      \"reopenMilliseconds\": %.3f,\n", result.reopenMilliseconds);
+	}
+	if (!result.resolutions.empty())
+	{
+		fprintf(file, "      \"resolutions\": [\n");
+		for (size_t i = 0; i < result.resolutions.size(); i++)
+		{
+			const ResolutionResult& resolution = result.resolutions[i];
+			fprintf(file, "        { \"width\": %d, \"height\": %d, \"fps\": %.2f, \"drawP50\": %.3f, \"outputP50\": %.3f }%s\n",
+				(int)resolution.size.cx, (int)resolution.size.cy, resolution.fps, resolution.drawMilliseconds, resolution.outputMilliseconds,
+				i + 1 == result.resolutions.size() ? "" : ",");
+		}
+		fprintf(file, "      ],\n");
+	}
+	fprintf(file, "      \"milliseconds\": {\n");
+
+	// only the stages this type goes through
+	std::vector<int> stages;
+	for (int stage = 0; stage < (int)FrameStage::Count; stage++)
+	{
+		if (*std::max_element(result.stageMilliseconds[stage].begin(), result.stageMilliseconds[stage].end()) > 0.0)
+			stages.push_back(stage);
+	}
+	WritePercentiles(file, "frame", result.frameMilliseconds, stages.empty());
+	for (size_t i = 0; i < stages.size(); i++)
+		WritePercentiles(file, StageNames[stages[i]], result.stageMilliseconds[stages[i]], i + 1 == stages.size());
+	fprintf(file, "      }\n    }%s\n", last ? "" : ",");
+}
+
+/// <summary>
+/// rundll32 entry point: "[frames per type] [output file]"
+/// </summary>
+extern "C" void CALLBACK RunBenchmarkW(HWND hwnd, HINSTANCE instance, LPWSTR commandLine, int show)
+{
+	wchar_t* rest = commandLine;
+	int frameCount = (int)wcstol(commandLine, &rest, 10);
+	if (frameCount <= 0)
+		frameCount = DefaultFrameCount;
+	while (*rest == L' ')
+		rest++;
+	std::wstring path = *rest ? rest : L"benchmark.json";
+
+	std::vector<BenchmarkResult> results;
+	for (int type = 0; type < (int)(sizeof(TypeNames) / sizeof(TypeNames[0])); type++)
+	{
+		OutputDebugStringA("Benchmarking ");
+		OutputDebugStringA(TypeNames[type]);
+		OutputDebugStringA("\n");
+		results.push_back(RunType((RealSenseCamType)type, frameCount));
+	}
+
+	FILE* file = _wfopen(path.c_str(), L"w");
+	if (!file)
+	{
+		OutputDebugStringA("Couldn't open the benchmark output file\n");
+		return;
+	}
+	fprintf(file, "{\n  \"warmUpFrames\": %d,\n  \"results\": [\n", WarmUpFrames);
+	for (size_t i = 0; i < results.size(); i++)
+		WriteResult(file, results[i], i + 1 == results.size());
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Fixed capacity blocking queue used to hand frames between the stages of the pipelined mode.
+// Push blocks while the queue is full (back-pressure on the producing stage) and Pop blocks
+// while it is empty. Close() releases every waiter so the stage threads can be shut down.
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity = 2) : m_Slots(capacity), m_Head(0), m_Count(0), m_Closed(false)
+	{
+	}
+
+	// only while nothing is waiting on the queue, i.e. before the stage threads start
+	void Reset(size_t capacity)
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Slots.clear();
+		m_Slots.resize(capacity);
+		m_Head = 0;
+		m_Count = 0;
+		m_Closed = false;
+	}
+
+	// returns false (and drops the item) if the queue has been closed
+	bool Push(T item)
+	{
+		std::unique_lock<std::mutex> lock(m_Lock);
+		m_NotFull.wait(lock, [this]() { return m_Closed || m_Count < m_Slots.size(); });
+		if (m_Closed)
+			return false;
+
+		m_Slots[(m_Head + m_Count) % m_Slots.size()] = std::move(item);
+		++m_Count;
+		m_NotEmpty.notify_one();
+		return true;
+	}
+
+	// returns false once the queue has been closed
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_Lock);
+		m_NotEmpty.wait(lock, [this]() { return m_Closed || m_Count > 0; });
+		if (m_Closed)
+			return false;
+
+		item = std::move(m_Slots[m_Head]);
+		m_Slots[m_Head] = T();
+		m_Head = (m_Head + 1) % m_Slots.size();
+		--m_Count;
+		m_NotFull.notify_one();
+		return true;
+	}
+
+	// doesn't wait: returns false if the queue is empty (or closed)
+	bool TryPop(T& item)
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (m_Closed || m_Count == 0)
+			return false;
+
+		item = std::move(m_Slots[m_Head]);
+		m_Slots[m_Head] = T();
+		m_Head = (m_Head + 1) % m_Slots.size();
+		--m_Count;
+		m_NotFull.notify_one();
+		return true;
+	}
+
+	bool IsClosed()
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		return m_Closed;
+	}
+
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Closed = true;
+		m_NotFull.notify_all();
+		m_NotEmpty.notify_all();
+	}
+
+private:
+	std::vector<T> m_Slots;
+	size_t m_Head;
+	size_t m_Count;
+	bool m_Closed;
+	std::mutex m_Lock;
+	std::condition_variable m_NotFull;
+	std::condition_variable m_NotEmpty;
+};
@@ -0,0 +1,142 @@
+#include "CameraController.h"
+
+#include <cmath>
+
+const float CameraController::DriftPeriod = 4.0f * DirectX::XM_PI;
+
+// the sensor's origin, looking out along +z with +y up (and the default user pose)
+static const DirectX::XMFLOAT3 DefaultEye = { 0.0f, 0.0f, 0.0f };
+static const DirectX::XMFLOAT3 DefaultLookAt = { 0.0f, 0.0f, 0.5f };
+
+static DirectX::XMFLOAT3 Lerp(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, float t)
+{
+	DirectX::XMFLOAT3 result = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t };
+	return result;
+}
+
+static bool Equal(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+CameraController::CameraController() : m_Mode(CameraMode::Drift), m_FixedTime(-1.0f), m_Started(false), m_HavePose(false), m_Eye(DefaultEye), m_LookAt(DefaultLookAt), m_PathCount(0), m_UserEye(DefaultEye), m_UserLookAt(DefaultLookAt)
+{
+	m_View = DirectX::XMMatrixIdentity();
+	for (int step = 0; step <= OrbitSteps; step++)
+	{
+		float angle = step * DirectX::XM_2PI / OrbitSteps;
+		m_Orbit[step].x = std::sin(angle) / 5.0f;
+		m_Orbit[step].y = -0.2f + std::cos(angle) / 5.0f;
+		m_Orbit[step].z = 0.0f;
+	}
+}
+
+void CameraController::SetMode(CameraMode mode)
+{
+	m_Mode = mode;
+	m_HavePose = false;
+}
+
+void CameraController::SetFixedTime(float time)
+{
+	m_FixedTime = time;
+	m_HavePose = false;
+}
+
+void CameraController::SetPath(const CameraKeyframe* keyframes, int count)
+{
+	m_PathCount = count < MaxKeyframes ? count : MaxKeyframes;
+	for (int i = 0; i < m_PathCount; i++)
+	{
+		m_Path[i] = keyframes[i];
+	}
+	m_HavePose = false;
+}
+
+void CameraController::SetUserPose(const DirectX::XMFLOAT3& eye, const DirectX::XMFLOAT3& lookAt)
+{
+	std::lock_guard<std::mutex> lock(m_UserLock);
+	m_UserEye = eye;
+	m_UserLookAt = lookAt;
+}
+
+void CameraController::Reset()
+{
+	m_Started = false;
+	m_HavePose = false;
+}
+
+bool CameraController::Update()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!m_Started)
+	{
+		m_Start = now;
+		m_Started = true;
+	}
+	return Update(m_FixedTime >= 0.0f ? m_FixedTime : std::chrono::duration<double>(now - m_Start).count());
+}
+
+bool CameraController::Update(double time)
+{
+	DirectX::XMFLOAT3 eye, lookAt;
+	GetPose(time, eye, lookAt);
+	if (m_HavePose && Equal(eye, m_Eye) && Equal(lookAt, m_LookAt))
+		return false;
+
+	m_Eye = eye;
+	m_LookAt = lookAt;
+	m_HavePose = true;
+	DirectX::XMVECTOR up = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f); // Positive Y Axis = Up
+	m_View = DirectX::XMMatrixLookAtLH(DirectX::XMLoadFloat3(&m_Eye), DirectX::XMLoadFloat3(&m_LookAt), up);
+	return true;
+}
+
+void CameraController::GetPose(double time, DirectX::XMFLOAT3& eye, DirectX::XMFLOAT3& lookAt)
+{
+	eye = DefaultEye;
+	lookAt = DefaultLookAt;
+	switch (m_Mode)
+	{
+	case CameraMode::Drift:
+	{
+		// wrapped in double so the phase stays exact however long the clock has been running
+		double phase = std::fmod(time, (double)DriftPeriod) * (OrbitSteps / DriftPeriod);
+		int step = (int)phase;
+		if (step >= OrbitSteps)
+			step = OrbitSteps - 1;
+		eye = Lerp(m_Orbit[step], m_Orbit[step + 1], (float)(phase - step));
+		break;
+	}
+	case CameraMode::Path:
+		if (m_PathCount == 1 || (m_PathCount > 1 && !(m_Path[m_PathCount - 1].time > 0.0f)))
+		{
+			eye = m_Path[0].eye;
+			lookAt = m_Path[0].lookAt;
+		}
+		else if (m_PathCount > 1)
+		{
+			double pathTime = std::fmod(time, (double)m_Path[m_PathCount - 1].time);
+			int key = 0;
+			while (key + 2 < m_PathCount && pathTime >= m_Path[key + 1].time)
+				key++;
+			const CameraKeyframe& from = m_Path[key];
+			const CameraKeyframe& to = m_Path[key + 1];
+			float span = to.time - from.time;
+			float t = span > 0.0f ? (float)((pathTime - from.time) / span) : 1.0f;
+			t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+			eye = Lerp(from.eye, to.eye, t);
+			lookAt = Lerp(from.lookAt, to.lookAt, t);
+		}
+		break;
+	case CameraMode::User:
+	{
+		std::lock_guard<std::mutex> lock(m_UserLock);
+		eye = m_UserEye;
+		lookAt = m_UserLookAt;
+		break;
+	}
+	default:
+		break;
+	}
+}
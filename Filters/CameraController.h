@@ -0,0 +1,81 @@
+#pragma once
+
+#include <DirectXMath.h>    // matrix/vector math
+#include <chrono>
+#include <mutex>
+
+// How the point cloud camera moves
+enum class CameraMode
+{
+	Static,		// held at the sensor, looking straight out
+	Drift,		// a slow orbit around the sensor, for a bit of a 3D feel
+	Path,		// along keyframed poses, looping
+	User		// wherever SetUserPose last put it
+};
+
+// a pose on a keyframed camera path
+struct CameraKeyframe
+{
+	float time;					// seconds from the start of the path, increasing
+	DirectX::XMFLOAT3 eye;
+	DirectX::XMFLOAT3 lookAt;
+};
+
+// The renderers' camera: finds the eye and look at positions for the current time in its mode, and the view matrix
+// from them, and reports whether the pose has moved since the last update so the world*view*projection matrix
+// (and the constant buffer it goes into) only has to be rebuilt when it does.
+// Time comes from a steady high resolution clock, so the drift and paths move at the same speed whatever the frame rate.
+// Only needs DirectXMath and the standard library.
+class CameraController
+{
+public:
+	static const int MaxKeyframes = 16;
+
+	CameraController();
+
+	void SetMode(CameraMode mode);
+	CameraMode GetMode() const { return m_Mode; }
+
+	// hold the clock this many seconds in (for repeatable frames), negative to follow the clock
+	void SetFixedTime(float time);
+
+	// path mode: copies the first MaxKeyframes keyframes. The path loops once it passes the last one
+	void SetPath(const CameraKeyframe* keyframes, int count);
+
+	// user mode: can be called from any thread, the camera moves there on its next Update
+	void SetUserPose(const DirectX::XMFLOAT3& eye, const DirectX::XMFLOAT3& lookAt);
+
+	// restart the clock from the next Update, and forget the last pose so that Update reports a change
+	void Reset();
+
+	// move the camera to where it is now on the clock (or at time seconds), returns true if the pose changed
+	bool Update();
+	bool Update(double time);
+
+	const DirectX::XMMATRIX& GetView() const { return m_View; }
+	DirectX::XMVECTOR GetEye() const { return DirectX::XMLoadFloat3(&m_Eye); }
+
+private:
+	// drift: the eye goes round a circle of 0.2 m radius, centred 0.2 m below the sensor in its image plane, every
+	// DriftPeriod seconds. The circle is sampled OrbitSteps times round when the controller is made and interpolated in between
+	static const int OrbitSteps = 1024;
+	static const float DriftPeriod;
+
+	DirectX::XMMATRIX m_View;
+	CameraMode m_Mode;
+	float m_FixedTime;
+	std::chrono::steady_clock::time_point m_Start;
+	bool m_Started;
+	bool m_HavePose;
+	DirectX::XMFLOAT3 m_Eye;
+	DirectX::XMFLOAT3 m_LookAt;
+	DirectX::XMFLOAT3 m_Orbit[OrbitSteps + 1];
+	CameraKeyframe m_Path[MaxKeyframes];
+	int m_PathCount;
+
+	std::mutex m_UserLock;		// the user pose, set from another thread
+	DirectX::XMFLOAT3 m_UserEye;
+	DirectX::XMFLOAT3 m_UserLookAt;
+
+	void GetPose(double time, DirectX::XMFLOAT3& eye, DirectX::XMFLOAT3& lookAt);
+};
@@ -0,0 +1,515 @@
+#include "CpuPointCloudRenderer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+CpuPointCloudRenderer::CpuPointCloudRenderer() : m_Vertices(NULL), m_ScreenPoints(NULL), m_Texture(NULL), m_ColorBuffer(NULL), m_DepthBuffer(NULL), m_PixelCapacity(0), m_PointCount(0), m_PointBins(NULL), m_BinPoints(NULL), m_BinPointCapacity(0), m_BinStarts(NULL), m_BinCursors(NULL), m_BinCapacity(0)
+{
+}
+
+CpuPointCloudRenderer::~CpuPointCloudRenderer()
+{
+}
+
+HRESULT CpuPointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int inputTexWidth, int inputTexHeight, TextureFormat textureFormat, int outputWidth, int outputHeight, float clippingDistanceZ, const PointCloudRendererOptions& options, ThreadPool* threadPool, FrameArena* frameArena)
+{
+    // no multisampling here: MSAA is asked for as the nearest supersampling, 4 samples as 2x2, 8 as 3x3, 16 as 4x4
+    PointCloudRendererOptions cpuOptions = options;
+    if (cpuOptions.supersample <= 1 && cpuOptions.msaaSamples > 1)
+        cpuOptions.supersample = (int)std::ceil(std::sqrt((float)cpuOptions.msaaSamples));
+    cpuOptions.msaaSamples = 1;
+    PointCloudRendererBase::Init(inputDepthWidth, inputDepthHeight, inputTexWidth, inputTexHeight, textureFormat, outputWidth, outputHeight, clippingDistanceZ, cpuOptions, threadPool, frameArena);
+
+    size_t pointCount = (size_t)m_InputDepthWidth * m_InputDepthHeight;
+    m_Vertices = frameArena->Allocate<PackedVertex>(pointCount);
+    m_ScreenPoints = frameArena->Allocate<ScreenPoint>(pointCount);
+    m_Texture = frameArena->Allocate<BYTE>((size_t)GetTexelBytes() * m_InputTexWidth * m_InputTexHeight);
+    if (m_Options.mesh)
+    {
+        m_BinPointCapacity = (size_t)MaxTriangleBands * (m_MeshIndexCount / 3);
+    }
+    else
+    {
+        m_PointBins = frameArena->Allocate<UINT>(pointCount);
+        m_BinPointCapacity = m_Options.splatting ? (1 + (2 * MaxSplatRadius + BinRows - 1) / BinRows) * pointCount : pointCount;
+    }
+    m_BinPoints = frameArena->Allocate<unsigned int>(m_BinPointCapacity);
+    AllocateTargets();
+
+    return S_OK;
+}
+
+HRESULT CpuPointCloudRenderer::Resize(int outputWidth, int outputHeight)
+{
+    PointCloudRendererBase::Resize(outputWidth, outputHeight);
+    AllocateTargets();
+    return S_OK;
+}
+
+/// <summary>
+/// allocate the render sized buffers (colour, depth and the bins) from the frame arena, if they don't fit in the ones
+/// there are. A smaller render target fits, a bigger one needs more of the frame arena (the old buffers are only
+/// given back with the rest of it)
+/// </summary>
+void CpuPointCloudRenderer::AllocateTargets()
+{
+    size_t pixelCount = (size_t)m_RenderWidth * m_RenderHeight;
+    if (pixelCount > m_PixelCapacity)
+    {
+        m_ColorBuffer = m_FrameArena->Allocate<UINT>(pixelCount);
+        m_DepthBuffer = m_FrameArena->Allocate<float>(pixelCount);
+        m_PixelCapacity = pixelCount;
+    }
+
+    size_t binCount = GetBinListCount();
+    if (binCount > m_BinCapacity)
+    {
+        m_BinStarts = m_FrameArena->Allocate<unsigned int>(binCount + 1);
+        m_BinCursors = m_FrameArena->Allocate<unsigned int>(GetBinChunkCount() * binCount);
+        m_BinCapacity = binCount;
+    }
+}
+
+void CpuPointCloudRenderer::UnInit()
+{
+    // the buffers belong to the frame arena
+    m_Vertices = NULL;
+    m_ScreenPoints = NULL;
+    m_Texture = NULL;
+    m_ColorBuffer = NULL;
+    m_DepthBuffer = NULL;
+    m_PixelCapacity = 0;
+    m_PointBins = NULL;
+    m_BinPoints = NULL;
+    m_BinPointCapacity = 0;
+    m_BinStarts = NULL;
+    m_BinCursors = NULL;
+    m_BinCapacity = 0;
+}
+
+void CpuPointCloudRenderer::DrawFrame(const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, const void* color_frame_data, const int color_frame_size)
+{
+    assert(pointsXyz != NULL && (pointsCount == m_InputDepthWidth * m_InputDepthHeight));
+
+    // copy the color texture, in the same format as the D3D texture
+    (this->*m_UploadTexture)(m_Texture, GetTexelBytes() * m_InputTexWidth, (const BYTE*)color_frame_data);
+
+    // same camera and point selection as the GPU renderer
+    UpdateCamera();
+    UpdateLevelOfDetail();
+    m_PointCount = pointsCount;
+    if (m_Options.mesh)
+        SelectMeshVertices(pointsCount, pointsXyz, texUvs, m_Vertices);
+    else
+        m_PointCount = SelectPoints(pointsCount, pointsXyz, texUvs, m_Vertices);
+
+    // the camera has already moved for this frame
+    RasterizeFrame();
+}
+
+void CpuPointCloudRenderer::RedrawFrame()
+{
+    // m_Vertices and m_Texture still hold the last frame, and the colour buffer its image if the camera hasn't moved
+    if (UpdateCamera())
+        RasterizeFrame();
+}
+
+/// <summary>
+/// transform the selected vertices and rasterise them into the cleared colour and depth buffers
+/// </summary>
+void CpuPointCloudRenderer::RasterizeFrame()
+{
+    unsigned int pointCount = m_PointCount;
+    TransformPoints(pointCount);
+    BinPoints(pointCount);
+
+    // clear to the background color
+    BYTE background[4];
+    for (int i = 0; i < 4; i++)
+    {
+        background[i] = (BYTE)(BackgroundColor[i] * 255.0f + 0.5f);
+    }
+    UINT backgroundColor;
+    memcpy(&backgroundColor, background, sizeof(backgroundColor));
+
+    // each task owns whole bands of render target rows, so no two threads ever touch the same pixel.
+    // A band is cleared just before it's drawn, which at 1080p and up is as much memory traffic as the points
+    int width = m_RenderWidth, height = m_RenderHeight;
+    m_ThreadPool->ParallelFor(0, GetBinCount(), 1, [=](int binBegin, int binEnd)
+        {
+            for (int bin = binBegin; bin < binEnd; bin++)
+            {
+                int rowBegin = bin << BinShift;
+                int rowEnd = std::min(rowBegin + BinRows, height);
+                std::fill(m_ColorBuffer + rowBegin * width, m_ColorBuffer + rowEnd * width, backgroundColor);
+                std::fill(m_DepthBuffer + rowBegin * width, m_DepthBuffer + rowEnd * width, 1.0f);
+                if (m_Options.mesh)
+                {
+                    RasterizeTriangles(bin, rowBegin, rowEnd);
+                }
+                else
+                {
+                    RasterizeBin(bin, rowBegin, rowEnd);
+                }
+            }
+        });
+}
+
+/// <summary>
+/// The vertex (and geometry) shader stage: unpack the selected points (depth along their pixel's ray), project them
+/// into rendered pixels and depth, size their splats and find their texels (and, for points and splats, the bands
+/// they fall in).
+/// </summary>
+/// <param name="pointCount">number of points in m_Vertices</param>
+void CpuPointCloudRenderer::TransformPoints(unsigned int pointCount)
+{
+    DirectX::XMFLOAT4X4 wvp;
+    DirectX::XMStoreFloat4x4(&wvp, worldViewProj);
+
+    // radius in pixels = radius in meters * projection x scale (negative when mirrored) / w * half the render width
+    DirectX::XMFLOAT4X4 proj;
+    DirectX::XMStoreFloat4x4(&proj, projection);
+    float splatScale = m_Options.splatting ? GetSplatRadiusPerMeter() * std::fabs(proj(0, 0)) * m_RenderWidth / 2.0f : 0.0f;
+
+    const PackedVertex* vertices = m_Vertices;
+    const float* depthRays = m_DepthRays;
+    float depthScale = m_PackedDepthScale;
+    const float uvScale = 1.0f / PackedUvMax;
+    ScreenPoint* screenPoints = m_ScreenPoints;
+    int texWidth = m_InputTexWidth, texHeight = m_InputTexHeight;
+    float renderWidth = (float)m_RenderWidth, renderHeight = (float)m_RenderHeight;
+    UINT* pointBins = m_Options.mesh ? NULL : m_PointBins;
+
+    m_ThreadPool->ParallelFor(0, pointCount, 4096, [=, &wvp](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                PackedVertex packed = vertices[i];
+                ScreenPoint& sp = screenPoints[i];
+                UINT depth = packed.depthPixel & 0xffff;
+                UINT pixel = packed.depthPixel >> 16 | (packed.uvPixel >> 28) << 16;
+                float v[3];
+                v[2] = depth * depthScale;
+                v[0] = depthRays[2 * pixel] * v[2];
+                v[1] = depthRays[2 * pixel + 1] * v[2];
+
+                // row vector times matrix, as mul(float4(pos, 1), worldViewProj) in the vertex shader
+                float x = v[0] * wvp(0, 0) + v[1] * wvp(1, 0) + v[2] * wvp(2, 0) + wvp(3, 0);
+                float y = v[0] * wvp(0, 1) + v[1] * wvp(1, 1) + v[2] * wvp(2, 1) + wvp(3, 1);
+                float z = v[0] * wvp(0, 2) + v[1] * wvp(1, 2) + v[2] * wvp(2, 2) + wvp(3, 2);
+                float w = v[0] * wvp(0, 3) + v[1] * wvp(1, 3) + v[2] * wvp(2, 3) + wvp(3, 3);
+
+                // near/far clipping, depth 0 is a mesh vertex that has been dropped
+                if (depth == 0 || !(w > 0.0f) || z < 0.0f || z > w)
+                {
+                    sp.radius = -1.0f;
+                    if (pointBins)
+                        pointBins[i] = NoBins;
+                    continue;
+                }
+
+                // viewport transform, y down
+                sp.x = (x / w * 0.5f + 0.5f) * renderWidth;
+                sp.y = (0.5f - y / w * 0.5f) * renderHeight;
+                sp.depth = z / w;
+                sp.radius = std::min(splatScale * v[2] / w, (float)MaxSplatRadius);
+
+                // nearest texel (the GPU filters linearly, close enough for a reference)
+                sp.u = (packed.uvPixel & PackedUvMax) * uvScale;
+                sp.v = (packed.uvPixel >> 14 & PackedUvMax) * uvScale;
+                int u = std::min((int)(sp.u * texWidth), texWidth - 1);
+                int t = std::min((int)(sp.v * texHeight), texHeight - 1);
+                sp.texel = t * texWidth + u;
+                if (pointBins)
+                    pointBins[i] = GetBinRange(sp);
+            }
+        });
+}
+
+/// <summary>
+/// the first and last (<< 16) bands a point or the pixel centres of its splat disc fall in, NoBins if it's off screen
+/// </summary>
+UINT CpuPointCloudRenderer::GetBinRange(const ScreenPoint& sp) const
+{
+    int width = m_RenderWidth, height = m_RenderHeight;
+    if (sp.radius == 0.0f)
+    {
+        int px = (int)sp.x, py = (int)sp.y;
+        if (py < 0 || py >= height || px < 0 || px >= width)
+            return NoBins;
+        return (py >> BinShift) * 0x10001u;
+    }
+
+    int yMin = std::max((int)std::ceil(sp.y - sp.radius - 0.5f), 0);
+    int yMax = std::min((int)std::floor(sp.y + sp.radius - 0.5f), height - 1);
+    int xMin = std::max((int)std::ceil(sp.x - sp.radius - 0.5f), 0);
+    int xMax = std::min((int)std::floor(sp.x + sp.radius - 0.5f), width - 1);
+    if (yMin > yMax || xMin > xMax)
+        return NoBins;
+    return (yMin >> BinShift) | (yMax >> BinShift) << 16;
+}
+
+/// <summary>
+/// the bands the pixel centres of a mesh triangle fall in, as GetBinRange, or just the big triangles' list (the one
+/// after the last band) for one that overlaps more than MaxTriangleBands. NoBins if it's culled or off screen
+/// </summary>
+UINT CpuPointCloudRenderer::GetTriangleBinRange(unsigned int triangle) const
+{
+    const ScreenPoint& a = m_ScreenPoints[m_MeshIndices[3 * triangle]];
+    const ScreenPoint& b = m_ScreenPoints[m_MeshIndices[3 * triangle + 1]];
+    const ScreenPoint& c = m_ScreenPoints[m_MeshIndices[3 * triangle + 2]];
+    if (a.radius < 0.0f || b.radius < 0.0f || c.radius < 0.0f)
+        return NoBins;
+
+    int width = m_RenderWidth, height = m_RenderHeight;
+    int yMin = std::max((int)std::ceil(std::min(std::min(a.y, b.y), c.y) - 0.5f), 0);
+    int yMax = std::min((int)std::floor(std::max(std::max(a.y, b.y), c.y) - 0.5f), height - 1);
+    int xMin = std::max((int)std::ceil(std::min(std::min(a.x, b.x), c.x) - 0.5f), 0);
+    int xMax = std::min((int)std::floor(std::max(std::max(a.x, b.x), c.x) - 0.5f), width - 1);
+    if (yMin > yMax || xMin > xMax)
+        return NoBins;
+    UINT first = yMin >> BinShift, last = yMax >> BinShift;
+    if (last - first >= MaxTriangleBands)
+        return GetBinCount() * 0x10001u;
+    return first | last << 16;
+}
+
+/// <summary>
+/// list the transformed points (or mesh triangles) under each band they overlap, in draw order: count the points each
+/// chunk of input rows has for each band (from the ranges TransformPoints found), turn the counts into where each chunk's
+/// points go (band by band, then chunk by chunk), then scatter the indices
+/// </summary>
+/// <param name="pointCount">number of points in m_ScreenPoints</param>
+void CpuPointCloudRenderer::BinPoints(unsigned int pointCount)
+{
+    // each input row's points are at [m_RowPointCounts[row], m_RowPointCounts[row + 1]), in column order, and each row
+    // of grid cells has GetTrianglesPerRow triangles
+    bool mesh = m_Options.mesh;
+    assert(mesh || m_RowPointCounts[m_InputDepthHeight] == pointCount);
+    int binCount = GetBinListCount(), chunkCount = GetBinChunkCount();
+    auto binChunk = [this, mesh, binCount](int chunk, bool scatter)
+        {
+            unsigned int* cursors = m_BinCursors + chunk * binCount;
+            unsigned int begin, end;
+            if (mesh)
+            {
+                int cellRows = m_InputDepthHeight - 1;
+                begin = std::min(chunk * BinChunkRows, cellRows) * GetTrianglesPerRow();
+                end = std::min((chunk + 1) * BinChunkRows, cellRows) * GetTrianglesPerRow();
+            }
+            else
+            {
+                begin = m_RowPointCounts[chunk * BinChunkRows];
+                end = m_RowPointCounts[std::min((chunk + 1) * BinChunkRows, (int)m_InputDepthHeight)];
+            }
+            for (unsigned int i = begin; i < end; i++)
+            {
+                UINT bins = mesh ? GetTriangleBinRange(i) : m_PointBins[i];
+                for (UINT bin = bins & 0xffff; bin <= bins >> 16; bin++)
+                {
+                    if (scatter)
+                        m_BinPoints[cursors[bin]++] = i;
+                    else
+                        cursors[bin]++;
+                }
+            }
+        };
+
+    m_ThreadPool->ParallelFor(0, chunkCount, 1, [=](int chunkBegin, int chunkEnd)
+        {
+            std::fill(m_BinCursors + chunkBegin * binCount, m_BinCursors + chunkEnd * binCount, 0u);
+            for (int chunk = chunkBegin; chunk < chunkEnd; chunk++)
+            {
+                binChunk(chunk, false);
+            }
+        });
+
+    size_t total = 0;
+    for (int bin = 0; bin < binCount; bin++)
+    {
+        m_BinStarts[bin] = (unsigned int)total;
+        for (int chunk = 0; chunk < chunkCount; chunk++)
+        {
+            unsigned int count = m_BinCursors[chunk * binCount + bin];
+            m_BinCursors[chunk * binCount + bin] = (unsigned int)total;
+            total += count;
+        }
+    }
+    m_BinStarts[binCount] = (unsigned int)total;
+
+    // only splats and triangles can overlap more than one band, and no more than MaxSplatRadius and MaxTriangleBands allow for
+    assert(total <= m_BinPointCapacity);
+
+    m_ThreadPool->ParallelFor(0, chunkCount, 1, [=](int chunkBegin, int chunkEnd)
+        {
+            for (int chunk = chunkBegin; chunk < chunkEnd; chunk++)
+            {
+                binChunk(chunk, true);
+            }
+        });
+}
+
+/// <summary>
+/// The rasteriser and output merger for one band of render target rows: every point (or splat disc) binned to
+/// the band is depth tested (less than) against the depth buffer, nearest point wins.
+/// A pixel is covered when its centre is inside the splat disc; without splatting a point covers the one
+/// pixel it falls in, like the D3D point list.
+/// </summary>
+/// <param name="bin">the band</param>
+/// <param name="rowBegin">first render target row of the band</param>
+/// <param name="rowEnd">one past the last render target row of the band</param>
+void CpuPointCloudRenderer::RasterizeBin(int bin, int rowBegin, int rowEnd)
+{
+    const unsigned int* binPoints = m_BinPoints;
+    for (unsigned int i = m_BinStarts[bin]; i < m_BinStarts[bin + 1]; i++)
+    {
+        RasterizePoint(m_ScreenPoints[binPoints[i]], rowBegin, rowEnd);
+    }
+}
+
+void CpuPointCloudRenderer::RasterizePoint(const ScreenPoint& sp, int rowBegin, int rowEnd)
+{
+    if (sp.radius < 0.0f)
+        return;
+
+    int width = m_RenderWidth;
+    if (sp.radius == 0.0f)
+    {
+        int px = (int)sp.x, py = (int)sp.y;
+        if (py < rowBegin || py >= rowEnd || px < 0 || px >= width)
+            return;
+
+        int pixel = py * width + px;
+        if (sp.depth < m_DepthBuffer[pixel])
+        {
+            m_DepthBuffer[pixel] = sp.depth;
+            m_ColorBuffer[pixel] = GetTexel(sp.texel);
+        }
+        return;
+    }
+
+    // bounds of the pixel centres inside the disc, clamped to the band
+    int yMin = std::max((int)std::ceil(sp.y - sp.radius - 0.5f), rowBegin);
+    int yMax = std::min((int)std::floor(sp.y + sp.radius - 0.5f), rowEnd - 1);
+    if (yMin > yMax)
+        return;
+    int xMin = std::max((int)std::ceil(sp.x - sp.radius - 0.5f), 0);
+    int xMax = std::min((int)std::floor(sp.x + sp.radius - 0.5f), width - 1);
+    if (xMin > xMax)
+        return;
+
+    // the texel is only looked up once the disc wins a pixel (texels are opaque, so 0 is never a colour)
+    UINT color = 0;
+    float radiusSquared = sp.radius * sp.radius;
+    for (int py = yMin; py <= yMax; py++)
+    {
+        float dy = py + 0.5f - sp.y;
+        float* depthRow = m_DepthBuffer + py * width;
+        UINT* colorRow = m_ColorBuffer + py * width;
+        for (int px = xMin; px <= xMax; px++)
+        {
+            float dx = px + 0.5f - sp.x;
+            if (dx * dx + dy * dy <= radiusSquared && sp.depth < depthRow[px])
+            {
+                if (color == 0)
+                    color = GetTexel(sp.texel);
+                depthRow[px] = sp.depth;
+                colorRow[px] = color;
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Mesh mode rasteriser for one band of render target rows: the triangles binned to the band, merged in draw order
+/// with the big triangles every band walks
+/// </summary>
+/// <param name="bin">the band</param>
+/// <param name="rowBegin">first render target row of the band</param>
+/// <param name="rowEnd">one past the last render target row of the band</param>
+void CpuPointCloudRenderer::RasterizeTriangles(int bin, int rowBegin, int rowEnd)
+{
+    const unsigned int* binTriangles = m_BinPoints;
+    unsigned int i = m_BinStarts[bin], end = m_BinStarts[bin + 1];
+    unsigned int big = m_BinStarts[GetBinCount()], bigEnd = m_BinStarts[GetBinCount() + 1];
+    while (i < end || big < bigEnd)
+    {
+        if (big == bigEnd || (i < end && binTriangles[i] < binTriangles[big]))
+            RasterizeTriangle(binTriangles[i++], rowBegin, rowEnd);
+        else
+            RasterizeTriangle(binTriangles[big++], rowBegin, rowEnd);
+    }
+}
+
+/// <summary>
+/// the pixel centres of a band inside a triangle (of either winding) get the depth and texture coordinates interpolated
+/// from its corners, nearest texel, depth tested (less than). Triangles with a dropped or clipped corner are culled
+/// (not binned), as the GPU does.
+/// </summary>
+void CpuPointCloudRenderer::RasterizeTriangle(unsigned int triangle, int rowBegin, int rowEnd)
+{
+    const ScreenPoint& a = m_ScreenPoints[m_MeshIndices[3 * triangle]];
+    const ScreenPoint& b = m_ScreenPoints[m_MeshIndices[3 * triangle + 1]];
+    const ScreenPoint& c = m_ScreenPoints[m_MeshIndices[3 * triangle + 2]];
+
+    int width = m_RenderWidth;
+    int yMin = std::max((int)std::ceil(std::min(std::min(a.y, b.y), c.y) - 0.5f), rowBegin);
+    int yMax = std::min((int)std::floor(std::max(std::max(a.y, b.y), c.y) - 0.5f), rowEnd - 1);
+    if (yMin > yMax)
+        return;
+    int xMin = std::max((int)std::ceil(std::min(std::min(a.x, b.x), c.x) - 0.5f), 0);
+    int xMax = std::min((int)std::floor(std::max(std::max(a.x, b.x), c.x) - 0.5f), width - 1);
+
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area == 0.0f)
+        return;
+    float invArea = 1.0f / area;
+
+    int texWidth = m_InputTexWidth, texHeight = m_InputTexHeight;
+    for (int py = yMin; py <= yMax; py++)
+    {
+        float y = py + 0.5f;
+        float* depthRow = m_DepthBuffer + py * width;
+        UINT* colorRow = m_ColorBuffer + py * width;
+        for (int px = xMin; px <= xMax; px++)
+        {
+            float x = px + 0.5f;
+
+            // barycentric weights, all the same sign as the area inside the triangle
+            float wa = ((b.x - x) * (c.y - y) - (b.y - y) * (c.x - x)) * invArea;
+            float wb = ((c.x - x) * (a.y - y) - (c.y - y) * (a.x - x)) * invArea;
+            float wc = 1.0f - wa - wb;
+            if (wa < 0.0f || wb < 0.0f || wc < 0.0f)
+                continue;
+
+            float depth = wa * a.depth + wb * b.depth + wc * c.depth;
+            if (depth < depthRow[px])
+            {
+                int u = std::min(std::max((int)((wa * a.u + wb * b.u + wc * c.u) * texWidth), 0), texWidth - 1);
+                int t = std::min(std::max((int)((wa * a.v + wb * b.v + wc * c.v) * texHeight), 0), texHeight - 1);
+                depthRow[px] = depth;
+                colorRow[px] = GetTexel(t * texWidth + u);
+            }
+        }
+    }
+}
+
+void CpuPointCloudRenderer::ReadFrame(BYTE* outputFrameBuffer, const int outputFrameLength)
+{
+    assert(outputFrameBuffer != NULL && (outputFrameLength == m_OutputWidth * m_OutputHeight * 3));
+    if (m_Supersample > 1)
+        downsample32bppToRGB(outputFrameBuffer, outputFrameLength, (BYTE*)m_ColorBuffer, 4 * m_RenderWidth);
+    else
+        convert32bppToRGB(outputFrameBuffer, outputFrameLength, (BYTE*)m_ColorBuffer, 4 * m_OutputWidth);
+}
+
+void CpuPointCloudRenderer::ReadFrameRgba(BYTE* rgbaFrameBuffer)
+{
+    assert(rgbaFrameBuffer != NULL);
+    if (m_Supersample > 1)
+        downsample32bppToRgba(rgbaFrameBuffer, (const BYTE*)m_ColorBuffer, 4 * m_RenderWidth);
+    else
+        memcpy(rgbaFrameBuffer, m_ColorBuffer, (size_t)4 * m_OutputWidth * m_OutputHeight);
+}
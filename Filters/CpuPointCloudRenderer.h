@@ -0,0 +1,97 @@
+#pragma once
+
+#include "PointCloudRendererBase.h"
+
+// Software point cloud renderer: the same points, camera, splats and mesh as PointCloudRenderer, rasterised on the
+// CPU (in parallel over bands of output rows, each with its own points binned up front) into an RGBA colour buffer
+// with a float depth buffer.
+// Useful on hosts without a usable D3D11 device, and as a reference image for the GPU path.
+class CpuPointCloudRenderer : public PointCloudRendererBase
+{
+public:
+	CpuPointCloudRenderer();
+	~CpuPointCloudRenderer();
+
+	HRESULT Init(int inputDepthWidth, int inputDepthHeight, int inputTexWidth, int inputTexHeight, TextureFormat textureFormat, int outputWidth, int outputHeight, float clippingDistanceZ, const PointCloudRendererOptions& options, ThreadPool* threadPool, FrameArena* frameArena) override;
+
+	void UnInit() override;
+	HRESULT Resize(int outputWidth, int outputHeight) override;
+
+	void DrawFrame(const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, const void* color_frame_data, const int color_frame_size) override;
+	void ReadFrame(BYTE* outputFrameBuffer, const int outputFrameLength) override;
+	void ReadFrameRgba(BYTE* rgbaFrameBuffer) override;
+	void RedrawFrame() override;
+
+private:
+	// a selected point after the vertex stage
+	struct ScreenPoint
+	{
+		float x;			// rendered pixels (output pixels times the supersample factor)
+		float y;
+		float depth;		// 0..1 like the D3D depth buffer
+		float radius;		// splat radius in rendered pixels, 0 for a single pixel and < 0 if the point is off screen
+		int texel;			// index of the nearest texel to the point's uv, only sampled for the pixels it's drawn into
+		float u;			// texture coordinates, interpolated across mesh triangles
+		float v;
+	};
+
+	// binning: the render target is cut into bands of BinRows rows, and each frame the points and
+	// splats are listed under every band they overlap, in draw order. A band's points then only touch its own rows of
+	// the colour and depth buffers (a few hundred KB at 1080p, so they stay in cache) and no two threads share a pixel.
+	// Both binning passes (count, then scatter) run over fixed chunks of BinChunkRows input rows, so there are no atomics
+	static const int BinShift = 4;
+	static const int BinRows = 1 << BinShift;
+	static const int BinChunkRows = 16;
+	// splats are clamped to this radius in rendered pixels (points that close fill the screen anyway), so a splat
+	// overlaps at most 1 + 2 * MaxSplatRadius / BinRows bands and the band lists can be sized at Init
+	static const int MaxSplatRadius = BinRows;
+	// mesh triangles are binned the same way, by chunks of BinChunkRows rows of grid cells. One that overlaps more than
+	// MaxTriangleBands bands (close to the camera) goes in an extra list that every band walks instead
+	static const int MaxTriangleBands = 2;
+	static const UINT NoBins = 0xffff;	// first band 0xffff, last 0: off screen
+
+	// all in the frame arena, sized at Init
+	PackedVertex* m_Vertices;	// the selected points, as in the vertex buffer
+	ScreenPoint* m_ScreenPoints;
+	BYTE* m_Texture;			// copy of the color (RGB8) or IR (Y8) frame, or RGBA white
+	UINT* m_ColorBuffer;		// RGBA render target, render sized
+	float* m_DepthBuffer;
+	size_t m_PixelCapacity;		// of the colour and depth buffers, which are only reallocated by Resize to grow
+	unsigned int m_PointCount;	// vertices selected by the last DrawFrame
+	UINT* m_PointBins;			// first | last << 16 band each screen point overlaps
+	unsigned int* m_BinPoints;	// indices into m_ScreenPoints (or of triangles), band by band, then the mesh's big triangles
+	size_t m_BinPointCapacity;	// a point per band it overlaps: one each without splatting, up to MaxSplatRadius's worth with,
+								// or MaxTriangleBands per triangle
+	unsigned int* m_BinStarts;	// where each band's points start in m_BinPoints, then the big triangles, plus the total
+	unsigned int* m_BinCursors;	// per chunk and band: the count, then where the chunk's points go
+	size_t m_BinCapacity;
+
+	// RGBA of a texel, IR broadcast to grey and RGB unpacked as by the grey and rgb pixel shaders
+	UINT GetTexel(int index) const
+	{
+		if (m_TextureFormat == TextureFormat::Y8)
+			return m_Texture[index] * 0x010101u | 0xff000000u;
+		if (m_TextureFormat == TextureFormat::Rgb8)
+		{
+			const BYTE* rgb = m_Texture + 3 * index;
+			return rgb[0] | rgb[1] << 8 | rgb[2] << 16 | 0xff000000u;
+		}
+		return ((const UINT*)m_Texture)[index];
+	}
+
+	int GetBinCount() const { return (m_RenderHeight + BinRows - 1) >> BinShift; }
+	int GetBinChunkCount() const { return (m_InputDepthHeight + BinChunkRows - 1) / BinChunkRows; }
+	int GetBinListCount() const { return GetBinCount() + (m_Options.mesh ? 1 : 0); }
+	unsigned int GetTrianglesPerRow() const { return 2 * (m_InputDepthWidth - 1); }
+	void AllocateTargets();
+
+	void RasterizeFrame();
+	void TransformPoints(unsigned int pointCount);
+	void BinPoints(unsigned int pointCount);
+	UINT GetBinRange(const ScreenPoint& sp) const;
+	UINT GetTriangleBinRange(unsigned int triangle) const;
+	void RasterizeBin(int bin, int rowBegin, int rowEnd);
+	void RasterizePoint(const ScreenPoint& sp, int rowBegin, int rowEnd);	// depth tests and draws a point or splat
+	void RasterizeTriangles(int bin, int rowBegin, int rowEnd);
+	void RasterizeTriangle(unsigned int triangle, int rowBegin, int rowEnd);
+};
@@ -0,0 +1,95 @@
+#include "DepthCrop.h"
+
+#include <algorithm>
+#include <cstring>
+#include <emmintrin.h>		// SSE2
+
+DepthCrop::DepthCrop() : rs2::filter([this](rs2::frame frame, rs2::frame_source& source) { Crop(frame, source); }),
+	m_Width(0), m_Height(0), m_Left(0), m_Top(0), m_CropWidth(0), m_CropHeight(0), m_MinDepth(0), m_MaxDepth(UINT16_MAX)
+{
+}
+
+void DepthCrop::SetRegion(int width, int height, int left, int top, int right, int bottom)
+{
+	m_Width = width;
+	m_Height = height;
+	m_Left = std::max(0, std::min(left, width - 1));
+	m_Top = std::max(0, std::min(top, height - 1));
+	m_CropWidth = std::max(1, std::min(right, width) - m_Left);
+	m_CropHeight = std::max(1, std::min(bottom, height) - m_Top);
+
+	// the cropped stream is cloned again for the new size
+	m_SourceProfile = rs2::stream_profile();
+	m_CroppedProfile = rs2::stream_profile();
+}
+
+void DepthCrop::SetDepthRange(uint16_t minDepth, uint16_t maxDepth)
+{
+	m_MinDepth = minDepth;
+	m_MaxDepth = maxDepth > 0 ? maxDepth : UINT16_MAX;
+}
+
+rs2_intrinsics DepthCrop::CropIntrinsics(const rs2_intrinsics& intrinsics) const
+{
+	// the distortion models work on coordinates relative to the principal point, so moving it with the pixels is exact
+	rs2_intrinsics cropped = intrinsics;
+	cropped.width = m_CropWidth;
+	cropped.height = m_CropHeight;
+	cropped.ppx -= m_Left;
+	cropped.ppy -= m_Top;
+	return cropped;
+}
+
+void DepthCrop::Crop(rs2::frame frame, const rs2::frame_source& source)
+{
+	rs2::video_frame depth = frame;
+	if (depth.get_width() != m_Width || depth.get_height() != m_Height)
+	{
+		// not the stream the region was set for
+		source.frame_ready(frame);
+		return;
+	}
+
+	rs2::stream_profile profile = depth.get_profile();
+	if (!m_CroppedProfile || profile.unique_id() != m_SourceProfile.unique_id())
+	{
+		rs2::video_stream_profile videoProfile = profile.as<rs2::video_stream_profile>();
+		m_SourceProfile = profile;
+		m_CroppedProfile = videoProfile.clone(profile.stream_type(), profile.stream_index(), profile.format(), m_CropWidth, m_CropHeight, CropIntrinsics(videoProfile.get_intrinsics()));
+
+		// same origin and axes as the depth stream, so rs2::pointcloud finds the way to the texture's stream through it
+		rs2_extrinsics identity = { { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f } };
+		m_CroppedProfile.register_extrinsics_to(m_SourceProfile, identity);
+	}
+
+	rs2::frame cropped = source.allocate_video_frame(m_CroppedProfile, frame, 2, m_CropWidth, m_CropHeight, 2 * m_CropWidth, RS2_EXTENSION_DEPTH_FRAME);
+	int sourceStride = depth.get_stride_in_bytes() / 2;
+	const uint16_t* sourceRow = (const uint16_t*)depth.get_data() + m_Top * sourceStride + m_Left;
+	uint16_t* croppedRow = (uint16_t*)cropped.get_data();
+	bool clampDepth = m_MinDepth > 0 || m_MaxDepth < UINT16_MAX;
+	__m128i minDepth = _mm_set1_epi16((short)m_MinDepth);
+	__m128i maxDepth = _mm_set1_epi16((short)m_MaxDepth);
+	for (int row = 0; row < m_CropHeight; row++, sourceRow += sourceStride, croppedRow += m_CropWidth)
+	{
+		if (!clampDepth)
+		{
+			memcpy(croppedRow, sourceRow, 2 * m_CropWidth);
+			continue;
+		}
+		// 8 depths at a time: z is in range when both saturating differences are 0 (no depth is 0 already, so a range
+		// starting at 0 keeps it that way)
+		int col = 0;
+		for (; col + 8 <= m_CropWidth; col += 8)
+		{
+			__m128i z = _mm_loadu_si128((const __m128i*)(sourceRow + col));
+			__m128i outside = _mm_or_si128(_mm_subs_epu16(minDepth, z), _mm_subs_epu16(z, maxDepth));
+			_mm_storeu_si128((__m128i*)(croppedRow + col), _mm_and_si128(z, _mm_cmpeq_epi16(outside, _mm_setzero_si128())));
+		}
+		for (; col < m_CropWidth; col++)
+		{
+			uint16_t z = sourceRow[col];
+			croppedRow[col] = z >= m_MinDepth && z <= m_MaxDepth ? z : 0;
+		}
+	}
+	source.frame_ready(cropped);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <librealsense2/rs.hpp>
+#include <cstdint>
+
+// Crops depth frames to a region of interest and zeroes the depths outside a range, before they are deprojected, so
+// that rs2::pointcloud, the dirty frame signature and the renderer only ever see the rows and columns that matter.
+// The cropped frames come from a stream with the depth intrinsics moved to the region's corner and the depth stream's
+// extrinsics, so their points (and texture coordinates) are exactly the ones the full frame would have given.
+// Made once per stream (the cropped stream is cloned from the first frame's), process() runs on the caller's thread.
+class DepthCrop : public rs2::filter
+{
+public:
+	DepthCrop();
+
+	// crop width x height depth frames to columns left..right-1 and rows top..bottom-1 (clamped to the frame)
+	void SetRegion(int width, int height, int left, int top, int right, int bottom);
+
+	// zero the depths nearer than minDepth or farther than maxDepth, in depth units (0 for no limit)
+	void SetDepthRange(uint16_t minDepth, uint16_t maxDepth);
+
+	// nothing to do: the whole frame with no depth range, frames can skip process() altogether
+	bool IsPassThrough() const { return m_Left == 0 && m_Top == 0 && m_CropWidth == m_Width && m_CropHeight == m_Height && m_MinDepth == 0 && m_MaxDepth == UINT16_MAX; }
+
+	int GetWidth() const { return m_CropWidth; }
+	int GetHeight() const { return m_CropHeight; }
+
+	// the intrinsics of the cropped frames, from the full frame's
+	rs2_intrinsics CropIntrinsics(const rs2_intrinsics& intrinsics) const;
+
+private:
+	int m_Width;
+	int m_Height;
+	int m_Left;
+	int m_Top;
+	int m_CropWidth;
+	int m_CropHeight;
+	uint16_t m_MinDepth;
+	uint16_t m_MaxDepth;
+	rs2::stream_profile m_SourceProfile;	// the depth stream the cropped one was cloned from
+	rs2::stream_profile m_CroppedProfile;
+
+	void Crop(rs2::frame frame, const rs2::frame_source& source);
+};
@@ -22,8 +22,12 @@ CVCam::CVCam(LPUNKNOWN lpunk, HRESULT *phr) :
     ASSERT(phr);
     CAutoLock cAutoLock(&m_cStateLock);
 
+    // Only settle the stream format here (for the media types), the camera is opened when the graph first runs
+    // (CVCamStream::OnThreadCreate) so that apps just enumerating or instantiating the filter don't start it up
+    m_realSenseCam.Configure(m_type);
+    m_connected = false;
+
     // Create the one and only output pin
-    m_connected = (m_realSenseCam.Init(m_type) == S_OK);
 
     m_paStreams = (CSourceStream **) new CVCamStream*[1];
     m_paStreams[0] = new CVCamStream(phr, this, L"VCam Realsense");
@@ -49,6 +53,39 @@ HRESULT CVCam::QueryInterface(REFIID riid, void **ppv)
 // CVCamStream is the one and only output pin of CVCam which handles 
 // all the stuff.
 //////////////////////////////////////////////////////////////////////////
+
+// RGB24 for every type but ColorYuy2, which hands the sensor's YUYV on as YUY2
+static void SetOutputFormat(BITMAPINFOHEADER *pbmi, RealSenseCamType type)
+{
+    if (type == RealSenseCamType::ColorYuy2)
+    {
+        pbmi->biCompression = MAKEFOURCC('Y', 'U', 'Y', '2');
+        pbmi->biBitCount    = 16;
+    }
+    else
+    {
+        pbmi->biCompression = BI_RGB;
+        pbmi->biBitCount    = 24;
+    }
+}
+
+// The output sizes offered, GetMediaType position 1 on: the 80x60 multiples up to 640x480 for every type,
+// then the large sizes (PointCloudOutputSizes) that only the point cloud types can render
+static const int PresetOutputSizeCount = 8;
+
+static int GetOutputSizeCount(const RealSenseCam &realSenseCam)
+{
+    return PresetOutputSizeCount + (realSenseCam.IsPointCloudType() ? ARRAYSIZE(PointCloudOutputSizes) : 0);
+}
+
+static SIZE GetOutputSize(int iPosition)
+{
+    if (iPosition > PresetOutputSizeCount)
+        return PointCloudOutputSizes[iPosition - PresetOutputSizeCount - 1];
+    SIZE size = { 80 * iPosition, 60 * iPosition };
+    return size;
+}
+
 CVCamStream::CVCamStream(HRESULT *phr, CVCam *pParent, LPCWSTR pPinName) :
     CSourceStream(NAME("VCam Realsense"),phr, pParent, pPinName), m_pParent(pParent)
 {
@@ -63,7 +100,8 @@ CVCamStream::CVCamStream(HRESULT *phr, CVCam *pParent, LPCWSTR pPinName) :
         GetMediaType(4, &m_mt); // 320x240x3 output size
         break;
     case RealSenseCamType::Color:
-        GetMediaType(8, &m_mt); // 640x480x3 output size
+    case RealSenseCamType::ColorYuy2:
+        GetMediaType(8, &m_mt); // 640x480x3 (or x2 for YUY2) output size
         break;
     case RealSenseCamType::PointCloud:
     case RealSenseCamType::PointCloudIR:
@@ -118,7 +156,9 @@ HRESULT CVCamStream::FillBuffer(IMediaSample *pms)
     if (m_pParent->m_connected)
     {
         // can remove the local variables now too
-        m_pParent->m_realSenseCam.GetCamFrame(pData, lDataLen);
+        // S_FALSE ends the stream: the camera has stopped (unplugged, say) and there won't be any more frames
+        if (!m_pParent->m_realSenseCam.GetCamFrame(pData, lDataLen))
+            return S_FALSE;
     }
 
     return NOERROR;
@@ -140,6 +180,11 @@ HRESULT CVCamStream::SetMediaType(const CMediaType *pmt)
 {
     DECLARE_PTR(VIDEOINFOHEADER, pvi, pmt->Format());
     HRESULT hr = CSourceStream::SetMediaType(pmt);
+
+    // the graph is stopped while the pin (re)connects, so the camera can be resized in place: the sensor keeps
+    // streaming and the renderer only recreates its output sized resources (fails for a type that can't be resized)
+    if (SUCCEEDED(hr))
+        hr = m_pParent->m_realSenseCam.SetOutputSize(pvi->bmiHeader.biWidth, abs(pvi->bmiHeader.biHeight));
     return hr;
 }
 
@@ -147,7 +192,7 @@ HRESULT CVCamStream::SetMediaType(const CMediaType *pmt)
 HRESULT CVCamStream::GetMediaType(int iPosition, CMediaType *pmt)
 {
     if(iPosition < 0) return E_INVALIDARG;
-    if(iPosition > 8) return VFW_S_NO_MORE_ITEMS;
+    if(iPosition > GetOutputSizeCount(m_pParent->m_realSenseCam)) return VFW_S_NO_MORE_ITEMS;
 
     if(iPosition == 0) 
     {
@@ -158,16 +203,16 @@ HRESULT CVCamStream::GetMediaType(int iPosition, CMediaType *pmt)
     DECLARE_PTR(VIDEOINFOHEADER, pvi, pmt->AllocFormatBuffer(sizeof(VIDEOINFOHEADER)));
     ZeroMemory(pvi, sizeof(VIDEOINFOHEADER));
 
-    pvi->bmiHeader.biCompression = BI_RGB;
-    pvi->bmiHeader.biBitCount    = 24;
+    SetOutputFormat(&pvi->bmiHeader, m_pParent->m_type);
     pvi->bmiHeader.biSize       = sizeof(BITMAPINFOHEADER);
-    pvi->bmiHeader.biWidth      = 80 * iPosition;
-    pvi->bmiHeader.biHeight     = 60 * iPosition;
+    SIZE size = GetOutputSize(iPosition);
+    pvi->bmiHeader.biWidth      = size.cx;
+    pvi->bmiHeader.biHeight     = size.cy;
     pvi->bmiHeader.biPlanes     = 1;
     pvi->bmiHeader.biSizeImage  = GetBitmapSize(&pvi->bmiHeader);
     pvi->bmiHeader.biClrImportant = 0;
 
-    pvi->AvgTimePerFrame = 333333;
+    pvi->AvgTimePerFrame = m_pParent->m_realSenseCam.GetFrameInterval();
 
     SetRectEmpty(&(pvi->rcSource)); // we want the whole image area rendered.
     SetRectEmpty(&(pvi->rcTarget)); // no particular destination rectangle
@@ -217,6 +262,10 @@ HRESULT CVCamStream::DecideBufferSize(IMemAllocator *pAlloc, ALLOCATOR_PROPERTIE
 HRESULT CVCamStream::OnThreadCreate()
 {
     m_rtLastTime = 0;
+
+    // first run: open the camera. No state lock here, Active holds it while it waits for this
+    if (!m_pParent->m_connected)
+        m_pParent->m_connected = (m_pParent->m_realSenseCam.Init(m_pParent->m_type) == S_OK);
     return NOERROR;
 } // OnThreadCreate
 
@@ -247,23 +296,28 @@ HRESULT STDMETHODCALLTYPE CVCamStream::GetFormat(AM_MEDIA_TYPE **ppmt)
 
 HRESULT STDMETHODCALLTYPE CVCamStream::GetNumberOfCapabilities(int *piCount, int *piSize)
 {
-    *piCount = 8;
+    *piCount = GetOutputSizeCount(m_pParent->m_realSenseCam);
     *piSize = sizeof(VIDEO_STREAM_CONFIG_CAPS);
     return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CVCamStream::GetStreamCaps(int iIndex, AM_MEDIA_TYPE **pmt, BYTE *pSCC)
 {
+    // check first, so a caller walking past the end isn't handed a media type it never frees
+    if (iIndex < 0 || iIndex >= GetOutputSizeCount(m_pParent->m_realSenseCam)) return E_INVALIDARG;
+
     *pmt = CreateMediaType(&m_mt);
+    if (!*pmt) return E_OUTOFMEMORY;
     DECLARE_PTR(VIDEOINFOHEADER, pvi, (*pmt)->pbFormat);
 
-    if (iIndex == 0) iIndex = 4;
+    // 320x240 first, then the other presets and the large sizes after them: GetMediaType positions 4, 1-3, 5 on
+    int iPosition = iIndex == 0 ? 4 : (iIndex < 4 ? iIndex : iIndex + 1);
+    SIZE size = GetOutputSize(iPosition);
 
-    pvi->bmiHeader.biCompression = BI_RGB;
-    pvi->bmiHeader.biBitCount    = 24;
+    SetOutputFormat(&pvi->bmiHeader, m_pParent->m_type);
     pvi->bmiHeader.biSize       = sizeof(BITMAPINFOHEADER);
-    pvi->bmiHeader.biWidth      = 80 * iIndex;
-    pvi->bmiHeader.biHeight     = 60 * iIndex;
+    pvi->bmiHeader.biWidth      = size.cx;
+    pvi->bmiHeader.biHeight     = size.cy;
     pvi->bmiHeader.biPlanes     = 1;
     pvi->bmiHeader.biSizeImage  = GetBitmapSize(&pvi->bmiHeader);
     pvi->bmiHeader.biClrImportant = 0;
@@ -272,7 +326,7 @@ HRESULT STDMETHODCALLTYPE CVCamStream::GetStreamCaps(int iIndex, AM_MEDIA_TYPE *
     SetRectEmpty(&(pvi->rcTarget)); // no particular destination rectangle
 
     (*pmt)->majortype = MEDIATYPE_Video;
-    (*pmt)->subtype = MEDIASUBTYPE_RGB24;
+    (*pmt)->subtype = GetBitmapSubtype(&pvi->bmiHeader);
     (*pmt)->formattype = FORMAT_VideoInfo;
     (*pmt)->bTemporalCompression = FALSE;
     (*pmt)->bFixedSizeSamples= FALSE;
@@ -283,12 +337,12 @@ HRESULT STDMETHODCALLTYPE CVCamStream::GetStreamCaps(int iIndex, AM_MEDIA_TYPE *
     
     pvscc->guid = FORMAT_VideoInfo;
     pvscc->VideoStandard = AnalogVideo_None;
-    pvscc->InputSize.cx = 80 * iIndex;
-    pvscc->InputSize.cy = 60 * iIndex;
+    pvscc->InputSize.cx = size.cx;
+    pvscc->InputSize.cy = size.cy;
     pvscc->MinCroppingSize.cx = 80;
     pvscc->MinCroppingSize.cy = 60;
-    pvscc->MaxCroppingSize.cx = 80 * iIndex;
-    pvscc->MaxCroppingSize.cy = 60 * iIndex;
+    pvscc->MaxCroppingSize.cx = size.cx;
+    pvscc->MaxCroppingSize.cy = size.cy;
     pvscc->CropGranularityX = 80;
     pvscc->CropGranularityY = 60;
     pvscc->CropAlignX = 0;
@@ -296,18 +350,23 @@ HRESULT STDMETHODCALLTYPE CVCamStream::GetStreamCaps(int iIndex, AM_MEDIA_TYPE *
 
     pvscc->MinOutputSize.cx = 80;
     pvscc->MinOutputSize.cy = 60;
-    pvscc->MaxOutputSize.cx = 80 * iIndex;
-    pvscc->MaxOutputSize.cy = 60 * iIndex;
+    pvscc->MaxOutputSize.cx = size.cx;
+    pvscc->MaxOutputSize.cy = size.cy;
     pvscc->OutputGranularityX = 0;
     pvscc->OutputGranularityY = 0;
     pvscc->StretchTapsX = 0;
     pvscc->StretchTapsY = 0;
     pvscc->ShrinkTapsX = 0;
     pvscc->ShrinkTapsY = 0;
-    pvscc->MinFrameInterval = 333333;   // 30 fps
-    pvscc->MaxFrameInterval = 333333; // 30 fps
-    pvscc->MinBitsPerSecond = (80 * 60 * 3 * 16) * 30;
-    pvscc->MaxBitsPerSecond = (80 * iIndex) * (60 * iIndex) * 3 * 16 * 30;
+    // 30 fps, or a multiple of it for point clouds with synthesized frames in between
+    REFERENCE_TIME frameInterval = m_pParent->m_realSenseCam.GetFrameInterval();
+    LONG framesPerSecond = (LONG)(10000000 / frameInterval);
+    pvscc->MinFrameInterval = frameInterval;
+    pvscc->MaxFrameInterval = frameInterval;
+    pvscc->MinBitsPerSecond = 80 * 60 * pvi->bmiHeader.biBitCount * framesPerSecond;
+    // (clamped, the largest sizes no longer fit a LONG)
+    LONGLONG maxBitsPerSecond = (LONGLONG)pvi->bmiHeader.biSizeImage * 8 * framesPerSecond;
+    pvscc->MaxBitsPerSecond = maxBitsPerSecond > LONG_MAX ? LONG_MAX : (LONG)maxBitsPerSecond;
 
     return S_OK;
 }
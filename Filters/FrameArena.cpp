@@ -0,0 +1,69 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+FrameArena::FrameArena() : m_Current(nullptr), m_CurrentRemaining(0), m_BytesReserved(0), m_BytesAllocated(0), m_AllocationCount(0), m_SteadyStateAllocationCount(0), m_Sealed(false)
+{
+}
+
+FrameArena::~FrameArena()
+{
+	Release();
+}
+
+void FrameArena::Reserve(size_t bytes)
+{
+	if (bytes > m_CurrentRemaining)
+		AddBlock(bytes);
+}
+
+void FrameArena::Release()
+{
+	for (auto block : m_Blocks)
+		delete[] block;
+	m_Blocks.clear();
+
+	m_Current = nullptr;
+	m_CurrentRemaining = 0;
+	m_BytesReserved = 0;
+	m_BytesAllocated = 0;
+	m_AllocationCount = 0;
+	m_SteadyStateAllocationCount = 0;
+	m_Sealed = false;
+}
+
+unsigned char* FrameArena::Allocate(size_t bytes)
+{
+	// keep every buffer starting on its own cache line so threads filling neighbouring buffers don't share lines
+	bytes = (bytes + Alignment - 1) & ~(Alignment - 1);
+
+	if (m_Sealed)
+	{
+		// Init should have asked for everything already
+		assert(false);
+		++m_SteadyStateAllocationCount;
+	}
+
+	if (bytes > m_CurrentRemaining)
+		AddBlock(std::max(bytes, (size_t)MinBlockSize));
+
+	unsigned char* buffer = m_Current;
+	m_Current += bytes;
+	m_CurrentRemaining -= bytes;
+	m_BytesAllocated += bytes;
+	++m_AllocationCount;
+	return buffer;
+}
+
+void FrameArena::AddBlock(size_t bytes)
+{
+	// over-allocate so the start of the block can be aligned
+	unsigned char* block = new unsigned char[bytes + Alignment];
+	m_Blocks.push_back(block);
+	m_BytesReserved += bytes;
+
+	m_Current = (unsigned char*)(((uintptr_t)block + Alignment - 1) & ~(uintptr_t)(Alignment - 1));
+	m_CurrentRemaining = bytes;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Owns the intermediate frame buffers of the capture path (vertex row counts, pipelined RGBA frames etc.)
+// so that they are all allocated at Init and streaming doesn't touch the heap. Buffers are bump-allocated
+// from a few large blocks and are only freed all together on Release.
+// Once Seal() has been called (at the end of Init) any further Allocate still works but is counted as a
+// steady-state allocation, so a non-zero GetSteadyStateAllocationCount() flags a buffer that slipped
+// into the per-frame path. The one exception is a resize to a bigger output, which grows the output sized
+// buffers between Unseal() and Seal() with streaming stopped (only ever growing, so at most a few times).
+class FrameArena
+{
+public:
+	FrameArena();
+	~FrameArena();
+
+	// allocate a block up front that is big enough for everything Init is about to ask for
+	void Reserve(size_t bytes);
+	void Release();
+
+	// 64-byte (cache line) aligned, uninitialised, lives until Release
+	unsigned char* Allocate(size_t bytes);
+	template <typename T>
+	T* Allocate(size_t count) { return reinterpret_cast<T*>(Allocate(count * sizeof(T))); }
+
+	void Seal() { m_Sealed = true; }
+	void Unseal() { m_Sealed = false; }
+
+	size_t GetBytesReserved() const { return m_BytesReserved; }
+	size_t GetBytesAllocated() const { return m_BytesAllocated; }
+	unsigned int GetAllocationCount() const { return m_AllocationCount; }
+	unsigned int GetHeapAllocationCount() const { return (unsigned int)m_Blocks.size(); }
+	unsigned int GetSteadyStateAllocationCount() const { return m_SteadyStateAllocationCount; }
+
+private:
+	static const size_t Alignment = 64;
+	static const size_t MinBlockSize = 1 << 20;
+
+	std::vector<unsigned char*> m_Blocks;
+	unsigned char* m_Current;		// next free byte in the last block
+	size_t m_CurrentRemaining;
+	size_t m_BytesReserved;
+	size_t m_BytesAllocated;
+	unsigned int m_AllocationCount;
+	unsigned int m_SteadyStateAllocationCount;
+	bool m_Sealed;
+
+	void AddBlock(size_t bytes);
+};
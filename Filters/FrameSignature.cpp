@@ -0,0 +1,94 @@
+#include "FrameSignature.h"
+
+#include <algorithm>
+#include <emmintrin.h>		// SSE2
+
+FrameSignature::FrameSignature() : m_RowBytes(0), m_Height(0), m_BytesPerElement(1), m_BlocksX(0), m_BlockCount(0), m_Sums(nullptr), m_ReferenceSums(nullptr), m_HaveReference(false)
+{
+}
+
+void FrameSignature::Init(int width, int height, int bytesPerPixel, int bytesPerElement, FrameArena* frameArena)
+{
+	m_RowBytes = width * bytesPerPixel;
+	m_Height = height;
+	m_BytesPerElement = bytesPerElement;
+	m_BlocksX = (m_RowBytes + BlockBytes - 1) / BlockBytes;
+	m_BlockCount = m_BlocksX * ((height + BlockRows - 1) / BlockRows);
+	m_Sums = frameArena->Allocate<unsigned int>(m_BlockCount);
+	m_ReferenceSums = frameArena->Allocate<unsigned int>(m_BlockCount);
+	m_HaveReference = false;
+}
+
+bool FrameSignature::Update(const void* data, int threshold)
+{
+	Sum((const unsigned char*)data);
+
+	bool changed = !m_HaveReference;
+	for (int block = 0; block < m_BlockCount && !changed; block++)
+	{
+		// edge blocks can be short of rows or bytes
+		int blockRows = std::min((int)BlockRows, m_Height - (block / m_BlocksX) * BlockRows);
+		int blockBytes = std::min((int)BlockBytes, m_RowBytes - (block % m_BlocksX) * BlockBytes);
+		unsigned int limit = (unsigned int)threshold * (blockRows * blockBytes / m_BytesPerElement);
+
+		unsigned int sum = m_Sums[block], reference = m_ReferenceSums[block];
+		changed = (sum > reference ? sum - reference : reference - sum) > limit;
+	}
+
+	if (changed)
+	{
+		std::swap(m_Sums, m_ReferenceSums);
+		m_HaveReference = true;
+	}
+	return changed;
+}
+
+void FrameSignature::Sum(const unsigned char* data)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int blocksY = (m_Height + BlockRows - 1) / BlockRows;
+
+	for (int by = 0; by < blocksY; by++)
+	{
+		int rowBegin = by * BlockRows;
+		int rowEnd = std::min(rowBegin + BlockRows, m_Height);
+		unsigned int* sums = m_Sums + by * m_BlocksX;
+
+		for (int bx = 0; bx < m_BlocksX; bx++)
+		{
+			int byteBegin = bx * BlockBytes;
+			int byteEnd = std::min(byteBegin + BlockBytes, m_RowBytes);
+			int vectorEnd = byteBegin + (byteEnd - byteBegin) / 16 * 16;
+			unsigned int sum = 0;
+
+			// Z16 is widened to 32 bit lanes, 8 bit data goes through psadbw against zero
+			__m128i acc = zero;
+			for (int row = rowBegin; row < rowEnd; row++)
+			{
+				const unsigned char* line = data + (size_t)row * m_RowBytes;
+				for (int i = byteBegin; i < vectorEnd; i += 16)
+				{
+					__m128i v = _mm_loadu_si128((const __m128i*)(line + i));
+					if (m_BytesPerElement == 2)
+						acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero)));
+					else
+						acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+				}
+
+				// the odd bytes at the end of a row that isn't a multiple of 16
+				for (int i = vectorEnd; i < byteEnd; i += m_BytesPerElement)
+				{
+					sum += m_BytesPerElement == 2 ? *(const unsigned short*)(line + i) : line[i];
+				}
+			}
+
+			unsigned int lanes[4];
+			_mm_storeu_si128((__m128i*)lanes, acc);
+			if (m_BytesPerElement == 2)
+				sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			else
+				sum += lanes[0] + lanes[2];		// psadbw leaves its two sums in the low half of each 64 bit lane
+			sums[bx] = sum;
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "FrameArena.h"
+
+// Cheap change detector for the sensor frames: a frame is summed over blocks of 16 rows by 64 bytes
+// (SSE2, 16 bytes at a time) and compared with the sums of the last frame that was let through.
+// A frame only counts as changed when some block's average moves by more than the threshold, so
+// sensor noise (which mostly averages out over a block) doesn't, and slow drift still does eventually
+// because the comparison is against the last changed frame rather than the previous one.
+class FrameSignature
+{
+public:
+	FrameSignature();
+
+	// bytesPerElement is 1 (Y8, RGB8, RGBA8) or 2 (Z16); the block sums live in the frame arena
+	void Init(int width, int height, int bytesPerPixel, int bytesPerElement, FrameArena* frameArena);
+
+	// returns true if the frame differs from the reference frame by more than threshold (in element units,
+	// e.g. depth units or 8 bit levels) on average over any block, and if so makes it the new reference
+	bool Update(const void* data, int threshold);
+
+	// forget the reference, so the next frame counts as changed
+	void Reset() { m_HaveReference = false; }
+
+private:
+	static const int BlockRows = 16;
+	static const int BlockBytes = 64;
+
+	int m_RowBytes;
+	int m_Height;
+	int m_BytesPerElement;
+	int m_BlocksX;
+	int m_BlockCount;
+	unsigned int* m_Sums;				// this frame's block sums
+	unsigned int* m_ReferenceSums;		// the last changed frame's
+	bool m_HaveReference;
+
+	void Sum(const unsigned char* data);
+};
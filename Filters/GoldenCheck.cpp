@@ -0,0 +1,431 @@
+// Golden image regression check for the output kernels and the point cloud renderers, on fixed SyntheticScene frames.
+// The kernels' reference images are committed in Filters/golden. On Windows run it from the Filters.dll output
+// directory with
+//     rundll32 Filters.dll,RunGoldenCheck <directory> [record]
+// Elsewhere only the kernel half builds (the Direct3D renderer needs Windows), as a program taking the same arguments.
+// "record" writes the reference images into the directory (from the scalar kernels), otherwise every kernel variant
+// this CPU supports is compared against them, per pixel and by PSNR.
+// The renderers' images depend on the compiler and the DirectXMath version they're built with, so there are no
+// committed ones: the Direct3D renderer is compared against the CPU renderer's output from the same run and build.
+// The results (with timings) go to goldencheck.json in the directory, any output that fails is saved next to its
+// golden image (or the CPU renderer's) for a look, and the process exit code is the number of failures.
+
+#include "PixelKernels.h"
+#include "SyntheticScene.h"
+#ifdef _WIN32
+#include "CpuPointCloudRenderer.h"
+#include "PointCloudRenderer.h"
+#else
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static const int GoldenFrameNumber = 20;	// ball a little right of centre
+static const float GoldenCameraTime = 1.0f;
+static const int OutputWidth = 640;
+static const int OutputHeight = 480;
+
+// how close an output has to be to its golden image: kernel variants must match exactly, the renderers only closely
+// (the GPU's rasterisation rules and texture filtering differ slightly from the CPU reference)
+struct Tolerance
+{
+	int pixel;					// largest per-channel difference that still counts as the same
+	double maxBadFraction;		// of the pixels, allowed to differ by more
+	double minPsnr;				// dB
+};
+
+static const Tolerance ExactTolerance = { 0, 0.0, 100.0 };
+static const Tolerance RendererTolerance = { 24, 0.01, 30.0 };
+
+struct GoldenImage
+{
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> pixels;	// 24bpp
+};
+
+struct GoldenResult
+{
+	std::string name;
+	std::string variant;
+	double milliseconds = 0.0;	// best of a few runs
+	bool haveGolden = false;
+	int maxDifference = 0;
+	double badFraction = 0.0;
+	double psnr = 0.0;
+	bool pass = false;
+};
+
+static std::wstring Widen(const std::string& text)
+{
+	return std::wstring(text.begin(), text.end());
+}
+
+static FILE* OpenFile(const std::wstring& path, const wchar_t* mode)
+{
+#ifdef _WIN32
+	return _wfopen(path.c_str(), mode);
+#else
+	// the paths come from the command line, so they're narrow to begin with
+	std::wstring wideMode = mode;
+	return fopen(std::string(path.begin(), path.end()).c_str(), std::string(wideMode.begin(), wideMode.end()).c_str());
+#endif
+}
+
+// binary PPM, which any image viewer can open. The output frames are BGR, PPM is RGB
+static bool WritePpm(const std::wstring& path, const GoldenImage& image)
+{
+	FILE* file = OpenFile(path, L"wb");
+	if (!file)
+		return false;
+	fprintf(file, "P6\n%d %d\n255\n", image.width, image.height);
+	std::vector<uint8_t> rgb(image.pixels);
+	for (size_t i = 0; i + 2 < rgb.size(); i += 3)
+		std::swap(rgb[i], rgb[i + 2]);
+	fwrite(rgb.data(), 1, rgb.size(), file);
+	fclose(file);
+	return true;
+}
+
+static bool ReadPpm(const std::wstring& path, GoldenImage& image)
+{
+	FILE* file = OpenFile(path, L"rb");
+	if (!file)
+		return false;
+	int maxValue = 0;
+	bool valid = fscanf(file, "P6 %d %d %d", &image.width, &image.height, &maxValue) == 3 && maxValue == 255 && fgetc(file) != EOF;
+	if (valid)
+	{
+		image.pixels.resize((size_t)image.width * image.height * 3);
+		valid = fread(image.pixels.data(), 1, image.pixels.size(), file) == image.pixels.size();
+		for (size_t i = 0; i + 2 < image.pixels.size(); i += 3)
+			std::swap(image.pixels[i], image.pixels[i + 2]);
+	}
+	fclose(file);
+	return valid;
+}
+
+static void Compare(const GoldenImage& output, const GoldenImage& golden, const Tolerance& tolerance, GoldenResult& result)
+{
+	result.haveGolden = true;
+	if (output.width != golden.width || output.height != golden.height)
+		return;
+
+	double squaredError = 0.0;
+	int badPixels = 0;
+	for (size_t i = 0; i < output.pixels.size(); i += 3)
+	{
+		int pixelDifference = 0;
+		for (size_t c = i; c < i + 3; c++)
+		{
+			int difference = abs(output.pixels[c] - golden.pixels[c]);
+			pixelDifference = std::max(pixelDifference, difference);
+			squaredError += difference * difference;
+		}
+		result.maxDifference = std::max(result.maxDifference, pixelDifference);
+		if (pixelDifference > tolerance.pixel)
+			badPixels++;
+	}
+
+	// identical images have infinite PSNR, which JSON can't hold
+	double mse = squaredError / output.pixels.size();
+	result.psnr = mse > 0.0 ? std::min(100.0, 10.0 * log10(255.0 * 255.0 / mse)) : 100.0;
+	result.badFraction = (double)badPixels / (output.width * output.height);
+	result.pass = result.badFraction <= tolerance.maxBadFraction && result.psnr >= tolerance.minPsnr;
+}
+
+/// <summary>
+/// record or check one output: the reference variant records the golden image, the rest are compared with it
+/// </summary>
+static void CheckOutput(const std::wstring& directory, bool record, bool reference, const GoldenImage& output, const Tolerance& tolerance, GoldenResult& result)
+{
+	std::wstring goldenPath = directory + L"/" + Widen(result.name) + L".ppm";
+	if (record)
+	{
+		if (reference)
+			result.pass = WritePpm(goldenPath, output);
+		else
+			result.pass = true;
+		return;
+	}
+
+	GoldenImage golden;
+	if (ReadPpm(goldenPath, golden))
+		Compare(output, golden, tolerance, result);
+	if (!result.pass)
+		WritePpm(directory + L"/" + Widen(result.name) + L"-" + Widen(result.variant) + L".ppm", output);
+}
+
+// YUY2 (BT.601 studio range) to 24bpp BGR, just to make the YUY2 output viewable and comparable as a PPM
+static void Yuy2ToBgr(const uint8_t* yuy2, int pixelCount, uint8_t* bgr)
+{
+	for (int i = 0; i < pixelCount; i += 2)
+	{
+		const uint8_t* macropixel = yuy2 + 2 * i;
+		int u = macropixel[1] - 128, v = macropixel[3] - 128;
+		for (int p = 0; p < 2; p++)
+		{
+			int c = 298 * (macropixel[2 * p] - 16);
+			uint8_t* pixel = bgr + 3 * (i + p);
+			pixel[0] = (uint8_t)std::min(std::max((c + 516 * u + 128) >> 8, 0), 255);
+			pixel[1] = (uint8_t)std::min(std::max((c - 100 * u - 208 * v + 128) >> 8, 0), 255);
+			pixel[2] = (uint8_t)std::min(std::max((c + 409 * v + 128) >> 8, 0), 255);
+		}
+	}
+}
+
+template <typename Fn>
+static double BestMilliseconds(int runs, Fn fn)
+{
+	double best = 1.0e9;
+	for (int i = 0; i < runs; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+/// <summary>
+/// the RealSenseCam conversions for the IR, Color and point cloud types, for every kernel variant this CPU has
+/// </summary>
+static void CheckKernels(const std::wstring& directory, bool record, std::vector<GoldenResult>& results)
+{
+	const int depthPixels = SyntheticScene::DepthWidth * SyntheticScene::DepthHeight;
+	const int colorPixels = SyntheticScene::ColorWidth * SyntheticScene::ColorHeight;
+	std::vector<uint8_t> infrared(depthPixels), rgb(3 * colorPixels), rgba(4 * colorPixels), yuyv(2 * colorPixels), yuy2(2 * colorPixels);
+	SyntheticScene::FillInfrared(infrared.data(), GoldenFrameNumber);
+	SyntheticScene::FillColor(rgb.data(), 3, GoldenFrameNumber);
+	SyntheticScene::FillColor(rgba.data(), 4, GoldenFrameNumber);
+	SyntheticScene::FillColor(yuyv.data(), 2, GoldenFrameNumber);
+
+	for (int v = 0; v < (int)KernelVariant::Count; v++)
+	{
+		KernelVariant variant = (KernelVariant)v;
+		if (!PixelKernels::IsSupported(variant))
+			continue;
+		const PixelKernels& kernels = PixelKernels::Get(variant);
+
+		GoldenImage output;
+		GoldenResult result;
+		result.variant = PixelKernels::GetVariantName(variant);
+
+		output.width = SyntheticScene::DepthWidth;
+		output.height = SyntheticScene::DepthHeight;
+		output.pixels.resize(3 * depthPixels);
+		result.name = "ir";
+		result.milliseconds = BestMilliseconds(20, [&]() { kernels.ReverseToGrey(output.pixels.data(), infrared.data(), depthPixels); });
+		CheckOutput(directory, record, variant == KernelVariant::Scalar, output, ExactTolerance, result);
+		results.push_back(result);
+
+		output.width = SyntheticScene::ColorWidth;
+		output.height = SyntheticScene::ColorHeight;
+		output.pixels.resize(3 * colorPixels);
+		result = GoldenResult();
+		result.variant = PixelKernels::GetVariantName(variant);
+		result.name = "color";
+		result.milliseconds = BestMilliseconds(20, [&]() { kernels.ReverseBytes(output.pixels.data(), rgb.data(), 3 * colorPixels); });
+		CheckOutput(directory, record, variant == KernelVariant::Scalar, output, ExactTolerance, result);
+		results.push_back(result);
+
+		result = GoldenResult();
+		result.variant = PixelKernels::GetVariantName(variant);
+		result.name = "rgba";
+		result.milliseconds = BestMilliseconds(20, [&]() { kernels.RgbaToBgr(output.pixels.data(), rgba.data(), colorPixels); });
+		CheckOutput(directory, record, variant == KernelVariant::Scalar, output, ExactTolerance, result);
+		results.push_back(result);
+
+		// mirrored row by row as RealSenseCam::mirrorYuy2 does, then made into BGR for the comparison
+		result = GoldenResult();
+		result.variant = PixelKernels::GetVariantName(variant);
+		result.name = "color-yuy2";
+		result.milliseconds = BestMilliseconds(20, [&]()
+			{
+				for (int row = 0; row < SyntheticScene::ColorHeight; row++)
+					kernels.MirrorYuy2(yuy2.data() + 2 * row * SyntheticScene::ColorWidth, yuyv.data() + 2 * row * SyntheticScene::ColorWidth, SyntheticScene::ColorWidth);
+			});
+		Yuy2ToBgr(yuy2.data(), colorPixels, output.pixels.data());
+		CheckOutput(directory, record, variant == KernelVariant::Scalar, output, ExactTolerance, result);
+		results.push_back(result);
+	}
+}
+
+#ifdef _WIN32
+/// <summary>
+/// the point cloud types (plus the splat and mesh modes) through one renderer, with the camera held still. The CPU
+/// renderer's outputs go into references (and are only timed), the Direct3D renderer's are compared with them
+/// </summary>
+static void CheckRenderer(const std::wstring& directory, bool cpu, std::vector<GoldenImage>& references, std::vector<GoldenResult>& results)
+{
+	struct RendererCase
+	{
+		const char* name;
+		bool infrared;
+		bool color;
+		bool splatting;
+		bool mesh;
+	};
+	static const RendererCase Cases[] =
+	{
+		{ "pointcloud", false, false, false, false },
+		{ "pointcloud-ir", true, false, false, false },
+		{ "pointcloud-color", false, true, false, false },
+		{ "pointcloud-color-splat", false, true, true, false },
+		{ "pointcloud-color-mesh", false, true, false, true },
+	};
+
+	const int pointCount = SyntheticScene::DepthWidth * SyntheticScene::DepthHeight;
+	std::vector<float> xyz(3 * pointCount), uv(2 * pointCount);
+	std::vector<uint8_t> infrared(pointCount), rgb(3 * SyntheticScene::ColorWidth * SyntheticScene::ColorHeight);
+	SyntheticScene::FillInfrared(infrared.data(), GoldenFrameNumber);
+	SyntheticScene::FillColor(rgb.data(), 3, GoldenFrameNumber);
+
+	ThreadPool threadPool;
+	threadPool.Start(0, false);
+	FrameArena frameArena;
+
+	for (const RendererCase& rendererCase : Cases)
+	{
+		SyntheticScene::FillPoints(xyz.data(), uv.data(), rendererCase.color, GoldenFrameNumber);
+		int textureWidth = rendererCase.color ? SyntheticScene::ColorWidth : SyntheticScene::DepthWidth;
+		int textureHeight = rendererCase.color ? SyntheticScene::ColorHeight : SyntheticScene::DepthHeight;
+		const void* texture = rendererCase.color ? rgb.data() : rendererCase.infrared ? infrared.data() : NULL;
+		int textureSize = rendererCase.color ? (int)rgb.size() : rendererCase.infrared ? (int)infrared.size() : 0;
+		TextureFormat textureFormat = rendererCase.color ? TextureFormat::Rgb8 : rendererCase.infrared ? TextureFormat::Y8 : TextureFormat::None;
+
+		// the options RealSenseCam::Init uses, apart from the mode under test
+		PointCloudRendererOptions options;
+		options.levelOfDetail = true;
+		options.splatting = rendererCase.splatting;
+		options.mesh = rendererCase.mesh;
+		options.cameraTime = GoldenCameraTime;
+
+		frameArena.Release();
+		frameArena.Reserve((size_t)4 << 20);
+		PointCloudRendererBase* renderer = cpu ? (PointCloudRendererBase*)new CpuPointCloudRenderer() : new PointCloudRenderer();
+		renderer->Init(SyntheticScene::DepthWidth, SyntheticScene::DepthHeight, textureWidth, textureHeight, textureFormat, OutputWidth, OutputHeight, 1.3f, options, &threadPool, &frameArena);
+		renderer->SetDepthFocalLength(SyntheticScene::DepthFocalLength);
+
+		GoldenImage output;
+		output.width = OutputWidth;
+		output.height = OutputHeight;
+		output.pixels.resize(3 * OutputWidth * OutputHeight);
+		GoldenResult result;
+		result.name = rendererCase.name;
+		result.variant = cpu ? "cpu" : "d3d";
+		result.milliseconds = BestMilliseconds(5, [&]()
+			{
+				renderer->RenderFrame(output.pixels.data(), (int)output.pixels.size(), pointCount, xyz.data(), uv.data(), texture, textureSize);
+			});
+		if (cpu)
+		{
+			result.pass = true;
+			references.push_back(output);
+		}
+		else
+		{
+			const GoldenImage& reference = references[&rendererCase - Cases];
+			Compare(output, reference, RendererTolerance, result);
+			if (!result.pass)
+			{
+				WritePpm(directory + L"/" + Widen(result.name) + L"-cpu.ppm", reference);
+				WritePpm(directory + L"/" + Widen(result.name) + L"-d3d.ppm", output);
+			}
+		}
+		results.push_back(result);
+
+		renderer->UnInit();
+		delete renderer;
+	}
+	threadPool.Stop();
+}
+
+// PointCloudRenderer asserts it gets a device, so only try it where there is one
+static bool HaveD3DDevice()
+{
+	return SUCCEEDED(D3D11CreateDevice(NULL, D3D_DRIVER_TYPE_HARDWARE, NULL, 0, NULL, 0, D3D11_SDK_VERSION, NULL, NULL, NULL));
+}
+
+#endif
+
+/// <summary>
+/// check (or record) everything this platform can run, write goldencheck.json and return the number of failures
+/// </summary>
+static int RunGoldenCheck(const std::wstring& directory, bool record)
+{
+	std::vector<GoldenResult> results;
+	CheckKernels(directory, record, results);
+#ifdef _WIN32
+	if (!record)
+	{
+		std::vector<GoldenImage> references;
+		CheckRenderer(directory, true, references, results);
+		if (HaveD3DDevice())
+			CheckRenderer(directory, false, references, results);
+	}
+#endif
+
+	int failures = 0;
+	FILE* file = OpenFile(directory + L"/goldencheck.json", L"w");
+	if (file)
+		fprintf(file, "{\n  \"record\": %s,\n  \"bestKernels\": \"%s\",\n  \"results\": [\n", record ? "true" : "false", PixelKernels::GetVariantName(PixelKernels::GetBestVariant()));
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const GoldenResult& result = results[i];
+		if (!result.pass)
+			failures++;
+		if (!file)
+			continue;
+
+		fprintf(file, "    { \"name\": \"%s\", \"variant\": \"%s\", \"milliseconds\": %.3f, ", result.name.c_str(), result.variant.c_str(), result.milliseconds);
+		if (result.haveGolden)
+			fprintf(file, "\"maxDifference\": %d, \"badFraction\": %.5f, \"psnr\": %.2f, ", result.maxDifference, result.badFraction, result.psnr);
+		fprintf(file, "\"pass\": %s }%s\n", result.pass ? "true" : "false", i + 1 == results.size() ? "" : ",");
+	}
+	if (file)
+	{
+		fprintf(file, "  ]\n}\n");
+		fclose(file);
+	}
+	return failures;
+}
+
+#ifdef _WIN32
+/// <summary>
+/// rundll32 entry point: "<directory> [record]"
+/// </summary>
+extern "C" void CALLBACK RunGoldenCheckW(HWND hwnd, HINSTANCE instance, LPWSTR commandLine, int show)
+{
+	std::wstring arguments = commandLine;
+	bool record = false;
+	size_t recordAt = arguments.rfind(L" record");
+	if (recordAt != std::wstring::npos && recordAt + 7 == arguments.size())
+	{
+		record = true;
+		arguments.erase(recordAt);
+	}
+	std::wstring directory = arguments.empty() ? L"golden" : arguments;
+	CreateDirectoryW(directory.c_str(), NULL);
+
+	ExitProcess(RunGoldenCheck(directory, record));
+}
+#else
+int main(int argc, char* argv[])
+{
+	std::wstring directory = Widen(argc > 1 ? argv[1] : "golden");
+	bool record = argc > 2 && std::string(argv[2]) == "record";
+	mkdir(std::string(directory.begin(), directory.end()).c_str(), 0777);
+
+	return RunGoldenCheck(directory, record);
+}
+#endif
@@ -0,0 +1,267 @@
+#include "PixelKernels.h"
+
+#include <immintrin.h>		// SSSE3, AVX2
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// MSVC compiles any intrinsic anywhere, gcc/clang need to be told which functions may use them
+#if defined(__GNUC__)
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_TARGET(isa)
+#endif
+
+// scalar: the reference the other variants are checked against, and the tails of their loops
+
+static void RgbaToBgrScalar(unsigned char* dst, const unsigned char* src, int pixelCount)
+{
+	for (int i = 0; i < pixelCount; ++i)
+	{
+		dst[3 * i] = src[4 * i + 2];
+		dst[3 * i + 1] = src[4 * i + 1];
+		dst[3 * i + 2] = src[4 * i + 0];
+	}
+}
+
+static void ReverseToGreyScalar(unsigned char* dst, const unsigned char* src, int pixelCount)
+{
+	for (int i = 0; i < pixelCount; ++i)
+	{
+		unsigned char val = src[pixelCount - i - 1];
+		dst[3 * i] = val;
+		dst[3 * i + 1] = val;
+		dst[3 * i + 2] = val;
+	}
+}
+
+static void ReverseBytesScalar(unsigned char* dst, const unsigned char* src, int byteCount)
+{
+	for (int i = 0; i < byteCount; ++i)
+		dst[i] = src[byteCount - i - 1];
+}
+
+static void MirrorYuy2Scalar(unsigned char* dst, const unsigned char* src, int pixelCount)
+{
+	for (int i = 0; i < pixelCount; i += 2)
+	{
+		const unsigned char* macropixel = src + 2 * (pixelCount - 2 - i);
+		dst[2 * i] = macropixel[2];
+		dst[2 * i + 1] = macropixel[1];
+		dst[2 * i + 2] = macropixel[0];
+		dst[2 * i + 3] = macropixel[3];
+	}
+}
+
+// SSSE3: pshufb does the reordering 16 bytes at a time
+
+KERNEL_TARGET("ssse3")
+static void RgbaToBgrSsse3(unsigned char* dst, const unsigned char* src, int pixelCount)
+{
+	// 4 pixels in, 12 bytes out and 4 zeroes that the next store overwrites, so stop while there are 6 pixels left
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	int i = 0;
+	for (; i + 6 <= pixelCount; i += 4)
+	{
+		__m128i rgba = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+		_mm_storeu_si128((__m128i*)(dst + 3 * i), _mm_shuffle_epi8(rgba, shuffle));
+	}
+	RgbaToBgrScalar(dst + 3 * i, src + 4 * i, pixelCount - i);
+}
+
+KERNEL_TARGET("ssse3")
+static void ReverseToGreySsse3(unsigned char* dst, const unsigned char* src, int pixelCount)
+{
+	// 16 source bytes, read back to front, make 48 output bytes
+	const __m128i shuffle0 = _mm_setr_epi8(15, 15, 15, 14, 14, 14, 13, 13, 13, 12, 12, 12, 11, 11, 11, 10);
+	const __m128i shuffle1 = _mm_setr_epi8(10, 10, 9, 9, 9, 8, 8, 8, 7, 7, 7, 6, 6, 6, 5, 5);
+	const __m128i shuffle2 = _mm_setr_epi8(5, 4, 4, 4, 3, 3, 3, 2, 2, 2, 1, 1, 1, 0, 0, 0);
+	int i = 0;
+	for (; i + 16 <= pixelCount; i += 16)
+	{
+		__m128i grey = _mm_loadu_si128((const __m128i*)(src + pixelCount - 16 - i));
+		_mm_storeu_si128((__m128i*)(dst + 3 * i), _mm_shuffle_epi8(grey, shuffle0));
+		_mm_storeu_si128((__m128i*)(dst + 3 * i + 16), _mm_shuffle_epi8(grey, shuffle1));
+		_mm_storeu_si128((__m128i*)(dst + 3 * i + 32), _mm_shuffle_epi8(grey, shuffle2));
+	}
+	ReverseToGreyScalar(dst + 3 * i, src, pixelCount - i);
+}
+
+KERNEL_TARGET("ssse3")
+static void ReverseBytesSsse3(unsigned char* dst, const unsigned char* src, int byteCount)
+{
+	const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	int i = 0;
+	for (; i + 16 <= byteCount; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(src + byteCount - 16 - i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(bytes, reverse));
+	}
+	ReverseBytesScalar(dst + i, src, byteCount - i);
+}
+
+KERNEL_TARGET("ssse3")
+static void MirrorYuy2Ssse3(unsigned char* dst, const unsigned char* src, int pixelCount)
+{
+	// 4 macropixels, last first, each with its Ys swapped
+	const __m128i mirror = _mm_setr_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+	int i = 0;
+	for (; i + 8 <= pixelCount; i += 8)
+	{
+		__m128i yuy2 = _mm_loadu_si128((const __m128i*)(src + 2 * (pixelCount - 8 - i)));
+		_mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_shuffle_epi8(yuy2, mirror));
+	}
+	MirrorYuy2Scalar(dst + 2 * i, src, pixelCount - i);
+}
+
+// AVX2: the same shuffles on both 128 bit lanes, with a cross-lane permute to join the halves up
+
+KERNEL_TARGET("avx2")
+static void RgbaToBgrAvx2(unsigned char* dst, const unsigned char* src, int pixelCount)
+{
+	// 8 pixels in, 24 bytes out and 8 zeroes, so stop while there are 11 pixels left
+	const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+	int i = 0;
+	for (; i + 11 <= pixelCount; i += 8)
+	{
+		__m256i rgba = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+		__m256i bgr = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(rgba, shuffle), pack);
+		_mm256_storeu_si256((__m256i*)(dst + 3 * i), bgr);
+	}
+	RgbaToBgrScalar(dst + 3 * i, src + 4 * i, pixelCount - i);
+}
+
+KERNEL_TARGET("avx2")
+static void ReverseToGreyAvx2(unsigned char* dst, const unsigned char* src, int pixelCount)
+{
+	// each 16 source bytes is broadcast to both lanes, so the in-lane shuffles can reach all of them.
+	// 32 pixels make 96 bytes: the first 16 pixels' 48 bytes, then the next 16's
+	const __m256i shuffle01 = _mm256_setr_epi8(15, 15, 15, 14, 14, 14, 13, 13, 13, 12, 12, 12, 11, 11, 11, 10,
+		10, 10, 9, 9, 9, 8, 8, 8, 7, 7, 7, 6, 6, 6, 5, 5);
+	const __m256i shuffle20 = _mm256_setr_epi8(5, 4, 4, 4, 3, 3, 3, 2, 2, 2, 1, 1, 1, 0, 0, 0,
+		15, 15, 15, 14, 14, 14, 13, 13, 13, 12, 12, 12, 11, 11, 11, 10);
+	const __m256i shuffle12 = _mm256_setr_epi8(10, 10, 9, 9, 9, 8, 8, 8, 7, 7, 7, 6, 6, 6, 5, 5,
+		5, 4, 4, 4, 3, 3, 3, 2, 2, 2, 1, 1, 1, 0, 0, 0);
+	int i = 0;
+	for (; i + 32 <= pixelCount; i += 32)
+	{
+		__m256i first = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(src + pixelCount - 16 - i)));
+		__m256i second = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(src + pixelCount - 32 - i)));
+		__m256i middle = _mm256_permute2x128_si256(first, second, 0x20);
+		_mm256_storeu_si256((__m256i*)(dst + 3 * i), _mm256_shuffle_epi8(first, shuffle01));
+		_mm256_storeu_si256((__m256i*)(dst + 3 * i + 32), _mm256_shuffle_epi8(middle, shuffle20));
+		_mm256_storeu_si256((__m256i*)(dst + 3 * i + 64), _mm256_shuffle_epi8(second, shuffle12));
+	}
+	ReverseToGreyScalar(dst + 3 * i, src, pixelCount - i);
+}
+
+KERNEL_TARGET("avx2")
+static void ReverseBytesAvx2(unsigned char* dst, const unsigned char* src, int byteCount)
+{
+	const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+		15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	int i = 0;
+	for (; i + 32 <= byteCount; i += 32)
+	{
+		__m256i bytes = _mm256_loadu_si256((const __m256i*)(src + byteCount - 32 - i));
+		__m256i reversed = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(bytes, reverse), 0x4E);
+		_mm256_storeu_si256((__m256i*)(dst + i), reversed);
+	}
+	ReverseBytesScalar(dst + i, src, byteCount - i);
+}
+
+KERNEL_TARGET("avx2")
+static void MirrorYuy2Avx2(unsigned char* dst, const unsigned char* src, int pixelCount)
+{
+	const __m256i mirror = _mm256_setr_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+		14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+	int i = 0;
+	for (; i + 16 <= pixelCount; i += 16)
+	{
+		__m256i yuy2 = _mm256_loadu_si256((const __m256i*)(src + 2 * (pixelCount - 16 - i)));
+		__m256i mirrored = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(yuy2, mirror), 0x4E);
+		_mm256_storeu_si256((__m256i*)(dst + 2 * i), mirrored);
+	}
+	MirrorYuy2Scalar(dst + 2 * i, src, pixelCount - i);
+}
+
+static const PixelKernels Kernels[(int)KernelVariant::Count] =
+{
+	{ RgbaToBgrScalar, ReverseToGreyScalar, ReverseBytesScalar, MirrorYuy2Scalar },
+	{ RgbaToBgrSsse3, ReverseToGreySsse3, ReverseBytesSsse3, MirrorYuy2Ssse3 },
+	{ RgbaToBgrAvx2, ReverseToGreyAvx2, ReverseBytesAvx2, MirrorYuy2Avx2 },
+};
+
+static void Cpuid(int leaf, int info[4])
+{
+#ifdef _MSC_VER
+	__cpuidex(info, leaf, 0);
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, 0, a, b, c, d);
+	info[0] = (int)a; info[1] = (int)b; info[2] = (int)c; info[3] = (int)d;
+#endif
+}
+
+bool PixelKernels::IsSupported(KernelVariant variant)
+{
+	int info[4];
+	Cpuid(0, info);
+	int maxLeaf = info[0];
+	Cpuid(1, info);
+	bool ssse3 = (info[2] & (1 << 9)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	switch (variant)
+	{
+	case KernelVariant::Scalar:
+		return true;
+	case KernelVariant::Ssse3:
+		return ssse3;
+	case KernelVariant::Avx2:
+	{
+		if (maxLeaf < 7 || !osxsave || !avx)
+			return false;
+		// the OS has to save the ymm registers too
+#ifdef _MSC_VER
+		unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int xcr0Low, xcr0High;
+		__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		unsigned long long xcr0 = ((unsigned long long)xcr0High << 32) | xcr0Low;
+#endif
+		Cpuid(7, info);
+		return (xcr0 & 6) == 6 && (info[1] & (1 << 5)) != 0;
+	}
+	default:
+		return false;
+	}
+}
+
+const PixelKernels& PixelKernels::Get(KernelVariant variant)
+{
+	return Kernels[(int)variant];
+}
+
+const PixelKernels& PixelKernels::GetBest()
+{
+	return Get(GetBestVariant());
+}
+
+KernelVariant PixelKernels::GetBestVariant()
+{
+	static const KernelVariant best = IsSupported(KernelVariant::Avx2) ? KernelVariant::Avx2
+		: IsSupported(KernelVariant::Ssse3) ? KernelVariant::Ssse3 : KernelVariant::Scalar;
+	return best;
+}
+
+const char* PixelKernels::GetVariantName(KernelVariant variant)
+{
+	static const char* const Names[(int)KernelVariant::Count] = { "scalar", "ssse3", "avx2" };
+	return Names[(int)variant];
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// The per-pixel format conversions of the output path (the RealSenseCam invert*/mirror functions and the renderers'
+// convert32bppToRGB), each in a scalar, SSSE3 and AVX2 variant that give identical results.
+// The variant is picked once from what the CPU supports (GetBest); Get gives any particular variant, e.g. to check
+// one against another. The kernels work on a plain run of pixels so the callers can split frames up between threads.
+enum class KernelVariant
+{
+	Scalar,
+	Ssse3,
+	Avx2,
+	Count
+};
+
+struct PixelKernels
+{
+	// dst pixel i (BGR) = src pixel i (RGBA) with red and blue swapped and alpha dropped
+	void (*RgbaToBgr)(unsigned char* dst, const unsigned char* src, int pixelCount);
+	// dst pixel i (24bpp) = src byte (pixelCount - 1 - i) three times, i.e. a Y8 frame turned around and made grey
+	void (*ReverseToGrey)(unsigned char* dst, const unsigned char* src, int pixelCount);
+	// dst byte i = src byte (byteCount - 1 - i), which turns a 24bpp frame around (and swaps red and blue)
+	void (*ReverseBytes)(unsigned char* dst, const unsigned char* src, int byteCount);
+	// dst pixel i = src pixel (pixelCount - 1 - i) of a YUY2 run, a row mirrored: the macropixels (Y0 U Y1 V, two pixels
+	// sharing U and V) are turned around and their two Ys swapped, so the chroma stays with its pixels. pixelCount is even
+	void (*MirrorYuy2)(unsigned char* dst, const unsigned char* src, int pixelCount);
+
+	static bool IsSupported(KernelVariant variant);
+	static const PixelKernels& Get(KernelVariant variant);
+	static const PixelKernels& GetBest();
+	static KernelVariant GetBestVariant();
+	static const char* GetVariantName(KernelVariant variant);
+};
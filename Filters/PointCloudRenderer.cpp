@@ -1,23 +1,33 @@
 #include "PointCloudRenderer.h"
 #include "vs-pointcloud.h"
 #include "ps-pointcloud.h"
+#include "gs-pointcloud-splat.h"
+#include "ps-pointcloud-splat.h"
+#include "ps-pointcloud-grey.h"
+#include "ps-pointcloud-splat-grey.h"
+#include "ps-pointcloud-rgb.h"
+#include "ps-pointcloud-splat-rgb.h"
 
 #include <d3dcompiler.h>    // shader compiler
 #include <DirectXMath.h>    // matrix/vector math
 #include <cassert>
-
-struct VertexPositionTexUv {
-    DirectX::XMFLOAT3 Pos;
-    DirectX::XMFLOAT2 TexUv;
-};
+#include <cmath>
 
 struct VS_CONSTANT_BUFFER
 {
     DirectX::XMMATRIX worldViewProj;
+    float depthScale;                   // meters per unit of packed depth
+    DirectX::XMFLOAT3 padding;          // constant buffers are a multiple of 16 bytes
+};
+
+struct GS_CONSTANT_BUFFER
+{
+    DirectX::XMFLOAT2 splatClipScale;
+    DirectX::XMFLOAT2 padding;          // constant buffers are a multiple of 16 bytes
 };
 
 
-PointCloudRenderer::PointCloudRenderer() : m_InputDepthWidth(0), m_InputDepthHeight(0), m_InputTexWidth(0), m_InputTexHeight(0), m_OutputWidth(0), m_OutputHeight(0), m_ClippingDistanceZ(1.3f)
+PointCloudRenderer::PointCloudRenderer()
 {
 }
 
@@ -25,15 +35,10 @@ PointCloudRenderer::~PointCloudRenderer()
 {
 }
 
-HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int inputTexWidth, int inputTexHeight, int outputWidth, int outputHeight, float clippingDistanceZ)
+HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int inputTexWidth, int inputTexHeight, TextureFormat textureFormat, int outputWidth, int outputHeight, float clippingDistanceZ, const PointCloudRendererOptions& options, ThreadPool* threadPool, FrameArena* frameArena)
 {
-    m_InputDepthWidth = inputDepthWidth;
-    m_InputDepthHeight = inputDepthHeight;
-    m_InputTexWidth = inputTexWidth;
-    m_InputTexHeight = inputTexHeight;
-    m_OutputWidth = outputWidth;
-    m_OutputHeight = outputHeight;
-    m_ClippingDistanceZ = clippingDistanceZ;
+    // sizes, options and the initial camera
+    PointCloudRendererBase::Init(inputDepthWidth, inputDepthHeight, inputTexWidth, inputTexHeight, textureFormat, outputWidth, outputHeight, clippingDistanceZ, options, threadPool, frameArena);
 
     // Set up Direct3D Device and Device Context
     {
@@ -57,39 +62,24 @@ HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int
             assert(S_OK == hr && device_ptr && device_context_ptr);
         }
 
-        // Render Target
+        // MSAA: the most samples up to msaaSamples that the device can do for both the color and depth formats
         {
-            // Create the render target texture (which will be copied back to caller's output frame)
-            D3D11_TEXTURE2D_DESC desc_target = {};
-            desc_target.Width = outputWidth;
-            desc_target.Height = outputHeight;
-            desc_target.ArraySize = 1;
-            desc_target.SampleDesc.Count = 1;
-            desc_target.Format = DXGI_FORMAT_R8G8B8A8_UNORM;  // .... DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
-            desc_target.BindFlags = D3D11_BIND_RENDER_TARGET;
-            desc_target.Usage = D3D11_USAGE_DEFAULT;
-            HRESULT hr = device_ptr->CreateTexture2D(&desc_target, nullptr, &target_ptr);
-            assert(SUCCEEDED(hr));
+            UINT samples = m_Options.msaaSamples < 1 ? 1 : m_Options.msaaSamples > D3D11_MAX_MULTISAMPLE_SAMPLE_COUNT ? D3D11_MAX_MULTISAMPLE_SAMPLE_COUNT : (UINT)m_Options.msaaSamples;
+            for (; samples > 1; samples--)
+            {
+                UINT colorQualityLevels = 0, depthQualityLevels = 0;
+                device_ptr->CheckMultisampleQualityLevels(DXGI_FORMAT_R8G8B8A8_UNORM, samples, &colorQualityLevels);
+                device_ptr->CheckMultisampleQualityLevels(DXGI_FORMAT_D32_FLOAT_S8X24_UINT, samples, &depthQualityLevels);
+                if (colorQualityLevels > 0 && depthQualityLevels > 0)
+                    break;
+            }
+            if ((int)samples < m_Options.msaaSamples)
+                OutputDebugStringA("PointCloudRenderer: MSAA sample count not supported by the device, using fewer\n");
+            m_MsaaSamples = samples;
         }
 
-        // depth stencil
+        // depth test state (the depth stencil itself is sized to the render target, see CreateOutputResources)
         {
-            // Create the depth stencil for the render target
-            D3D11_TEXTURE2D_DESC desc_depth;
-            desc_depth.Width = outputWidth;
-            desc_depth.Height = outputHeight;
-            desc_depth.MipLevels = 1;
-            desc_depth.ArraySize = 1;
-            desc_depth.Format = DXGI_FORMAT_D32_FLOAT_S8X24_UINT;
-            desc_depth.SampleDesc.Count = 1;
-            desc_depth.SampleDesc.Quality = 0;
-            desc_depth.Usage = D3D11_USAGE_DEFAULT;
-            desc_depth.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-            desc_depth.CPUAccessFlags = 0;
-            desc_depth.MiscFlags = 0;
-            HRESULT hr = device_ptr->CreateTexture2D(&desc_depth, NULL, &depth_stencil_ptr);
-            assert(SUCCEEDED(hr));
-
             D3D11_DEPTH_STENCIL_DESC depth_stencil_desc;
 
             // Depth test parameters
@@ -115,41 +105,12 @@ HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int
             depth_stencil_desc.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
 
             // Create depth stencil state
-            hr = device_ptr->CreateDepthStencilState(&depth_stencil_desc, &depth_stencil_state_ptr);
-            assert(SUCCEEDED(hr));
-
-            // Create the depth stencil view
-            D3D11_DEPTH_STENCIL_VIEW_DESC depth_stencil_view_desc;
-            depth_stencil_view_desc.Format = desc_depth.Format;
-            depth_stencil_view_desc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-            depth_stencil_view_desc.Texture2D.MipSlice = 0;
-            depth_stencil_view_desc.Flags = 0;
-
-            hr = device_ptr->CreateDepthStencilView(depth_stencil_ptr, // Depth stencil texture
-                &depth_stencil_view_desc, // Depth stencil desc
-                &depth_stencil_view_ptr);  // [out] Depth stencil view
+            HRESULT hr = device_ptr->CreateDepthStencilState(&depth_stencil_desc, &depth_stencil_state_ptr);
             assert(SUCCEEDED(hr));
         }
 
-        // Create the Staging texture, we resource-copy GPU->GPU from target to staging, then read from staging
-        // at our leisure
-        {
-            D3D11_TEXTURE2D_DESC desc_staging = {};
-            desc_staging.Width = outputWidth;
-            desc_staging.Height = outputHeight;
-            desc_staging.ArraySize = 1;
-            desc_staging.SampleDesc.Count = 1;
-            desc_staging.Format = DXGI_FORMAT_R8G8B8A8_UNORM;  // .... DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
-            desc_staging.BindFlags = 0;
-            desc_staging.Usage = D3D11_USAGE_STAGING;
-            desc_staging.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-            HRESULT hr = device_ptr->CreateTexture2D(&desc_staging, nullptr, &staging_ptr);
-            assert(SUCCEEDED(hr));
-
-            // create and set the render target view
-            hr = device_ptr->CreateRenderTargetView(target_ptr, nullptr, &render_target_view_ptr);
-            assert(SUCCEEDED(hr));
-        }
+        // render target, depth stencil, resolve and staging textures
+        CreateOutputResources();
     }
 
     // Compile the Shaders
@@ -161,15 +122,19 @@ HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int
         HRESULT hr = device_ptr->CreateVertexShader(g_vertex_shader, sizeof(g_vertex_shader) / sizeof(BYTE), nullptr, &vertex_shader_ptr);
         assert(SUCCEEDED(hr));
 
-        // COMPILE PIXEL SHADER
-        hr = device_ptr->CreatePixelShader(g_pixel_shader, sizeof(g_pixel_shader) / sizeof(BYTE), nullptr, &pixel_shader_ptr);
+        // COMPILE PIXEL SHADER (the grey one broadcasts the single channel IR texture, the rgb one unpacks the RGB8 buffer)
+        if (m_TextureFormat == TextureFormat::Y8)
+            hr = device_ptr->CreatePixelShader(g_grey_pixel_shader, sizeof(g_grey_pixel_shader) / sizeof(BYTE), nullptr, &pixel_shader_ptr);
+        else if (m_TextureFormat == TextureFormat::Rgb8)
+            hr = device_ptr->CreatePixelShader(g_rgb_pixel_shader, sizeof(g_rgb_pixel_shader) / sizeof(BYTE), nullptr, &pixel_shader_ptr);
+        else
+            hr = device_ptr->CreatePixelShader(g_pixel_shader, sizeof(g_pixel_shader) / sizeof(BYTE), nullptr, &pixel_shader_ptr);
         assert(SUCCEEDED(hr));
 
         // set up input layout for vertex shader
         D3D11_INPUT_ELEMENT_DESC inputElementDesc[] = {
-            // POS comes in input slot 0 (vertex position buffer)
-            { "SV_POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            // PackedVertex comes in input slot 0 (vertex position buffer), unpacked by the vertex shader
+            { "PACKED", 0, DXGI_FORMAT_R32G32_UINT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
             /*
             { "COL", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
             { "NOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
@@ -182,46 +147,93 @@ HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int
             sizeof(g_vertex_shader) / sizeof(BYTE),
             &input_layout_ptr);
         assert(SUCCEEDED(hr));
+
+        // splatting mode: the geometry shader grows each point into a quad and the pixel shader rounds it off
+        if (m_Options.splatting)
+        {
+            hr = device_ptr->CreateGeometryShader(g_splat_geometry_shader, sizeof(g_splat_geometry_shader) / sizeof(BYTE), nullptr, &splat_geometry_shader_ptr);
+            assert(SUCCEEDED(hr));
+
+            if (m_TextureFormat == TextureFormat::Y8)
+                hr = device_ptr->CreatePixelShader(g_splat_grey_pixel_shader, sizeof(g_splat_grey_pixel_shader) / sizeof(BYTE), nullptr, &splat_pixel_shader_ptr);
+            else if (m_TextureFormat == TextureFormat::Rgb8)
+                hr = device_ptr->CreatePixelShader(g_splat_rgb_pixel_shader, sizeof(g_splat_rgb_pixel_shader) / sizeof(BYTE), nullptr, &splat_pixel_shader_ptr);
+            else
+                hr = device_ptr->CreatePixelShader(g_splat_pixel_shader, sizeof(g_splat_pixel_shader) / sizeof(BYTE), nullptr, &splat_pixel_shader_ptr);
+            assert(SUCCEEDED(hr));
+
+            // splat size, updated with the rest of the camera each frame
+            D3D11_BUFFER_DESC constant_buff_descr = {};
+            constant_buff_descr.ByteWidth = sizeof(GS_CONSTANT_BUFFER);
+            constant_buff_descr.Usage = D3D11_USAGE_DEFAULT;
+            constant_buff_descr.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+            hr = device_ptr->CreateBuffer(&constant_buff_descr, NULL, &splat_constant_buffer_ptr);
+            assert(SUCCEEDED(hr));
+        }
     }
 
     // Create dynamic vertex buffer - sized to input width x height
     {
         int arrayElementCount = m_InputDepthWidth * m_InputDepthHeight;
-        VertexPositionTexUv* vertex_data_array = new VertexPositionTexUv[arrayElementCount];
-        ZeroMemory(vertex_data_array, arrayElementCount * sizeof(VertexPositionTexUv));
 
         // create vertex buffer to store the vertex data
+        // (no initial data needed, it's rewritten with WRITE_DISCARD before every draw)
         D3D11_BUFFER_DESC vertex_buff_descr = {};
-        vertex_buff_descr.ByteWidth = arrayElementCount * sizeof(VertexPositionTexUv);
+        vertex_buff_descr.ByteWidth = arrayElementCount * sizeof(PackedVertex);
         vertex_buff_descr.Usage = D3D11_USAGE_DYNAMIC;
         vertex_buff_descr.BindFlags = D3D11_BIND_VERTEX_BUFFER;
         vertex_buff_descr.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-        D3D11_SUBRESOURCE_DATA sr_data = { 0 };
-        sr_data.pSysMem = vertex_data_array;
-        HRESULT hr = device_ptr->CreateBuffer(&vertex_buff_descr, &sr_data, &vertex_buffer_ptr);
+        HRESULT hr = device_ptr->CreateBuffer(&vertex_buff_descr, NULL, &vertex_buffer_ptr);
         assert(SUCCEEDED(hr));
-    }
 
-    // constant buffer for world view projection matrix 
-    {
-        VS_CONSTANT_BUFFER VsConstData = {};
+        // the ray of each depth pixel, which the vertex shader rebuilds the positions along
+        // (uploaded in UpdateConstants, once the rays are known)
+        D3D11_BUFFER_DESC rays_buff_descr = {};
+        rays_buff_descr.ByteWidth = arrayElementCount * 2 * sizeof(float);
+        rays_buff_descr.Usage = D3D11_USAGE_DEFAULT;
+        rays_buff_descr.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        hr = device_ptr->CreateBuffer(&rays_buff_descr, NULL, &depth_rays_buffer_ptr);
+        assert(SUCCEEDED(hr));
 
-        // Set up WVP matrix, camera details
-        world = DirectX::XMMatrixIdentity(); // no reflection
-        //DirectX::XMMATRIX world = {-1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}; // reflect about x ("mirror mode")
+        D3D11_SHADER_RESOURCE_VIEW_DESC rays_view_descr = {};
+        rays_view_descr.Format = DXGI_FORMAT_R32G32_FLOAT;
+        rays_view_descr.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        rays_view_descr.Buffer.FirstElement = 0;
+        rays_view_descr.Buffer.NumElements = arrayElementCount;
+        hr = device_ptr->CreateShaderResourceView(depth_rays_buffer_ptr, &rays_view_descr, &depth_rays_view_ptr);
+        assert(SUCCEEDED(hr));
+        m_DepthRaysChanged = true;
 
-        eyePos = DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f);
-        lookAtPos = DirectX::XMVectorSet(0.0f, 0.0f, 0.5f, 0.0f); //Look at center of the world
-        upVector = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f); //Positive Y Axis = Up
-        view = DirectX::XMMatrixLookAtLH(eyePos, lookAtPos, upVector);
+        // mesh mode: the grid's triangles never change, only which vertices are dropped
+        if (m_Options.mesh)
+        {
+            D3D11_BUFFER_DESC index_buff_descr = {};
+            index_buff_descr.ByteWidth = m_MeshIndexCount * sizeof(UINT);
+            index_buff_descr.Usage = D3D11_USAGE_IMMUTABLE;
+            index_buff_descr.BindFlags = D3D11_BIND_INDEX_BUFFER;
+
+            D3D11_SUBRESOURCE_DATA sr_data = {};
+            sr_data.pSysMem = m_MeshIndices;
+            hr = device_ptr->CreateBuffer(&index_buff_descr, &sr_data, &index_buffer_ptr);
+            assert(SUCCEEDED(hr));
 
-        float fovRadians = DirectX::XM_PI / 3.0f; // 60 degree FOV
-        float aspectRatio = static_cast<float>(m_OutputWidth) / static_cast<float>(m_OutputHeight);
-        float nearZ = 0.1f;
-        float farZ = 20.0f;
-        projection = DirectX::XMMatrixPerspectiveFovLH(fovRadians, aspectRatio, nearZ, farZ);
+            // the grid can be seen from either side as the camera moves (front stays the side facing the sensor
+            // when the orientation reverses the winding)
+            D3D11_RASTERIZER_DESC rasterizer_desc = {};
+            rasterizer_desc.FillMode = D3D11_FILL_SOLID;
+            rasterizer_desc.CullMode = D3D11_CULL_NONE;
+            rasterizer_desc.FrontCounterClockwise = IsOrientationReflected();
+            rasterizer_desc.DepthClipEnable = TRUE;
+            hr = device_ptr->CreateRasterizerState(&rasterizer_desc, &rasterizer_state_ptr);
+            assert(SUCCEEDED(hr));
+        }
+    }
 
-        VsConstData.worldViewProj = DirectX::XMMatrixTranspose(world * view * projection);
+    // constant buffer for world view projection matrix 
+    {
+        VS_CONSTANT_BUFFER VsConstData = {};
+        VsConstData.worldViewProj = DirectX::XMMatrixTranspose(worldViewProj);
+        VsConstData.depthScale = m_PackedDepthScale;
 
         // create the constant buffer descriptor
         D3D11_BUFFER_DESC constant_buff_descr;
@@ -249,13 +261,48 @@ HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int
         device_context_ptr->VSSetConstantBuffers(0, 1, &constant_buffer_ptr);
     }
 
+    // RGB8 color frames go into a raw buffer, unpacked and filtered by the rgb pixel shaders
+    if (m_TextureFormat == TextureFormat::Rgb8)
+    {
+        // whole 32 bit words for the raw view, plus one more since the shaders load the two words around each texel
+        D3D11_BUFFER_DESC bufDesc = {};
+        bufDesc.ByteWidth = ((3 * m_InputTexWidth * m_InputTexHeight + 3) / 4 + 1) * 4;
+        bufDesc.Usage = D3D11_USAGE_DYNAMIC;
+        bufDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        bufDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        bufDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+
+        HRESULT hr = device_ptr->CreateBuffer(&bufDesc, NULL, &color_buffer_ptr);
+        assert(SUCCEEDED(hr));
+        color_resource_ptr = color_buffer_ptr;
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
+        srvDesc.BufferEx.FirstElement = 0;
+        srvDesc.BufferEx.NumElements = bufDesc.ByteWidth / 4;
+        srvDesc.BufferEx.Flags = D3D11_BUFFEREX_SRV_FLAG_RAW;
+        hr = device_ptr->CreateShaderResourceView(color_buffer_ptr, &srvDesc, &tex_view_ptr);
+        assert(SUCCEEDED(hr));
+
+        // the frame size never changes
+        UINT colorSize[4] = { m_InputTexWidth, m_InputTexHeight, 0, 0 };
+        D3D11_BUFFER_DESC sizeDesc = {};
+        sizeDesc.ByteWidth = sizeof(colorSize);
+        sizeDesc.Usage = D3D11_USAGE_IMMUTABLE;
+        sizeDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+        D3D11_SUBRESOURCE_DATA sizeData = { colorSize, 0, 0 };
+        hr = device_ptr->CreateBuffer(&sizeDesc, &sizeData, &color_size_buffer_ptr);
+        assert(SUCCEEDED(hr));
+    }
     // Create the Color Texture2D updated each frame with RGB/IR camera and matching SamplerState
+    else
     {
         D3D11_TEXTURE2D_DESC texDesc;
         texDesc.Width = m_InputTexWidth;
         texDesc.Height = m_InputTexHeight;
         texDesc.MipLevels = texDesc.ArraySize = 1;
-        texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        texDesc.Format = m_TextureFormat == TextureFormat::Y8 ? DXGI_FORMAT_R8_UNORM : DXGI_FORMAT_R8G8B8A8_UNORM;
         texDesc.SampleDesc.Count = 1;
         texDesc.SampleDesc.Quality = 0;
         texDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -265,6 +312,7 @@ HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int
 
         HRESULT hr = device_ptr->CreateTexture2D(&texDesc, NULL, &color_tex_ptr);
         assert(SUCCEEDED(hr));
+        color_resource_ptr = color_tex_ptr;
 
         // Create a texture sampler state description.
         D3D11_SAMPLER_DESC samplerDesc;
@@ -298,39 +346,45 @@ HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int
         assert(SUCCEEDED(hr));
     }
 
-    // set background color for point clouds
-#if defined( DEBUG ) || defined( _DEBUG )
-    // set the default background color to quarter cornflower blue for Debug builds
-    m_BackgroundColor = new float[] { 0x64 / 255.0f / 4.0f, 0x95 / 255.0f / 4.0f, 0xED / 255.0f / 4.0f, 1.0f };
-#else
-    // set the default background color to black for Release builds
-    m_BackgroundColor = new float[] { 0.0f, 0.0f, 0.0f, 1.0f };
-#endif // DEBUG
-
-    // set the viewport and other rendering settings that never change(!)
+    // set the rendering settings that never change(!) (the viewport and render targets only change with the output size)
     {
-        D3D11_VIEWPORT viewport = { 0.0f, 0.0f, static_cast<float>(m_OutputWidth), static_cast<float>(m_OutputHeight), 0.0f, 1.0f };
-        device_context_ptr->RSSetViewports(1, &viewport);
-
         // set the output merger
         device_context_ptr->OMSetDepthStencilState(depth_stencil_state_ptr, 1);
-        device_context_ptr->OMSetRenderTargets(1, &render_target_view_ptr, depth_stencil_view_ptr);
 
         // set the input assembler
-        UINT vertex_stride = sizeof(VertexPositionTexUv);
+        UINT vertex_stride = sizeof(PackedVertex);
         UINT vertex_offset = 0;
-        device_context_ptr->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
         device_context_ptr->IASetInputLayout(input_layout_ptr);
         device_context_ptr->IASetVertexBuffers(0, 1, &vertex_buffer_ptr, &vertex_stride, &vertex_offset);
+        if (m_Options.mesh)
+        {
+            device_context_ptr->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            device_context_ptr->IASetIndexBuffer(index_buffer_ptr, DXGI_FORMAT_R32_UINT, 0);
+            device_context_ptr->RSSetState(rasterizer_state_ptr);
+        }
+        else
+        {
+            device_context_ptr->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+        }
 
-        // set the texture and the sampler
+        // set the texture and the sampler (or the RGB8 buffer and its size)
         device_context_ptr->PSSetShaderResources(0, 1, &tex_view_ptr);
-        device_context_ptr->PSSetSamplers(0, 1, &sampler_state_ptr);
+        if (color_buffer_ptr)
+            device_context_ptr->PSSetConstantBuffers(0, 1, &color_size_buffer_ptr);
+        else
+            device_context_ptr->PSSetSamplers(0, 1, &sampler_state_ptr);
 
-        // set the shaders
+        // set the shaders (and the vertex shader's depth rays)
         device_context_ptr->VSSetShader(vertex_shader_ptr, NULL, 0);
+        device_context_ptr->VSSetShaderResources(0, 1, &depth_rays_view_ptr);
         device_context_ptr->PSSetShader(pixel_shader_ptr, NULL, 0);
 
+        if (m_Options.splatting)
+        {
+            device_context_ptr->GSSetShader(splat_geometry_shader_ptr, NULL, 0);
+            device_context_ptr->GSSetConstantBuffers(0, 1, &splat_constant_buffer_ptr);
+            device_context_ptr->PSSetShader(splat_pixel_shader_ptr, NULL, 0);
+        }
     }
 
     return S_OK;;
@@ -338,68 +392,176 @@ HRESULT PointCloudRenderer::Init(int inputDepthWidth, int inputDepthHeight, int
 
 void PointCloudRenderer::UnInit()
 {
-    if (m_BackgroundColor) delete m_BackgroundColor;
+    if (rasterizer_state_ptr) rasterizer_state_ptr->Release();
+    if (index_buffer_ptr) index_buffer_ptr->Release();
+    if (depth_rays_view_ptr) depth_rays_view_ptr->Release();
+    if (depth_rays_buffer_ptr) depth_rays_buffer_ptr->Release();
+    if (splat_constant_buffer_ptr) splat_constant_buffer_ptr->Release();
+    if (splat_pixel_shader_ptr) splat_pixel_shader_ptr->Release();
+    if (splat_geometry_shader_ptr) splat_geometry_shader_ptr->Release();
     if (tex_view_ptr) tex_view_ptr->Release();
-    if (depth_stencil_view_ptr) depth_stencil_view_ptr->Release();
     if (depth_stencil_state_ptr) depth_stencil_state_ptr->Release();
-    if (depth_stencil_ptr) depth_stencil_ptr->Release();
     if (sampler_state_ptr) sampler_state_ptr->Release();
     if (color_tex_ptr) color_tex_ptr->Release();
-    if (render_target_view_ptr) render_target_view_ptr->Release();
+    if (color_buffer_ptr) color_buffer_ptr->Release();
+    if (color_size_buffer_ptr) color_size_buffer_ptr->Release();
     if (input_layout_ptr) input_layout_ptr->Release();
     if (constant_buffer_ptr) constant_buffer_ptr->Release();
     if (vertex_shader_ptr) vertex_shader_ptr->Release();
     if (pixel_shader_ptr) pixel_shader_ptr->Release();
     if (vertex_buffer_ptr) vertex_buffer_ptr->Release();
-    if (staging_ptr) staging_ptr->Release();
-    if (target_ptr) target_ptr->Release();
+    ReleaseOutputResources();
     if (device_context_ptr) device_context_ptr->Release();
     if (device_ptr) device_ptr->Release();
 }
 
-void PointCloudRenderer::RenderFrame(BYTE* outputFrameBuffer, const int outputFrameLength, const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, const void* color_frame_data, const int color_frame_size)
+HRESULT PointCloudRenderer::Resize(int outputWidth, int outputHeight)
 {
-    assert(outputFrameBuffer != NULL && pointsXyz != NULL && (pointsCount == m_InputDepthWidth * m_InputDepthHeight) && (outputFrameLength == m_OutputWidth * m_OutputHeight * 3));
+    if ((UINT)outputWidth == m_OutputWidth && (UINT)outputHeight == m_OutputHeight)
+        return S_OK;
+
+    // the new size and projection, then just the textures (and views) sized to the output
+    PointCloudRendererBase::Resize(outputWidth, outputHeight);
+    ReleaseOutputResources();
+    CreateOutputResources();
+
+    // the splat sizes depend on the projection too, but the constant buffers are rewritten with every draw anyway
+    return S_OK;
+}
+
+/// <summary>
+/// create the render target, its depth stencil and the staging texture it's copied into for the CPU (by way of
+/// the resolve texture when it's multisampled), at the current render size, and bind the targets and viewport
+/// </summary>
+void PointCloudRenderer::CreateOutputResources()
+{
+    // Render Target
+    {
+        // Create the render target texture (which will be copied back to caller's output frame)
+        D3D11_TEXTURE2D_DESC desc_target = {};
+        desc_target.Width = m_RenderWidth;
+        desc_target.Height = m_RenderHeight;
+        desc_target.ArraySize = 1;
+        desc_target.SampleDesc.Count = m_MsaaSamples;
+        desc_target.Format = DXGI_FORMAT_R8G8B8A8_UNORM;  // .... DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+        desc_target.BindFlags = D3D11_BIND_RENDER_TARGET;
+        desc_target.Usage = D3D11_USAGE_DEFAULT;
+        HRESULT hr = device_ptr->CreateTexture2D(&desc_target, nullptr, &target_ptr);
+        assert(SUCCEEDED(hr));
+
+        // multisampled targets can't be copied to staging directly, they're resolved into a plain texture first
+        if (m_MsaaSamples > 1)
+        {
+            desc_target.SampleDesc.Count = 1;
+            desc_target.BindFlags = 0;
+            hr = device_ptr->CreateTexture2D(&desc_target, nullptr, &resolve_ptr);
+            assert(SUCCEEDED(hr));
+        }
+    }
+
+    // depth stencil
+    {
+        // Create the depth stencil for the render target
+        D3D11_TEXTURE2D_DESC desc_depth;
+        desc_depth.Width = m_RenderWidth;
+        desc_depth.Height = m_RenderHeight;
+        desc_depth.MipLevels = 1;
+        desc_depth.ArraySize = 1;
+        desc_depth.Format = DXGI_FORMAT_D32_FLOAT_S8X24_UINT;
+        desc_depth.SampleDesc.Count = m_MsaaSamples;
+        desc_depth.SampleDesc.Quality = 0;
+        desc_depth.Usage = D3D11_USAGE_DEFAULT;
+        desc_depth.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+        desc_depth.CPUAccessFlags = 0;
+        desc_depth.MiscFlags = 0;
+        HRESULT hr = device_ptr->CreateTexture2D(&desc_depth, NULL, &depth_stencil_ptr);
+        assert(SUCCEEDED(hr));
+
+        // Create the depth stencil view
+        D3D11_DEPTH_STENCIL_VIEW_DESC depth_stencil_view_desc;
+        depth_stencil_view_desc.Format = desc_depth.Format;
+        depth_stencil_view_desc.ViewDimension = m_MsaaSamples > 1 ? D3D11_DSV_DIMENSION_TEXTURE2DMS : D3D11_DSV_DIMENSION_TEXTURE2D;
+        depth_stencil_view_desc.Texture2D.MipSlice = 0;
+        depth_stencil_view_desc.Flags = 0;
+
+        hr = device_ptr->CreateDepthStencilView(depth_stencil_ptr, // Depth stencil texture
+            &depth_stencil_view_desc, // Depth stencil desc
+            &depth_stencil_view_ptr);  // [out] Depth stencil view
+        assert(SUCCEEDED(hr));
+    }
+
+    // Create the Staging texture, we resource-copy GPU->GPU from target to staging, then read from staging
+    // at our leisure
+    {
+        D3D11_TEXTURE2D_DESC desc_staging = {};
+        desc_staging.Width = m_RenderWidth;
+        desc_staging.Height = m_RenderHeight;
+        desc_staging.ArraySize = 1;
+        desc_staging.SampleDesc.Count = 1;
+        desc_staging.Format = DXGI_FORMAT_R8G8B8A8_UNORM;  // .... DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+        desc_staging.BindFlags = 0;
+        desc_staging.Usage = D3D11_USAGE_STAGING;
+        desc_staging.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        HRESULT hr = device_ptr->CreateTexture2D(&desc_staging, nullptr, &staging_ptr);
+        assert(SUCCEEDED(hr));
+
+        // create the render target view
+        hr = device_ptr->CreateRenderTargetView(target_ptr, nullptr, &render_target_view_ptr);
+        assert(SUCCEEDED(hr));
+    }
+
+    // bind them, with a viewport over the whole target
+    D3D11_VIEWPORT viewport = { 0.0f, 0.0f, static_cast<float>(m_RenderWidth), static_cast<float>(m_RenderHeight), 0.0f, 1.0f };
+    device_context_ptr->RSSetViewports(1, &viewport);
+    device_context_ptr->OMSetRenderTargets(1, &render_target_view_ptr, depth_stencil_view_ptr);
+}
+
+void PointCloudRenderer::ReleaseOutputResources()
+{
+    // unbind the targets first so the device lets go of them
+    if (device_context_ptr) device_context_ptr->OMSetRenderTargets(0, NULL, NULL);
+    if (depth_stencil_view_ptr) depth_stencil_view_ptr->Release();
+    if (depth_stencil_ptr) depth_stencil_ptr->Release();
+    if (render_target_view_ptr) render_target_view_ptr->Release();
+    if (staging_ptr) staging_ptr->Release();
+    if (resolve_ptr) resolve_ptr->Release();
+    if (target_ptr) target_ptr->Release();
+    depth_stencil_view_ptr = NULL;
+    depth_stencil_ptr = NULL;
+    render_target_view_ptr = NULL;
+    staging_ptr = NULL;
+    resolve_ptr = NULL;
+    target_ptr = NULL;
+}
+
+void PointCloudRenderer::DrawFrame(const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, const void* color_frame_data, const int color_frame_size)
+{
+    assert(pointsXyz != NULL && (pointsCount == m_InputDepthWidth * m_InputDepthHeight));
 
     // upload the color texture
     {
         D3D11_MAPPED_SUBRESOURCE mappedResource = { 0 };
 
         //  Disable GPU access to the texture data.
-        HRESULT hr = device_context_ptr->Map(color_tex_ptr, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+        HRESULT hr = device_context_ptr->Map(color_resource_ptr, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
         assert(SUCCEEDED(hr));
 
-        //  Copy over the texture data here.
-        if (color_frame_size == 0)
-        {
-            // Point cloud, no IR or Color frame, set the texture to opaque white
-            memset(mappedResource.pData, 255, (size_t)4 * pointsCount);
-        }
-        else if (color_frame_size == pointsCount) 
-        {
-            // IR frame: copy Y8 value over to RGB (and set A to 255)
-            BYTE* data = ((BYTE*)mappedResource.pData);
-            BYTE* colorFrame = (BYTE*)color_frame_data;
-            for (unsigned int i = 0; i < pointsCount; i++)
-            {
-                data[4 * i] = colorFrame[i];
-                data[4 * i + 1] = colorFrame[i];
-                data[4 * i + 2] = colorFrame[i];
-                data[4 * i + 3] = 255;
-            }
-        }
-        else
-        {
-            // RGBA color frame
-            memcpy(mappedResource.pData, color_frame_data, color_frame_size);
-        }
+        //  Copy over the texture data here, in the format given at Init.
+        // (a buffer has no rows, so its RowPitch is the whole size and the frame is copied in one go)
+        UINT rowPitch = color_buffer_ptr ? GetTexelBytes() * m_InputTexWidth : mappedResource.RowPitch;
+        (this->*m_UploadTexture)((BYTE*)mappedResource.pData, rowPitch, (const BYTE*)color_frame_data);
 
         //  Reenable GPU access to the texture data.
-        device_context_ptr->Unmap(color_tex_ptr, 0);
+        device_context_ptr->Unmap(color_resource_ptr, 0);
     }
 
+    // update the camera position with a bit of drift
+    UpdateConstants();
+
+    // work out how far each depth band of points can be thinned out from this frame's view
+    UpdateLevelOfDetail();
+
     // copy/set/map the updated vertex position data into the vertex position buffer
-    unsigned int currPoint = 0; // track valid points (exclude distant points)
     {
         D3D11_MAPPED_SUBRESOURCE mappedResource = { 0 };
 
@@ -407,93 +569,135 @@ void PointCloudRenderer::RenderFrame(BYTE* outputFrameBuffer, const int outputFr
         HRESULT hr = device_context_ptr->Map(vertex_buffer_ptr, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
         assert(SUCCEEDED(hr));
 
-        //  Update the vertex buffer here.
-        float* data = ((float*)mappedResource.pData);
-        for (unsigned int p = 0; p < pointsCount; p++)
+        // the depth rays only change when the camera's intrinsics are set
+        if (m_DepthRaysChanged)
         {
-            // only include points less than m_ClippingDistanceZ
-            if (pointsXyz[3 * p + 2] < m_ClippingDistanceZ)
-            {
-                // lay out the points (3 floats) then the tex uvs (2 floats) in the vertex buffer struct
-                // TODO do I need to align these to 16-bytes with filler?
-                data[5 * currPoint] = pointsXyz[3 * p];
-                data[5 * currPoint + 1] = pointsXyz[3 * p + 1];
-                data[5 * currPoint + 2] = pointsXyz[3 * p + 2];
-                data[5 * currPoint + 3] = texUvs[2 * p];
-                data[5 * currPoint + 4] = texUvs[2 * p + 1];
-                currPoint++;
-            }
+            device_context_ptr->UpdateSubresource(depth_rays_buffer_ptr, 0, nullptr, m_DepthRays, 0, 0);
+            m_DepthRaysChanged = false;
         }
-        mappedResource.pData = data;
+
+        //  Update the vertex buffer here.
+        if (m_Options.mesh)
+            SelectMeshVertices(pointsCount, pointsXyz, texUvs, (PackedVertex*)mappedResource.pData);
+        else
+            m_VertexCount = SelectPoints(pointsCount, pointsXyz, texUvs, (PackedVertex*)mappedResource.pData);
 
         //  Reenable GPU access to the vertex buffer data.
         device_context_ptr->Unmap(vertex_buffer_ptr, 0);
     }
 
-    // update the camera position with a bit of drift
-    {
-        // Update our time
-        static float t = 0.0f;
-        {
-            static ULONGLONG timeStart = 0;
-            ULONGLONG timeCur = GetTickCount64();
-            if (timeStart == 0)
-                timeStart = timeCur;
-            t = (timeCur - timeStart) / 1000.0f;
-        }
+    DrawVertices();
+}
 
-        // TODO UpdateSubresource (with DEFAULT buffer usage) works smoothly straight away,
-        // but the Map/Unmap approach with DYNAMIC buffer usage resulted in choppy performance.
-        // This is the opposite of what's suggested by the documentation from what I can tell.
+void PointCloudRenderer::RedrawFrame()
+{
+    // the texture and vertex buffer still hold the last frame, and the staging texture its image if the camera hasn't moved
+    if (UpdateConstants())
+        DrawVertices();
+}
 
-        // move the camera eyePos around in a dizzying circle (just a demo!)
-        // calculate and copy the updated wvp matrix
-        VS_CONSTANT_BUFFER VsConstData = {};
-        eyePos = DirectX::XMVectorSet(DirectX::XMScalarSinEst(t/2.0f) / 5.0f, -0.2f + DirectX::XMScalarCosEst(t/2.0f) / 5.0f, 0.0f, 0.0f); // FIXME rotate an amount based on a time interval!
-        view = DirectX::XMMatrixLookAtLH(eyePos, lookAtPos, upVector);
-        VsConstData.worldViewProj = DirectX::XMMatrixTranspose(world * view * projection);
-        device_context_ptr->UpdateSubresource(constant_buffer_ptr, 0, nullptr, &VsConstData, 0, 0);
+/// <summary>
+/// move the camera and, if it has moved, update the constant buffers to match
+/// </summary>
+/// <returns>true if the constant buffers changed</returns>
+bool PointCloudRenderer::UpdateConstants()
+{
+    if (!UpdateCamera())
+        return false;
+
+    // TODO UpdateSubresource (with DEFAULT buffer usage) works smoothly straight away,
+    // but the Map/Unmap approach with DYNAMIC buffer usage resulted in choppy performance.
+    // This is the opposite of what's suggested by the documentation from what I can tell.
+
+    // calculate and copy the updated wvp matrix
+    VS_CONSTANT_BUFFER VsConstData = {};
+    VsConstData.worldViewProj = DirectX::XMMatrixTranspose(worldViewProj);
+    VsConstData.depthScale = m_PackedDepthScale;
+    device_context_ptr->UpdateSubresource(constant_buffer_ptr, 0, nullptr, &VsConstData, 0, 0);
+
+    if (m_Options.splatting)
+    {
+        DirectX::XMFLOAT4X4 proj;
+        DirectX::XMStoreFloat4x4(&proj, projection);
+        float radiusPerMeter = GetSplatRadiusPerMeter();
+
+        GS_CONSTANT_BUFFER GsConstData = {};
+        // (the scales are negative for a mirrored or flipped output, which would turn the quads' winding around)
+        GsConstData.splatClipScale = DirectX::XMFLOAT2(radiusPerMeter * std::fabs(proj(0, 0)), radiusPerMeter * std::fabs(proj(1, 1)));
+        device_context_ptr->UpdateSubresource(splat_constant_buffer_ptr, 0, nullptr, &GsConstData, 0, 0);
     }
+    return true;
+}
 
+/// <summary>
+/// draw the current vertex buffer and copy the result to the staging texture
+/// </summary>
+void PointCloudRenderer::DrawVertices()
+{
     // clear to the background color
-    device_context_ptr->ClearRenderTargetView(render_target_view_ptr, m_BackgroundColor);
+    device_context_ptr->ClearRenderTargetView(render_target_view_ptr, BackgroundColor);
     device_context_ptr->ClearDepthStencilView(depth_stencil_view_ptr, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 
     // draw the points
-    device_context_ptr->Draw(currPoint, 0); // currPoint now holds the total count of valid vertices
+    if (m_Options.mesh)
+        device_context_ptr->DrawIndexed(m_MeshIndexCount, 0, 0);
+    else
+        device_context_ptr->Draw(m_VertexCount, 0); // the total count of valid vertices
 
     // flush the DirectX to the render target
     device_context_ptr->Flush();
 
     // Duplicate render target texture to the staging texture so we can get at it from the CPU
-    device_context_ptr->CopyResource(staging_ptr, target_ptr);
-    
-    // Map/memcpy/Unmap the staging data to main memory
+    // (averaging each pixel's samples into the resolve texture on the way when multisampled)
+    if (m_MsaaSamples > 1)
     {
-        D3D11_MAPPED_SUBRESOURCE mappedResource;
-        HRESULT hr = device_context_ptr->Map(staging_ptr, 0, D3D11_MAP_READ, 0, &mappedResource);
-        assert(SUCCEEDED(hr));
-        // pData is 32bit, outputFrameBuffer is 24bit, and one of them is BGR I think?
-        convert32bppToRGB(outputFrameBuffer, outputFrameLength, (BYTE*)mappedResource.pData, m_OutputWidth * m_OutputHeight);
-        device_context_ptr->Unmap(staging_ptr, 0);
+        device_context_ptr->ResolveSubresource(resolve_ptr, 0, target_ptr, 0, DXGI_FORMAT_R8G8B8A8_UNORM);
+        device_context_ptr->CopyResource(staging_ptr, resolve_ptr);
+    }
+    else
+    {
+        device_context_ptr->CopyResource(staging_ptr, target_ptr);
     }
 }
 
-/// <summary>
-/// assuming the 32bits per pixel is an RGBA value
-/// then replicate it in the R, G and B bytes of the output frame buffer.
-/// Also flip the bytes around to(from?) BGR.
-/// </summary>
-/// <param name="frameBuffer">output buffer, 24bpp</param>
-/// <param name="frameSize">output buffer size in bytes</param>
-/// <param name="pData">32bpp RGBA render target from Direct3D</param>
-/// <param name="pixelCount">The number of pixels in the output images (same for both)</param>
-void PointCloudRenderer::convert32bppToRGB(BYTE* frameBuffer, int frameSize, BYTE* pData, int pixelCount)
+void PointCloudRenderer::ReadFrame(BYTE* outputFrameBuffer, const int outputFrameLength)
 {
-    for (int i = 0; i < pixelCount; ++i)
+    assert(outputFrameBuffer != NULL && (outputFrameLength == m_OutputWidth * m_OutputHeight * 3));
+
+    // Map/memcpy/Unmap the staging data to main memory
+    D3D11_MAPPED_SUBRESOURCE mappedResource;
+    HRESULT hr = device_context_ptr->Map(staging_ptr, 0, D3D11_MAP_READ, 0, &mappedResource);
+    assert(SUCCEEDED(hr));
+    // pData is 32bit, outputFrameBuffer is 24bit, and one of them is BGR I think?
+    // (supersampled, it's filtered down to the output size in the same pass)
+    if (m_Supersample > 1)
+        downsample32bppToRGB(outputFrameBuffer, outputFrameLength, (BYTE*)mappedResource.pData, mappedResource.RowPitch);
+    else
+        convert32bppToRGB(outputFrameBuffer, outputFrameLength, (BYTE*)mappedResource.pData, mappedResource.RowPitch);
+    device_context_ptr->Unmap(staging_ptr, 0);
+}
+
+void PointCloudRenderer::ReadFrameRgba(BYTE* rgbaFrameBuffer)
+{
+    assert(rgbaFrameBuffer != NULL);
+
+    D3D11_MAPPED_SUBRESOURCE mappedResource;
+    HRESULT hr = device_context_ptr->Map(staging_ptr, 0, D3D11_MAP_READ, 0, &mappedResource);
+    assert(SUCCEEDED(hr));
+    // the staging rows can be padded out at some widths, the RGBA frame is packed
+    size_t rowBytes = (size_t)4 * m_OutputWidth;
+    if (m_Supersample > 1)
+    {
+        downsample32bppToRgba(rgbaFrameBuffer, (const BYTE*)mappedResource.pData, mappedResource.RowPitch);
+    }
+    else if (mappedResource.RowPitch == rowBytes)
+    {
+        memcpy(rgbaFrameBuffer, mappedResource.pData, rowBytes * m_OutputHeight);
+    }
+    else
     {
-        frameBuffer[3 * i] = pData[4 * i + 2];
-        frameBuffer[3 * i + 1] = pData[4 * i + 1];
-        frameBuffer[3 * i + 2] = pData[4 * i + 0];
+        for (UINT row = 0; row < m_OutputHeight; row++)
+            memcpy(rgbaFrameBuffer + row * rowBytes, (const BYTE*)mappedResource.pData + (size_t)row * mappedResource.RowPitch, rowBytes);
     }
+    device_context_ptr->Unmap(staging_ptr, 0);
 }
\ No newline at end of file
@@ -9,25 +9,27 @@
 #include <d3d11.h>          // D3D interface
 #include <DirectXMath.h>    // matrix/vector math
 
+#include "PointCloudRendererBase.h"
+
 // TODO why am I getting rs2 to calculate point cloud and return a flat list of 3d vertices; losing the RGB-D structure?
 // why not just load the depth and colour textures natively and compute vertices and color texture sampling in a shader?
 // well, intrinsics/extrinsics/distortion models are all taken care of by rs2 point cloud calculator, for starters
-class PointCloudRenderer
+class PointCloudRenderer : public PointCloudRendererBase
 {
 public:
 	PointCloudRenderer();
 	~PointCloudRenderer();
 
-	// TODO really here I just need to know the vertex structure (if we're going with that)
-	// TODO just uses a default camera position, lookat, up - for now
-	HRESULT Init(int inputDepthWidth, int inputDepthHeight, int inputTexWidth, int inputTexHeight, int outputWidth, int outputHeight, float clippingDistanceZ);
+	HRESULT Init(int inputDepthWidth, int inputDepthHeight, int inputTexWidth, int inputTexHeight, TextureFormat textureFormat, int outputWidth, int outputHeight, float clippingDistanceZ, const PointCloudRendererOptions& options, ThreadPool* threadPool, FrameArena* frameArena) override;
 
-	void UnInit();
+	void UnInit() override;
+	HRESULT Resize(int outputWidth, int outputHeight) override;
 
-	// TODO vertex structures with colour? Separate streams? 
-	// TODO really can pass current depth and color frames and let the shader work out the points, not librealsense
-	// TODO pass near/far clipping, other thresholding?
-	void RenderFrame(BYTE* outputFrameBuffer, const int outputFrameLength, const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, const void* color_frame_data, const int color_frame_size);
+	// DrawFrame also copies the render target into the staging texture, which ReadFrame/ReadFrameRgba then map
+	void DrawFrame(const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, const void* color_frame_data, const int color_frame_size) override;
+	void ReadFrame(BYTE* outputFrameBuffer, const int outputFrameLength) override;
+	void ReadFrameRgba(BYTE* rgbaFrameBuffer) override;
+	void RedrawFrame() override;
 
 private:
 	// D3D globals
@@ -36,33 +38,37 @@ private:
 	ID3D11Texture2D* target_ptr = NULL;				// render target texture
 	ID3D11Texture2D* depth_stencil_ptr = NULL;		// render target depth stencil texture
 	ID3D11Texture2D* staging_ptr = NULL;			// staging copy of render target to pass back to CPU
+	ID3D11Texture2D* resolve_ptr = NULL;			// single sampled copy of the multisampled render target (MSAA only)
 	ID3D11RenderTargetView* render_target_view_ptr = NULL;
 	ID3D11VertexShader* vertex_shader_ptr = NULL;
 	ID3D11PixelShader* pixel_shader_ptr = NULL;
 	ID3D11InputLayout* input_layout_ptr = NULL;
 	ID3D11Buffer* vertex_buffer_ptr = NULL;
 	ID3D11Buffer* constant_buffer_ptr = NULL;
-	ID3D11Texture2D* color_tex_ptr = NULL;			// RGB(A)?8-formatted data per point (comes off the sensor as RGB8)
+	ID3D11Texture2D* color_tex_ptr = NULL;			// IR (R8) or white (RGBA8) texture
+	ID3D11Buffer* color_buffer_ptr = NULL;			// RGB8 color frame as it comes off the sensor, a raw buffer unpacked by the rgb pixel shaders
+	ID3D11Buffer* color_size_buffer_ptr = NULL;		// its dimensions, for the rgb pixel shaders
+	ID3D11Resource* color_resource_ptr = NULL;		// whichever of the two is uploaded each frame
 	ID3D11ShaderResourceView* tex_view_ptr = NULL;
 	ID3D11SamplerState* sampler_state_ptr = NULL;
 	ID3D11DepthStencilState* depth_stencil_state_ptr = NULL;
 	ID3D11DepthStencilView* depth_stencil_view_ptr = NULL;
-	DirectX::XMMATRIX world; 
-	DirectX::XMMATRIX view;
-	DirectX::XMMATRIX projection;
-	DirectX::XMVECTOR eyePos;
-	DirectX::XMVECTOR lookAtPos;
-	DirectX::XMVECTOR upVector;
+	ID3D11GeometryShader* splat_geometry_shader_ptr = NULL;	// expands each point into a depth sized disc (splatting mode)
+	ID3D11PixelShader* splat_pixel_shader_ptr = NULL;
+	ID3D11Buffer* splat_constant_buffer_ptr = NULL;
+	ID3D11Buffer* index_buffer_ptr = NULL;			// static triangles over the depth grid (mesh mode)
+	ID3D11Buffer* depth_rays_buffer_ptr = NULL;		// x/z, y/z of each depth pixel, for the vertex shader to unpack positions
+	ID3D11ShaderResourceView* depth_rays_view_ptr = NULL;
+	ID3D11RasterizerState* rasterizer_state_ptr = NULL;
+
+	unsigned int m_VertexCount = 0;					// valid (unclipped) points in the vertex buffer
+	UINT m_MsaaSamples = 1;							// samples per pixel of the render target, what the device supports of msaaSamples
 
-	UINT m_InputDepthWidth;
-	UINT m_InputDepthHeight;
-	UINT m_InputTexWidth;
-	UINT m_InputTexHeight;
-	UINT m_OutputWidth;
-	UINT m_OutputHeight;
-	float m_ClippingDistanceZ;
-	float* m_BackgroundColor;
+	// the render sized resources (render target, depth stencil, resolve and staging textures and their views), bound along with the viewport
+	void CreateOutputResources();
+	void ReleaseOutputResources();
 
-	void convert32bppToRGB(BYTE* frameBuffer, int frameSize, BYTE* pData, int pixelCount);
+	bool UpdateConstants();
+	void DrawVertices();
 };
 
@@ -0,0 +1,680 @@
+#include "PointCloudRendererBase.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>      // SSE2
+#include <limits>
+
+// background color for point clouds
+#if defined( DEBUG ) || defined( _DEBUG )
+// quarter cornflower blue for Debug builds
+const float PointCloudRendererBase::BackgroundColor[4] = { 0x64 / 255.0f / 4.0f, 0x95 / 255.0f / 4.0f, 0xED / 255.0f / 4.0f, 1.0f };
+#else
+// black for Release builds
+const float PointCloudRendererBase::BackgroundColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+#endif // DEBUG
+
+PointCloudRendererBase::PointCloudRendererBase() : m_TransformsChanged(true), m_InputDepthWidth(0), m_InputDepthHeight(0), m_InputTexWidth(0), m_InputTexHeight(0), m_TextureFormat(TextureFormat::None), m_OutputWidth(0), m_OutputHeight(0), m_Supersample(1), m_RenderWidth(0), m_RenderHeight(0), m_ClippingDistanceZ(1.3f), m_DepthFocalLength(0.0f), m_ThreadPool(NULL), m_FrameArena(NULL), m_PixelKernels(NULL), m_RowPointCounts(NULL), m_LodBandsPerMeter(1.0f), m_MeshIndices(NULL), m_MeshIndexCount(0), m_MeshDepths(NULL), m_PackedDepthScale(1.0f), m_DepthRays(NULL), m_DepthRaysSet(false), m_DepthRaysChanged(false), m_UploadTexture(NULL), m_DownsampleRgba(NULL)
+{
+}
+
+PointCloudRendererBase::~PointCloudRendererBase()
+{
+}
+
+// copy rows of rowBytes from a tightly packed frame into a texture whose rows are rowPitch apart
+static void CopyRows(BYTE* texture, UINT rowPitch, const BYTE* frame, UINT rowBytes, UINT rowCount)
+{
+    if (rowPitch == rowBytes)
+    {
+        memcpy(texture, frame, (size_t)rowBytes * rowCount);
+        return;
+    }
+    for (UINT row = 0; row < rowCount; row++)
+        memcpy(texture + (size_t)row * rowPitch, frame + (size_t)row * rowBytes, rowBytes);
+}
+
+template <>
+void PointCloudRendererBase::UploadTexture<TextureFormat::None>(BYTE* texture, UINT rowPitch, const BYTE* frame)
+{
+    // Point cloud, no IR or Color frame, set the texture to opaque white
+    memset(texture, 255, (size_t)rowPitch * m_InputTexHeight);
+}
+
+template <>
+void PointCloudRendererBase::UploadTexture<TextureFormat::Y8>(BYTE* texture, UINT rowPitch, const BYTE* frame)
+{
+    // IR frame: straight copy of the Y8 values, the (single channel) texture is broadcast to grey when it's sampled
+    CopyRows(texture, rowPitch, frame, m_InputTexWidth, m_InputTexHeight);
+}
+
+template <>
+void PointCloudRendererBase::UploadTexture<TextureFormat::Rgb8>(BYTE* texture, UINT rowPitch, const BYTE* frame)
+{
+    // RGB color frame: straight copy too, the shaders (or the CPU renderer) unpack the texels when they sample them
+    CopyRows(texture, rowPitch, frame, 3 * m_InputTexWidth, m_InputTexHeight);
+}
+
+/// <summary>
+/// Filter count output pixels of an output row down from the supersampled frame, with separable integer weights:
+/// each is the rounded weighted sum of the rendered pixels at (offset x, offset y) from its block's top left pixel,
+/// clamped at the frame's edges, for every pair of taps. SSE2, first the vertical taps of every rendered column under
+/// the run (and its margins) in 16 bits, then the horizontal taps over those in 32. The rounding divide is done in
+/// float, which is exact for every sum these weights can make
+/// </summary>
+/// <param name="factor">supersample factor</param>
+/// <param name="maxX">last column of the rendered frame</param>
+/// <param name="maxY">last row of the rendered frame</param>
+/// <param name="tapCount">number of taps in each direction, at most 2 * factor</param>
+/// <param name="offsets">tap offsets from the block's top left, from -factor</param>
+/// <param name="weights">tap weights, up to 2 * factor, summing to at most 2 * factor * factor</param>
+static void DownsampleSeparable(BYTE* rgba, const BYTE* pData, UINT rowPitch, int row, int x, int count, int factor, int maxX, int maxY, int tapCount, int* offsets, int* weights)
+{
+    const int MaxColumns = (512 + 3) * 4;   // DownsampleChunkPixels and MaxSupersample, plus a block over for the odd pixel
+    alignas(16) short columns[4 * MaxColumns];
+    int firstColumn = x * factor - factor;
+    int columnCount = (count + 2) * factor;
+    assert(columnCount + factor <= MaxColumns);
+
+    const __m128i zero = _mm_setzero_si128();
+    const BYTE* tapRows[8];
+    __m128i tapWeights[8];
+    int total = 0;
+    for (int ty = 0; ty < tapCount; ty++)
+    {
+        int y = row * factor + offsets[ty];
+        tapRows[ty] = pData + (size_t)(y < 0 ? 0 : y > maxY ? maxY : y) * rowPitch;
+        tapWeights[ty] = _mm_set1_epi16((short)weights[ty]);
+        total += weights[ty];
+    }
+    total *= total;
+
+    // the columns four at a time, those off the frame's edges (clamped) one at a time
+    int column = 0;
+    while (column < columnCount)
+    {
+        int px = firstColumn + column;
+        if (px >= 0 && px + 3 <= maxX)
+        {
+            __m128i sumLo = zero, sumHi = zero;
+            for (int ty = 0; ty < tapCount; ty++)
+            {
+                __m128i pixels = _mm_loadu_si128((const __m128i*)(tapRows[ty] + 4 * px));
+                sumLo = _mm_add_epi16(sumLo, _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), tapWeights[ty]));
+                sumHi = _mm_add_epi16(sumHi, _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), tapWeights[ty]));
+            }
+            _mm_storeu_si128((__m128i*)(columns + 4 * column), sumLo);
+            _mm_storeu_si128((__m128i*)(columns + 4 * column + 8), sumHi);
+            column += 4;
+        }
+        else
+        {
+            px = 4 * (px < 0 ? 0 : px > maxX ? maxX : px);
+            for (int channel = 0; channel < 4; channel++)
+            {
+                int sum = 0;
+                for (int ty = 0; ty < tapCount; ty++)
+                    sum += weights[ty] * tapRows[ty][px + channel];
+                columns[4 * column + channel] = (short)sum;
+            }
+            column++;
+        }
+    }
+
+    // the horizontal taps in pairs, interleaved and multiply-added (an odd one out is paired with a zero weight),
+    // two output pixels at a time
+    if (tapCount & 1)
+    {
+        offsets[tapCount] = offsets[0];
+        weights[tapCount++] = 0;
+    }
+    __m128i pairWeights[4];
+    for (int t = 0; t < tapCount; t += 2)
+        pairWeights[t / 2] = _mm_set1_epi32(weights[t + 1] << 16 | weights[t]);
+    const __m128i half = _mm_set1_epi32(total / 2);
+    const __m128 scale = _mm_set1_ps(1.0f / total);
+    for (int i = 0; i < count; i += 2)
+    {
+        const short* block = columns + 4 * (i + 1) * factor;
+        __m128i sum0 = zero, sum1 = zero;
+        for (int t = 0; t < tapCount; t += 2)
+        {
+            const short* a = block + 4 * offsets[t];
+            const short* b = block + 4 * offsets[t + 1];
+            sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)a), _mm_loadl_epi64((const __m128i*)b)), pairWeights[t / 2]));
+            sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(a + 4 * factor)), _mm_loadl_epi64((const __m128i*)(b + 4 * factor))), pairWeights[t / 2]));
+        }
+        sum0 = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(sum0, half)), scale));
+        sum1 = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(sum1, half)), scale));
+        __m128i pixels = _mm_packus_epi16(_mm_packs_epi32(sum0, sum1), zero);
+        if (i + 1 < count)
+            _mm_storel_epi64((__m128i*)(rgba + 4 * i), pixels);
+        else
+            *(int*)(rgba + 4 * i) = _mm_cvtsi128_si32(pixels);
+    }
+}
+
+/// <summary>
+/// box filter: each output pixel is the rounded average of its supersample x supersample block
+/// </summary>
+template <>
+void PointCloudRendererBase::DownsampleRgba<DownsampleFilter::Box>(BYTE* rgba, const BYTE* pData, UINT rowPitch, int row, int x, int count) const
+{
+    int factor = m_Supersample;
+    int i = 0;
+
+    // 2x2, four output pixels at a time: widen the two rows' eight pixels to 16 bits, add the rows and then the
+    // neighbouring pixels, round and narrow again
+    if (factor == 2)
+    {
+        const BYTE* rows = pData + (size_t)row * 2 * rowPitch;
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+        for (; i + 4 <= count; i += 4)
+        {
+            const BYTE* top = rows + (size_t)8 * (x + i);
+            const BYTE* bottom = top + rowPitch;
+            __m128i top0 = _mm_loadu_si128((const __m128i*)top), top1 = _mm_loadu_si128((const __m128i*)(top + 16));
+            __m128i bottom0 = _mm_loadu_si128((const __m128i*)bottom), bottom1 = _mm_loadu_si128((const __m128i*)(bottom + 16));
+
+            // pixels 0,1 | 2,3 | 4,5 | 6,7 of the two rows summed, each register two pixels of 4 x 16 bit channels
+            __m128i sum01 = _mm_add_epi16(_mm_unpacklo_epi8(top0, zero), _mm_unpacklo_epi8(bottom0, zero));
+            __m128i sum23 = _mm_add_epi16(_mm_unpackhi_epi8(top0, zero), _mm_unpackhi_epi8(bottom0, zero));
+            __m128i sum45 = _mm_add_epi16(_mm_unpacklo_epi8(top1, zero), _mm_unpacklo_epi8(bottom1, zero));
+            __m128i sum67 = _mm_add_epi16(_mm_unpackhi_epi8(top1, zero), _mm_unpackhi_epi8(bottom1, zero));
+
+            // and the pixel pairs, output pixel n in the low half of each
+            __m128i out0 = _mm_add_epi16(sum01, _mm_srli_si128(sum01, 8));
+            __m128i out1 = _mm_add_epi16(sum23, _mm_srli_si128(sum23, 8));
+            __m128i out2 = _mm_add_epi16(sum45, _mm_srli_si128(sum45, 8));
+            __m128i out3 = _mm_add_epi16(sum67, _mm_srli_si128(sum67, 8));
+            __m128i out01 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(out0, out1), two), 2);
+            __m128i out23 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(out2, out3), two), 2);
+            _mm_storeu_si128((__m128i*)(rgba + 4 * i), _mm_packus_epi16(out01, out23));
+        }
+        if (i == count)
+            return;
+    }
+
+    // any other factor (and what's left of a 2x2 run): factor taps of weight 1, which never reach past the frame
+    int offsets[8], weights[8];
+    for (int tap = 0; tap < factor; tap++)
+    {
+        offsets[tap] = tap;
+        weights[tap] = 1;
+    }
+    DownsampleSeparable(rgba + 4 * i, pData, rowPitch, row, x + i, count - i, factor, m_RenderWidth - 1, m_RenderHeight - 1, factor, offsets, weights);
+}
+
+/// <summary>
+/// tent filter: each output pixel weighs the rendered pixels within supersample of its block's centre (in each
+/// direction) by supersample - their distance from it, clamped at the frame's edges
+/// </summary>
+template <>
+void PointCloudRendererBase::DownsampleRgba<DownsampleFilter::Tent>(BYTE* rgba, const BYTE* pData, UINT rowPitch, int row, int x, int count) const
+{
+    // offsets from the block's first pixel and weights, the same in both directions, with distances measured in
+    // half pixels so that even factors (whose centres fall between pixels) stay integer
+    int factor = m_Supersample;
+    int offsets[8], weights[8], tapCount = 0;
+    for (int offset = -factor; offset < 2 * factor; offset++)
+    {
+        int distance = 2 * offset + 1 - factor;
+        int weight = 2 * factor - (distance < 0 ? -distance : distance);
+        if (weight > 0)
+        {
+            offsets[tapCount] = offset;
+            weights[tapCount++] = weight;
+        }
+    }
+    DownsampleSeparable(rgba, pData, rowPitch, row, x, count, factor, m_RenderWidth - 1, m_RenderHeight - 1, tapCount, offsets, weights);
+}
+
+HRESULT PointCloudRendererBase::Init(int inputDepthWidth, int inputDepthHeight, int inputTexWidth, int inputTexHeight, TextureFormat textureFormat, int outputWidth, int outputHeight, float clippingDistanceZ, const PointCloudRendererOptions& options, ThreadPool* threadPool, FrameArena* frameArena)
+{
+    m_InputDepthWidth = inputDepthWidth;
+    m_InputDepthHeight = inputDepthHeight;
+    m_InputTexWidth = inputTexWidth;
+    m_InputTexHeight = inputTexHeight;
+    m_ClippingDistanceZ = clippingDistanceZ;
+    m_Options = options;
+    if (m_Options.mesh)
+        m_Options.splatting = false;    // the mesh is already solid
+    m_Supersample = m_Options.supersample < 1 ? 1 : m_Options.supersample > (int)MaxSupersample ? MaxSupersample : (UINT)m_Options.supersample;
+    if (m_Options.downsampleFilter == DownsampleFilter::Tent)
+        m_DownsampleRgba = &PointCloudRendererBase::DownsampleRgba<DownsampleFilter::Tent>;
+    else
+        m_DownsampleRgba = &PointCloudRendererBase::DownsampleRgba<DownsampleFilter::Box>;
+    m_ThreadPool = threadPool;
+    m_PixelKernels = &PixelKernels::GetBest();
+    m_TextureFormat = textureFormat;
+    switch (textureFormat)
+    {
+    case TextureFormat::Y8:
+        m_UploadTexture = &PointCloudRendererBase::UploadTexture<TextureFormat::Y8>;
+        break;
+    case TextureFormat::Rgb8:
+        m_UploadTexture = &PointCloudRendererBase::UploadTexture<TextureFormat::Rgb8>;
+        break;
+    default:
+        m_UploadTexture = &PointCloudRendererBase::UploadTexture<TextureFormat::None>;
+        break;
+    }
+    m_FrameArena = frameArena;
+    m_RowPointCounts = frameArena->Allocate<unsigned int>(m_InputDepthHeight + 1);
+    if (m_Options.mesh)
+    {
+        BuildMeshIndices();
+        m_MeshDepths = frameArena->Allocate<float>((size_t)m_InputDepthWidth * m_InputDepthHeight);
+    }
+
+    // packed vertices only have room for a 20 bit pixel index, and 16 bits of depth up to the clipping distance
+    assert((UINT)m_InputDepthWidth * m_InputDepthHeight <= MaxPackedPixels);
+    m_PackedDepthScale = m_ClippingDistanceZ / 65535.0f;
+    m_DepthRays = frameArena->Allocate<float>(2 * (size_t)m_InputDepthWidth * m_InputDepthHeight);
+    m_DepthRaysSet = false;
+    SetPinholeDepthRays();
+
+    // Set up WVP matrix, camera details
+    world = DirectX::XMMatrixIdentity(); // no reflection (the orientation is in the projection)
+
+    m_Camera.SetMode(m_Options.cameraMode);
+    m_Camera.SetFixedTime(m_Options.cameraTime);
+    m_Camera.Reset();
+
+    SetOutputSize(outputWidth, outputHeight);
+
+    // the starting pose, for the constant buffers made at Init (the first frame still counts as a move)
+    m_Camera.Update(0.0);
+    view = m_Camera.GetView();
+    eyePos = m_Camera.GetEye();
+    worldViewProj = world * view * projection;
+
+    return S_OK;
+}
+
+HRESULT PointCloudRendererBase::Resize(int outputWidth, int outputHeight)
+{
+    SetOutputSize(outputWidth, outputHeight);
+    return S_OK;
+}
+
+void PointCloudRendererBase::SetOutputSize(int outputWidth, int outputHeight)
+{
+    m_OutputWidth = outputWidth;
+    m_OutputHeight = outputHeight;
+    m_RenderWidth = m_OutputWidth * m_Supersample;
+    m_RenderHeight = m_OutputHeight * m_Supersample;
+
+    float fovRadians = DirectX::XM_PI / 3.0f; // 60 degree FOV
+    float aspectRatio = static_cast<float>(m_OutputWidth) / static_cast<float>(m_OutputHeight);
+    float nearZ = 0.1f;
+    float farZ = 20.0f;
+    projection = DirectX::XMMatrixPerspectiveFovLH(fovRadians, aspectRatio, nearZ, farZ);
+
+    // The sensor's y axis points down and the view's up, so the render target is upside down, and the bottom-up RGB24
+    // output puts it the right way up again with a straight copy. Any other orientation reflects clip space x and/or y
+    // on top of that (both is the 180 degree turn)
+    OutputOrientation orientation = m_Options.orientation;
+    float scaleX = orientation == OutputOrientation::Mirrored || orientation == OutputOrientation::Rotated180 ? -1.0f : 1.0f;
+    float scaleY = orientation == OutputOrientation::Flipped || orientation == OutputOrientation::Rotated180 ? -1.0f : 1.0f;
+    projection = projection * DirectX::XMMatrixScaling(scaleX, scaleY, 1.0f);
+    m_TransformsChanged = true;
+}
+
+void PointCloudRendererBase::SetDepthFocalLength(float fx)
+{
+    m_DepthFocalLength = fx;
+    m_TransformsChanged = true;     // the splat sizes are worked out along with the camera
+    if (!m_DepthRaysSet)
+        SetPinholeDepthRays();
+}
+
+void PointCloudRendererBase::SetDepthRays(const float* rays)
+{
+    assert(rays != NULL && m_DepthRays != NULL);
+    memcpy(m_DepthRays, rays, 2 * sizeof(float) * m_InputDepthWidth * m_InputDepthHeight);
+    m_DepthRaysSet = true;
+    m_DepthRaysChanged = true;
+}
+
+// rays of an undistorted camera centred on the depth grid, (col - width/2, row - height/2) / fx
+void PointCloudRendererBase::SetPinholeDepthRays()
+{
+    if (m_DepthRays == NULL)
+        return;
+    float invFocalLength = m_DepthFocalLength > 0.0f ? 1.0f / m_DepthFocalLength : 0.0f;
+    float* ray = m_DepthRays;
+    for (UINT row = 0; row < m_InputDepthHeight; row++)
+    {
+        for (UINT col = 0; col < m_InputDepthWidth; col++)
+        {
+            *ray++ = (col - 0.5f * m_InputDepthWidth) * invFocalLength;
+            *ray++ = (row - 0.5f * m_InputDepthHeight) * invFocalLength;
+        }
+    }
+    m_DepthRaysChanged = true;
+}
+
+void PointCloudRendererBase::RenderFrame(BYTE* outputFrameBuffer, const int outputFrameLength, const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, const void* color_frame_data, const int color_frame_size)
+{
+    DrawFrame(pointsCount, pointsXyz, texUvs, color_frame_data, color_frame_size);
+    ReadFrame(outputFrameBuffer, outputFrameLength);
+}
+
+void PointCloudRendererBase::ConvertFrame(BYTE* outputFrameBuffer, const int outputFrameLength, const BYTE* rgbaFrameBuffer)
+{
+    assert(outputFrameBuffer != NULL && rgbaFrameBuffer != NULL && (outputFrameLength == m_OutputWidth * m_OutputHeight * 3));
+    convert32bppToRGB(outputFrameBuffer, outputFrameLength, rgbaFrameBuffer, 4 * m_OutputWidth);
+}
+
+bool PointCloudRendererBase::UpdateCamera()
+{
+    if (!m_Camera.Update() && !m_TransformsChanged)
+        return false;
+
+    view = m_Camera.GetView();
+    eyePos = m_Camera.GetEye();
+    worldViewProj = world * view * projection;
+    m_TransformsChanged = false;
+    return true;
+}
+
+/// <summary>
+/// For level of detail mode: estimate the projected footprint (in rendered pixels) of a point at the middle of
+/// each view depth band, and pick the largest power of two stride for the band that still keeps the thinned
+/// grid's points no further apart than m_Options.minPointFootprint pixels.
+/// A point deprojected from depth z is about z / fx meters from its grid neighbours, and at view depth v that
+/// spacing covers (z / fx) * (projection y scale * render height / 2) / v pixels. (Supersampled, the points are
+/// thinned to the rendered pixels, not the output's, or the filtering would just fade the thinned grid out)
+/// </summary>
+void PointCloudRendererBase::UpdateLevelOfDetail()
+{
+    DirectX::XMFLOAT4X4 worldView;
+    DirectX::XMStoreFloat4x4(&worldView, world * view);
+
+    // view space z is the dot product of the point with the third column of the world*view matrix
+    m_LodViewZ[0] = worldView(0, 2);
+    m_LodViewZ[1] = worldView(1, 2);
+    m_LodViewZ[2] = worldView(2, 2);
+    m_LodViewZ[3] = worldView(3, 2);
+
+    // bands cover everything from the eye out to a little past the clipping distance
+    float bandsMaxZ = m_ClippingDistanceZ + 0.5f;
+    m_LodBandsPerMeter = LodBandCount / bandsMaxZ;
+
+    DirectX::XMFLOAT4X4 proj;
+    DirectX::XMStoreFloat4x4(&proj, projection);
+    float pixelsPerUnitAtUnitDepth = std::fabs(proj(1, 1)) * m_RenderHeight / 2.0f;     // (negative when flipped)
+
+    // view depth of the sensor origin, so that depth z ~= view depth - sensorViewZ along the view direction
+    float sensorViewZ = m_LodViewZ[3];
+
+    for (int band = 0; band < LodBandCount; band++)
+    {
+        UINT stride = 1;
+        if (m_Options.levelOfDetail && m_DepthFocalLength > 0.0f)
+        {
+            float viewZ = (band + 0.5f) / m_LodBandsPerMeter;
+            float depthZ = viewZ - sensorViewZ;
+            float footprint = depthZ > 0.0f ? (depthZ / m_DepthFocalLength) * pixelsPerUnitAtUnitDepth / viewZ : 0.0f;
+            while (footprint > 0.0f && stride * 2 <= MaxLodStride && footprint * stride * 2 <= m_Options.minPointFootprint)
+                stride *= 2;
+        }
+        m_LodBandStrideMasks[band] = stride - 1;
+    }
+}
+
+unsigned int PointCloudRendererBase::SelectPoints(const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, PackedVertex* vertices)
+{
+    assert(pointsXyz != NULL && (pointsCount == m_InputDepthWidth * m_InputDepthHeight));
+
+    // Clipping compacts the points, so first count the survivors in each input row, then each row
+    // knows where its points start in the vertex buffer and the rows can be filled independently
+    UINT width = m_InputDepthWidth;
+    unsigned int* rowPointCounts = m_RowPointCounts;
+
+    // only include points with a depth less than m_ClippingDistanceZ, and (in level of detail mode) on the grid of their depth band's stride
+    float clippingDistanceZ = m_ClippingDistanceZ;
+    const UINT* bandStrideMasks = m_LodBandStrideMasks;
+    float viewZx = m_LodViewZ[0], viewZy = m_LodViewZ[1], viewZz = m_LodViewZ[2], viewZw = m_LodViewZ[3];
+    float bandsPerMeter = m_LodBandsPerMeter;
+    auto keepPoint = [=](unsigned int p, unsigned int row, unsigned int col)
+        {
+            const float* xyz = pointsXyz + 3 * p;
+            if (!(xyz[2] < clippingDistanceZ && xyz[2] > 0.0f))
+                return false;
+            float viewZ = xyz[0] * viewZx + xyz[1] * viewZy + xyz[2] * viewZz + viewZw;
+            int band = viewZ > 0.0f ? (int)(viewZ * bandsPerMeter) : 0;
+            UINT mask = bandStrideMasks[band < LodBandCount ? band : LodBandCount - 1];
+            return ((row | col) & mask) == 0;
+        };
+
+    m_ThreadPool->ParallelFor(0, m_InputDepthHeight, 8, [=](int rowBegin, int rowEnd)
+        {
+            for (int row = rowBegin; row < rowEnd; row++)
+            {
+                unsigned int count = 0;
+                for (unsigned int col = 0; col < width; col++)
+                {
+                    if (keepPoint(row * width + col, row, col))
+                        count++;
+                }
+                rowPointCounts[row + 1] = count;
+            }
+        });
+
+    rowPointCounts[0] = 0;
+    for (UINT row = 0; row < m_InputDepthHeight; row++)
+    {
+        rowPointCounts[row + 1] += rowPointCounts[row];
+    }
+
+    float depthUnits = 1.0f / m_PackedDepthScale;
+    m_ThreadPool->ParallelFor(0, m_InputDepthHeight, 8, [=](int rowBegin, int rowEnd)
+        {
+            unsigned int rowPoint = rowPointCounts[rowBegin];
+            for (unsigned int row = rowBegin; row < (unsigned int)rowEnd; row++)
+            {
+                for (unsigned int col = 0; col < width; col++)
+                {
+                    unsigned int p = row * width + col;
+                    if (keepPoint(p, row, col))
+                    {
+                        vertices[rowPoint++] = PackVertex(pointsXyz + 3 * p, texUvs + 2 * p, p, depthUnits);
+                    }
+                }
+            }
+        });
+
+    return rowPointCounts[m_InputDepthHeight];
+}
+
+void PointCloudRendererBase::BuildMeshIndices()
+{
+    // (row, col), (row, col + 1), (row + 1, col) and (row, col + 1), (row + 1, col + 1), (row + 1, col)
+    UINT width = m_InputDepthWidth;
+    m_MeshIndexCount = 6 * (m_InputDepthWidth - 1) * (m_InputDepthHeight - 1);
+    m_MeshIndices = m_FrameArena->Allocate<UINT>(m_MeshIndexCount);
+
+    UINT* index = m_MeshIndices;
+    for (UINT row = 0; row + 1 < m_InputDepthHeight; row++)
+    {
+        for (UINT col = 0; col + 1 < m_InputDepthWidth; col++)
+        {
+            UINT p = row * width + col;
+            *index++ = p;
+            *index++ = p + 1;
+            *index++ = p + width;
+            *index++ = p + 1;
+            *index++ = p + width + 1;
+            *index++ = p + width;
+        }
+    }
+}
+
+/// <summary>
+/// A point is dropped from the mesh (packed with depth 0) if it is clipped (or has no depth), or if it is more than
+/// meshMaxDepthJump further away than any of its 4 neighbours. Only the far side of a discontinuity goes, so the foreground
+/// surface keeps its edge and the background loses the one row of points that would join up to it.
+/// </summary>
+void PointCloudRendererBase::SelectMeshVertices(const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, PackedVertex* vertices)
+{
+    assert(pointsXyz != NULL && (pointsCount == m_InputDepthWidth * m_InputDepthHeight));
+
+    UINT width = m_InputDepthWidth;
+    int height = m_InputDepthHeight;
+    float* depths = m_MeshDepths;
+    float clippingDistanceZ = m_ClippingDistanceZ;
+    float maxDepthJump = m_Options.meshMaxDepthJump;
+    float depthUnits = 1.0f / m_PackedDepthScale;
+
+    // gather the depths into a plane so the neighbour tests can load 4 at a time,
+    // missing depths become +inf so they never count as the nearer neighbour
+    m_ThreadPool->ParallelFor(0, height, 16, [=](int rowBegin, int rowEnd)
+        {
+            const float infinity = std::numeric_limits<float>::infinity();
+            for (unsigned int p = rowBegin * width; p < rowEnd * width; p++)
+            {
+                float z = pointsXyz[3 * p + 2];
+                depths[p] = z > 0.0f ? z : infinity;
+            }
+        });
+
+    m_ThreadPool->ParallelFor(0, height, 8, [=](int rowBegin, int rowEnd)
+        {
+            const __m128 clip = _mm_set1_ps(clippingDistanceZ);
+            const __m128 maxJump = _mm_set1_ps(maxDepthJump);
+
+            for (int row = rowBegin; row < rowEnd; row++)
+            {
+                const float* z = depths + row * width;
+                const float* above = row > 0 ? z - width : z;
+                const float* below = row + 1 < height ? z + width : z;
+                UINT rowStart = row * width;
+                PackedVertex* rowVertices = vertices + rowStart;
+                const float* xyz = pointsXyz + 3 * (size_t)rowStart;
+                const float* uv = texUvs + 2 * (size_t)rowStart;
+
+                auto writeVertex = [&](UINT col, bool keep)
+                    {
+                        PackedVertex vertex = PackVertex(xyz + 3 * col, uv + 2 * col, rowStart + col, depthUnits);
+                        if (!keep)
+                            vertex.depthPixel &= 0xffff0000u;
+                        rowVertices[col] = vertex;
+                    };
+                auto keepScalar = [&](UINT col)
+                    {
+                        float nearest = std::fmin(std::fmin(above[col], below[col]), std::fmin(col > 0 ? z[col - 1] : z[col], col + 1 < width ? z[col + 1] : z[col]));
+                        return z[col] < clippingDistanceZ && !(z[col] - nearest > maxDepthJump);
+                    };
+
+                // the first and last columns are missing a neighbour, the rest go 4 at a time
+                writeVertex(0, keepScalar(0));
+                UINT col = 1;
+                for (; col + 4 < width; col += 4)
+                {
+                    __m128 centre = _mm_loadu_ps(z + col);
+                    __m128 nearest = _mm_min_ps(_mm_min_ps(_mm_loadu_ps(above + col), _mm_loadu_ps(below + col)),
+                        _mm_min_ps(_mm_loadu_ps(z + col - 1), _mm_loadu_ps(z + col + 1)));
+                    __m128 keep = _mm_andnot_ps(_mm_cmpgt_ps(_mm_sub_ps(centre, nearest), maxJump), _mm_cmplt_ps(centre, clip));
+                    int keepMask = _mm_movemask_ps(keep);
+                    for (int i = 0; i < 4; i++)
+                    {
+                        writeVertex(col + i, (keepMask >> i) & 1);
+                    }
+                }
+                for (; col < width; col++)
+                {
+                    writeVertex(col, keepScalar(col));
+                }
+            }
+        });
+}
+
+float PointCloudRendererBase::GetSplatRadiusPerMeter() const
+{
+    // grid neighbours at depth z are z / fx apart, and the splat diameter is splatSize of those spacings
+    return m_DepthFocalLength > 0.0f ? 0.5f * m_Options.splatSize / m_DepthFocalLength : 0.0f;
+}
+
+/// <summary>
+/// assuming the 32bits per pixel is an RGBA value
+/// then replicate it in the R, G and B bytes of the output frame buffer.
+/// Also flip the bytes around to(from?) BGR.
+/// </summary>
+/// <param name="frameBuffer">output buffer, 24bpp</param>
+/// <param name="frameSize">output buffer size in bytes</param>
+/// <param name="pData">32bpp RGBA render target from Direct3D, output sized</param>
+/// <param name="rowPitch">bytes between its rows (a mapped staging texture's rows can be padded)</param>
+void PointCloudRendererBase::convert32bppToRGB(BYTE* frameBuffer, int frameSize, const BYTE* pData, UINT rowPitch)
+{
+    UINT width = m_OutputWidth;
+    auto rgbaToBgr = m_PixelKernels->RgbaToBgr;
+
+    // bands of at least MinConvertPixelsPerTask, so tiny outputs aren't split up for nothing and large ones
+    // (up to 4K) are spread over every thread
+    int minRowsPerTask = width < MinConvertPixelsPerTask ? MinConvertPixelsPerTask / width : 1;
+    m_ThreadPool->ParallelFor(0, m_OutputHeight, minRowsPerTask, [=](int rowBegin, int rowEnd)
+        {
+            if (rowPitch == 4 * width)
+            {
+                rgbaToBgr(frameBuffer + 3 * rowBegin * width, pData + 4 * rowBegin * width, (rowEnd - rowBegin) * width);
+                return;
+            }
+            for (int row = rowBegin; row < rowEnd; row++)
+                rgbaToBgr(frameBuffer + 3 * row * width, pData + (size_t)row * rowPitch, width);
+        });
+}
+
+/// <summary>
+/// supersampled frames: filter the rendered RGBA frame down and convert it into the 24bpp output in one pass
+/// </summary>
+/// <param name="frameBuffer">output buffer, 24bpp</param>
+/// <param name="frameSize">output buffer size in bytes</param>
+/// <param name="pData">32bpp RGBA render target, render sized</param>
+/// <param name="rowPitch">bytes between its rows</param>
+void PointCloudRendererBase::downsample32bppToRGB(BYTE* frameBuffer, int frameSize, const BYTE* pData, UINT rowPitch)
+{
+    int width = m_OutputWidth;
+    auto rgbaToBgr = m_PixelKernels->RgbaToBgr;
+    int minRowsPerTask = (UINT)width < MinConvertPixelsPerTask ? MinConvertPixelsPerTask / width : 1;
+    m_ThreadPool->ParallelFor(0, m_OutputHeight, minRowsPerTask, [=](int rowBegin, int rowEnd)
+        {
+            alignas(16) BYTE rgba[4 * DownsampleChunkPixels];
+            for (int row = rowBegin; row < rowEnd; row++)
+            {
+                for (int x = 0; x < width; x += DownsampleChunkPixels)
+                {
+                    int count = width - x < DownsampleChunkPixels ? width - x : DownsampleChunkPixels;
+                    (this->*m_DownsampleRgba)(rgba, pData, rowPitch, row, x, count);
+                    rgbaToBgr(frameBuffer + 3 * (row * width + x), rgba, count);
+                }
+            }
+        });
+}
+
+/// <summary>
+/// supersampled frames in the pipelined mode: filter the rendered RGBA frame down into the output sized RGBA frame
+/// (on the render stage, so the present stage converts as much as it would without supersampling)
+/// </summary>
+/// <param name="rgbaFrameBuffer">output sized, packed RGBA</param>
+/// <param name="pData">32bpp RGBA render target, render sized</param>
+/// <param name="rowPitch">bytes between its rows</param>
+void PointCloudRendererBase::downsample32bppToRgba(BYTE* rgbaFrameBuffer, const BYTE* pData, UINT rowPitch)
+{
+    int width = m_OutputWidth;
+    int minRowsPerTask = (UINT)width < MinConvertPixelsPerTask ? MinConvertPixelsPerTask / width : 1;
+    m_ThreadPool->ParallelFor(0, m_OutputHeight, minRowsPerTask, [=](int rowBegin, int rowEnd)
+        {
+            for (int row = rowBegin; row < rowEnd; row++)
+            {
+                for (int x = 0; x < width; x += DownsampleChunkPixels)
+                {
+                    int count = width - x < DownsampleChunkPixels ? width - x : DownsampleChunkPixels;
+                    (this->*m_DownsampleRgba)(rgbaFrameBuffer + 4 * (row * width + x), pData, rowPitch, row, x, count);
+                }
+            }
+        });
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef UNICODE
+#define UNICODE
+#endif
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+// the few Windows types the renderer interface uses, so that the CPU renderer builds (and benchmarks) elsewhere
+#include <cstdint>
+typedef unsigned char BYTE;
+typedef unsigned int UINT;
+typedef int32_t HRESULT;
+#define S_OK ((HRESULT)0)
+#define E_FAIL ((HRESULT)0x80004005)
+#endif
+#include <DirectXMath.h>    // matrix/vector math
+
+#include "CameraController.h"
+#include "FrameArena.h"
+#include "PixelKernels.h"
+#include "ThreadPool.h"
+
+// What the points are textured from, fixed at Init
+enum class TextureFormat
+{
+	None,		// no IR or color frame, the points are white
+	Y8,			// IR frame, kept single channel in the texture (1 byte per texel) and broadcast to grey when sampled
+	Rgb8		// color frame, kept 3 bytes per texel (a raw buffer for D3D) and unpacked when sampled
+};
+
+// How a supersampled frame is filtered down to the output size
+enum class DownsampleFilter
+{
+	Box,		// the average of each supersample x supersample block
+	Tent		// each block and half of its neighbours, weighted towards the middle: softer, and steadier as the camera moves
+};
+
+// Which way round the point cloud comes out, done by the projection so the readback stays a straight copy
+enum class OutputOrientation
+{
+	Upright,	// as the sensor sees it
+	Mirrored,	// left to right, like the IR and color types
+	Flipped,	// upside down
+	Rotated180	// mirrored and flipped
+};
+
+// A selected point as both renderers store it (the D3D vertex buffer, the CPU renderer's copy): 8 bytes rather than
+// 5 floats. Only the depth is kept of the position, which is rebuilt as depth times the ray of the depth pixel the point
+// came from (rays are per pixel and fixed for the camera, see SetDepthRays), and the texture coordinates are fixed point.
+//   uvPixel: u (unorm 14 bits) | v (unorm 14 bits) << 14 | pixel index bits 16 to 19 << 28
+//   depthPixel: depth (unorm 16 bits of the clipping distance, 0 for a dropped vertex) | pixel index bits 0 to 15 << 16
+struct PackedVertex
+{
+	UINT uvPixel;
+	UINT depthPixel;
+};
+
+// Optional rendering modes, set once at Init
+struct PointCloudRendererOptions
+{
+	// thin out points whose projected footprint is below minPointFootprint output pixels, with a stride per view depth band
+	bool levelOfDetail = false;
+	float minPointFootprint = 1.0f;
+
+	// draw each point as a disc sized to its depth rather than a single pixel, so sparser point clouds still cover
+	// the surface. splatSize is the disc diameter in units of the depth grid spacing at the point's depth
+	// (1 just touches the neighbouring points at full density, 2 for every second row and column etc.)
+	bool splatting = false;
+	float splatSize = 1.0f;
+
+	// connect neighbouring points of the depth grid into a triangle mesh for solid surfaces (instead of points or splats,
+	// and without level of detail thinning). Triangles spanning a depth jump of more than meshMaxDepthJump meters
+	// are dropped so separate objects don't get joined up
+	bool mesh = false;
+	float meshMaxDepthJump = 0.05f;
+
+	// anti-aliasing for the single pixel points, which shimmer as the camera drifts: render supersample times the output
+	// size in each direction (1 to 4) and filter it down on the way into the output frame, and/or take msaaSamples per
+	// pixel, resolved on the GPU (the CPU renderer supersamples instead: 4 samples as 2x2, 8 as 3x3, 16 as 4x4)
+	int supersample = 1;
+	DownsampleFilter downsampleFilter = DownsampleFilter::Box;
+	int msaaSamples = 1;
+
+	// mirror, flip or turn the output around
+	OutputOrientation orientation = OutputOrientation::Upright;
+
+	// how the camera moves (path and user poses are set through GetCamera), and where to hold it: this many seconds
+	// in, rather than following the clock (for repeatable frames, e.g. the golden images), negative to move
+	CameraMode cameraMode = CameraMode::Drift;
+	float cameraTime = -1.0f;
+};
+
+// Everything the point cloud renderers have in common: selecting (clipping, thinning) the points into vertices,
+// the drifting camera and converting the rendered RGBA frame into the 24bpp output.
+// PointCloudRenderer draws with Direct3D, CpuPointCloudRenderer is a software reference for hosts without a GPU.
+class PointCloudRendererBase
+{
+public:
+	PointCloudRendererBase();
+	virtual ~PointCloudRendererBase();
+
+	// TODO really here I just need to know the vertex structure (if we're going with that)
+	virtual HRESULT Init(int inputDepthWidth, int inputDepthHeight, int inputTexWidth, int inputTexHeight, TextureFormat textureFormat, int outputWidth, int outputHeight, float clippingDistanceZ, const PointCloudRendererOptions& options, ThreadPool* threadPool, FrameArena* frameArena);
+
+	virtual void UnInit() = 0;
+
+	// change the output size (e.g. when the filter's pin is reconnected at another size), recreating only what depends on it:
+	// the render target, depth buffer and readback copy, the viewport and the projection. The input textures, vertex
+	// buffers, shaders and the device are kept. Not while a frame is being drawn or read
+	virtual HRESULT Resize(int outputWidth, int outputHeight);
+
+	// focal length (in pixels) of the depth stream, used to estimate the point spacing for level of detail and splat sizes.
+	// Also sets pinhole rays through the middle of the depth grid, unless SetDepthRays has been called
+	void SetDepthFocalLength(float fx);
+
+	// the ray of each depth pixel, x/z and y/z (2 floats per pixel in row order) as the points are deprojected,
+	// which the packed vertices' positions are rebuilt along
+	void SetDepthRays(const float* rays);
+
+	// TODO vertex structures with colour? Separate streams?
+	// TODO really can pass current depth and color frames and let the shader work out the points, not librealsense
+	// TODO pass near/far clipping, other thresholding?
+	void RenderFrame(BYTE* outputFrameBuffer, const int outputFrameLength, const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, const void* color_frame_data, const int color_frame_size);
+
+	// RenderFrame split in two for the pipelined mode: DrawFrame uploads and draws the points into the renderer's RGBA frame,
+	// then ReadFrame converts that frame into the output frame. The render stage can instead copy the raw RGBA pixels out
+	// with ReadFrameRgba and leave the conversion (ConvertFrame) to the present stage.
+	virtual void DrawFrame(const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, const void* color_frame_data, const int color_frame_size) = 0;
+	virtual void ReadFrame(BYTE* outputFrameBuffer, const int outputFrameLength) = 0;
+	virtual void ReadFrameRgba(BYTE* rgbaFrameBuffer) = 0;
+
+	// draw the points from the last DrawFrame again from the camera's current position, for output frames
+	// in between sensor frames (the camera drift is time based so the view still moves on). If the camera hasn't
+	// moved nothing is drawn, the last frame is still there to read
+	virtual void RedrawFrame() = 0;
+	void ConvertFrame(BYTE* outputFrameBuffer, const int outputFrameLength, const BYTE* rgbaFrameBuffer);
+
+	// for the keyframed path and the user pose
+	CameraController& GetCamera() { return m_Camera; }
+
+	// vertices the last DrawFrame kept after clipping and level of detail (not in mesh mode, which keeps the whole grid)
+	unsigned int GetSelectedPointCount() const { return m_RowPointCounts[m_InputDepthHeight]; }
+
+protected:
+	static const float BackgroundColor[4];
+
+	DirectX::XMMATRIX world;
+	DirectX::XMMATRIX view;
+	DirectX::XMMATRIX projection;
+	DirectX::XMMATRIX worldViewProj;			// kept up to date by UpdateCamera
+	DirectX::XMVECTOR eyePos;
+	CameraController m_Camera;
+	bool m_TransformsChanged;					// world or projection, since worldViewProj was last worked out
+
+	UINT m_InputDepthWidth;
+	UINT m_InputDepthHeight;
+	UINT m_InputTexWidth;
+	UINT m_InputTexHeight;
+	TextureFormat m_TextureFormat;
+	UINT m_OutputWidth;
+	UINT m_OutputHeight;
+	UINT m_Supersample;							// 1 for none
+	UINT m_RenderWidth;							// what is actually rendered, the output size times m_Supersample
+	UINT m_RenderHeight;
+	float m_ClippingDistanceZ;
+	float m_DepthFocalLength;
+	PointCloudRendererOptions m_Options;
+	ThreadPool* m_ThreadPool;					// shared with RealSenseCam, not owned
+	FrameArena* m_FrameArena;					// likewise
+	const PixelKernels* m_PixelKernels;			// the best variant for this CPU
+	unsigned int* m_RowPointCounts;				// selected points per input depth row, then prefix summed
+
+	// level of detail: points are kept if their row and column are both multiples of their view depth band's stride
+	static const int LodBandCount = 16;
+	static const UINT MaxLodStride = 8;
+	float m_LodViewZ[4];						// view space z = dot(m_LodViewZ, (x, y, z, 1))
+	float m_LodBandsPerMeter;
+	UINT m_LodBandStrideMasks[LodBandCount];	// stride - 1, strides are powers of two
+
+	// the output and render sizes, and the perspective projection for the output aspect ratio and orientation
+	void SetOutputSize(int outputWidth, int outputHeight);
+
+	// a mirrored or flipped (not turned) output reverses the winding of the triangles on screen
+	bool IsOrientationReflected() const { return m_Options.orientation == OutputOrientation::Mirrored || m_Options.orientation == OutputOrientation::Flipped; }
+
+	// move the camera to where it is now, and rebuild worldViewProj if it or the world or projection transforms have
+	// moved. Returns true if worldViewProj changed
+	bool UpdateCamera();
+	void UpdateLevelOfDetail();
+
+	// packed vertices: the largest depth grid the pixel index has room for, the depth and uv scales
+	static const UINT MaxPackedPixels = 1 << 20;
+	static const UINT PackedUvMax = (1 << 14) - 1;
+	float m_PackedDepthScale;					// meters per unit of packed depth
+	float* m_DepthRays;							// x/z, y/z per depth pixel
+	bool m_DepthRaysSet;						// by SetDepthRays, so SetDepthFocalLength leaves them be
+	bool m_DepthRaysChanged;					// since the renderer last took them (the GPU renderer uploads them)
+	void SetPinholeDepthRays();
+
+	// depthUnits is 1 / m_PackedDepthScale. Depths outside (0, 65535 units] become 0, uvs are clamped to [0, 1] as the
+	// sampler does. (Written with compares rather than fmin/fmax so the selection loops stay branch free)
+	static PackedVertex PackVertex(const float* xyz, const float* uv, UINT pixel, float depthUnits)
+	{
+		float depth = xyz[2] * depthUnits;
+		float u = uv[0] > 0.0f ? (uv[0] < 1.0f ? uv[0] : 1.0f) : 0.0f;
+		float v = uv[1] > 0.0f ? (uv[1] < 1.0f ? uv[1] : 1.0f) : 0.0f;
+		PackedVertex vertex;
+		vertex.uvPixel = (int)(u * PackedUvMax + 0.5f) | (int)(v * PackedUvMax + 0.5f) << 14 | (pixel >> 16) << 28;
+		vertex.depthPixel = (depth > 0.0f && depth < 65535.5f ? (int)(depth + 0.5f) : 0) | pixel << 16;
+		return vertex;
+	}
+
+	// clip and thin the points (in parallel over the input rows) and pack them into vertices,
+	// returns the number of vertices written
+	unsigned int SelectPoints(const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, PackedVertex* vertices);
+
+	// mesh mode: two triangles per quad of the depth grid, indices into the (uncompacted) grid of vertices.
+	// Built once at Init, static from then on
+	UINT* m_MeshIndices;
+	unsigned int m_MeshIndexCount;
+	float* m_MeshDepths;						// depth plane of the current frame, +inf where there is no depth
+
+	void BuildMeshIndices();
+
+	// pack every point of the grid into a vertex, in grid order for the mesh indices. Points that are clipped, or on the
+	// far side of a depth discontinuity, get depth 0, which the vertex stage turns into a NaN position so every triangle
+	// touching them is culled
+	void SelectMeshVertices(const unsigned int pointsCount, const float* pointsXyz, const float* texUvs, PackedVertex* vertices);
+
+	// splat disc radius in world units per meter of the point's depth
+	float GetSplatRadiusPerMeter() const;
+
+	// bytes per texel of the texture for m_TextureFormat (1 for Y8, 3 for RGB8, RGBA for the plain white texture)
+	UINT GetTexelBytes() const { return m_TextureFormat == TextureFormat::Y8 ? 1 : m_TextureFormat == TextureFormat::Rgb8 ? 3 : 4; }
+
+	// copy an IR/color frame into the texture (the D3D texture, or the CPU renderer's copy of it), rowPitch bytes apart,
+	// compiled for each TextureFormat and picked once at Init so there's no per-frame or per-pixel format test
+	template <TextureFormat Format>
+	void UploadTexture(BYTE* texture, UINT rowPitch, const BYTE* frame);
+	void (PointCloudRendererBase::*m_UploadTexture)(BYTE* texture, UINT rowPitch, const BYTE* frame);
+
+	static const UINT MinConvertPixelsPerTask = 16 * 640;
+	void convert32bppToRGB(BYTE* frameBuffer, int frameSize, const BYTE* pData, UINT rowPitch);
+
+	// supersampling: filter the render sized RGBA frame down into the 24bpp output (fused with the conversion, each
+	// run of output pixels is filtered into a small RGBA buffer that's converted while it's still in L1) or the output
+	// sized RGBA frame of the pipelined mode
+	static const UINT MaxSupersample = 4;
+	static const int DownsampleChunkPixels = 512;
+	void downsample32bppToRGB(BYTE* frameBuffer, int frameSize, const BYTE* pData, UINT rowPitch);
+	void downsample32bppToRgba(BYTE* rgbaFrameBuffer, const BYTE* pData, UINT rowPitch);
+
+	// count (up to DownsampleChunkPixels) pixels of output row from x on, filtered from the supersampled frame into rgba.
+	// Both filters are separable integer weights, rounded exactly like the plain 2D sum. The box filter has its own
+	// path for the usual 2x2. Picked once at Init
+	template <DownsampleFilter Filter>
+	void DownsampleRgba(BYTE* rgba, const BYTE* pData, UINT rowPitch, int row, int x, int count) const;
+	void (PointCloudRendererBase::*m_DownsampleRgba)(BYTE* rgba, const BYTE* pData, UINT rowPitch, int row, int x, int count) const;
+};
@@ -0,0 +1,825 @@
+// Headless benchmark of the parts of the capture path that build without Windows, DirectShow or librealsense, fed by
+// SyntheticScene frames, so that it runs on Linux (and anywhere else CMake builds it) to track regressions every commit.
+//     PortableBenchmark [frames per type] [output file]
+// prints JSON (to the file if there is one, 300 frames by default) with, for each RealSenseCamType, the frame rate,
+// per-stage percentiles, CPU time and peak memory of its output path: the pixel kernels for the IR and color types, the
+// CPU point cloud renderer for the point cloud types (the colorized and aligned depth types need librealsense's
+// colorizer and align, so they're only listed). Then the pixel kernels at 1080p and 4K, and the CPU renderer on its own
+// at 1080p for each of its modes, with 1, 2, 4... threads. Then what the CPU renderer's options trade: the points drawn,
+// draw time, PSNR against a reference image and coverage of level of detail, of splats against single pixel points, and
+// of the mesh against points. Last, the shared frame ring's latency from publishing a frame to 1, 2 and 4 readers
+// copying it out.
+// The whole capture path, librealsense and Direct3D included, is Benchmark.cpp's RunBenchmark in Filters.dll.
+
+#include "CpuPointCloudRenderer.h"
+#include "FrameArena.h"
+#include "PixelKernels.h"
+#include "SharedFrameRing.h"
+#include "SyntheticScene.h"
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+#include <psapi.h>
+#pragma comment(lib, "psapi")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int WarmUpFrames = 15;			// not counted, while the caches warm up
+static const int DefaultFrameCount = 300;
+static const int SceneFrames = 8;			// distinct SyntheticScene frames each type cycles through
+static const int OutputWidth = 640;
+static const int OutputHeight = 480;
+
+enum class Stage
+{
+	Draw,		// the CPU renderer's DrawFrame: selecting, transforming, binning and rasterising the points
+	Output,		// conversion into the output frame
+	Count
+};
+static const char* const StageNames[] = { "draw", "output" };
+
+struct TypeResult
+{
+	const char* type;
+	std::string error;						// empty if it ran
+	int frames = 0;
+	double seconds = 0.0;
+	double cpuSeconds = 0.0;				// all threads, user and kernel
+	size_t peakMemoryBytes = 0;				// of the whole process so far
+	std::vector<double> frameMilliseconds;
+	std::vector<double> stageMilliseconds[(int)Stage::Count];
+};
+
+// a pixel kernel or CPU renderer mode run with a thread pool of one size
+struct ScalingResult
+{
+	std::string mode;
+	int threads;
+	double drawMilliseconds;				// median of a frame's ParallelFor or DrawFrame
+	double cpuMilliseconds;					// all threads, per frame
+};
+
+// a renderer option set drawing the scene, against a reference drawn from the same view
+struct QualityResult
+{
+	std::string mode;
+	int width;
+	int height;
+	unsigned int points;					// vertices drawn
+	double drawMilliseconds;				// median of DrawFrame
+	double psnr;							// of the output frame against the reference, dB
+	double coverage;						// fraction of the output pixels drawn (not background)
+};
+
+// readers of the shared frame ring, each on its own thread with its own mapping as separate processes would have
+struct RingResult
+{
+	int readers;
+	int published;
+	int minFramesRead;						// by the reader that saw the fewest
+	double averageLatencyMicroseconds;		// publish to copy-out, over all the readers
+	double maxLatencyMicroseconds;
+};
+
+// a depth grid of the scene's points with its IR texture
+struct SceneGrid
+{
+	int width;
+	int height;
+	float focalLength;
+	std::vector<float> xyz;
+	std::vector<float> uv;
+	std::vector<uint8_t> infrared;			// always the full depth size, the uvs point into it
+};
+
+static double Median(std::vector<double> samples)
+{
+	std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+	return samples[samples.size() / 2];
+}
+
+// 1, 2, 4... up to one thread per logical core, and that too
+static int NextThreadCount(int threads)
+{
+	int coreCount = std::max(1, (int)std::thread::hardware_concurrency());
+	return threads >= coreCount ? 0 : std::min(threads * 2, coreCount);
+}
+
+static double Milliseconds(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static double CpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER kernelTicks = { kernel.dwLowDateTime, kernel.dwHighDateTime };
+	ULARGE_INTEGER userTicks = { user.dwLowDateTime, user.dwHighDateTime };
+	return (kernelTicks.QuadPart + userTicks.QuadPart) / 1.0e7;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1.0e6;
+#endif
+}
+
+static size_t PeakMemoryBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS memoryCounters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters)))
+		return memoryCounters.PeakWorkingSetSize;
+	return 0;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (size_t)usage.ru_maxrss << 10;
+#endif
+}
+
+/// <summary>
+/// time frameCount output frames (after the warm up), each made by frame(i, stageMilliseconds) which fills in its stages
+/// </summary>
+template <typename Fn>
+static void TimeFrames(TypeResult& result, int frameCount, Fn frame)
+{
+	double stages[(int)Stage::Count];
+	for (int i = 0; i < WarmUpFrames; i++)
+		frame(i, stages);
+
+	double cpuBegin = CpuSeconds();
+	auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < frameCount; i++)
+	{
+		for (double& stage : stages)
+			stage = 0.0;
+		auto start = std::chrono::steady_clock::now();
+		frame(i, stages);
+		result.frameMilliseconds.push_back(Milliseconds(start, std::chrono::steady_clock::now()));
+		for (int stage = 0; stage < (int)Stage::Count; stage++)
+			result.stageMilliseconds[stage].push_back(stages[stage]);
+	}
+	result.frames = frameCount;
+	result.seconds = Milliseconds(begin, std::chrono::steady_clock::now()) / 1000.0;
+	result.cpuSeconds = CpuSeconds() - cpuBegin;
+	result.peakMemoryBytes = PeakMemoryBytes();
+}
+
+/// <summary>
+/// the IR, Color and ColorYuy2 types: the sensor frames turned into output frames by the pixel kernels, split into rows
+/// over the thread pool as RealSenseCam's invert8bppToRGB, invert24bppToRGB and mirrorYuy2 do it
+/// </summary>
+static TypeResult RunKernelType(const char* type, int frameCount, ThreadPool& threadPool)
+{
+	TypeResult result;
+	result.type = type;
+	const PixelKernels& kernels = PixelKernels::GetBest();
+
+	std::string name = type;
+	bool infrared = name == "IR";
+	int width = infrared ? SyntheticScene::DepthWidth : SyntheticScene::ColorWidth;
+	int height = infrared ? SyntheticScene::DepthHeight : SyntheticScene::ColorHeight;
+	int inputBytesPerPixel = infrared ? 1 : name == "ColorYuy2" ? 2 : 3;
+	int outputBytesPerPixel = name == "ColorYuy2" ? 2 : 3;
+	int pixelCount = width * height;
+
+	std::vector<std::vector<uint8_t>> frames(SceneFrames, std::vector<uint8_t>((size_t)inputBytesPerPixel * pixelCount));
+	for (int i = 0; i < SceneFrames; i++)
+	{
+		if (infrared)
+			SyntheticScene::FillInfrared(frames[i].data(), i);
+		else
+			SyntheticScene::FillColor(frames[i].data(), inputBytesPerPixel, i);
+	}
+	std::vector<uint8_t> output((size_t)outputBytesPerPixel * pixelCount);
+	uint8_t* frameBuffer = output.data();
+
+	TimeFrames(result, frameCount, [&](int i, double* stages)
+		{
+			const uint8_t* data = frames[i % SceneFrames].data();
+			auto start = std::chrono::steady_clock::now();
+			threadPool.ParallelFor(0, height, 16, [=, &kernels](int rowBegin, int rowEnd)
+				{
+					if (infrared)
+						kernels.ReverseToGrey(frameBuffer + 3 * rowBegin * width, data + pixelCount - rowEnd * width, (rowEnd - rowBegin) * width);
+					else if (outputBytesPerPixel == 3)
+						kernels.ReverseBytes(frameBuffer + 3 * rowBegin * width, data + 3 * (pixelCount - rowEnd * width), 3 * (rowEnd - rowBegin) * width);
+					else
+					{
+						for (int row = rowBegin; row < rowEnd; row++)
+							kernels.MirrorYuy2(frameBuffer + 2 * row * width, data + 2 * row * width, width);
+					}
+				});
+			stages[(int)Stage::Output] = Milliseconds(start, std::chrono::steady_clock::now());
+		});
+	return result;
+}
+
+/// <summary>
+/// the point cloud types: SyntheticScene's points (as rs2::pointcloud would calculate them) drawn by the CPU renderer,
+/// with the options RealSenseCam::Init uses, and read back into the output frame
+/// </summary>
+static TypeResult RunPointCloudType(const char* type, int frameCount, ThreadPool& threadPool)
+{
+	TypeResult result;
+	result.type = type;
+
+	std::string name = type;
+	bool infrared = name == "PointCloudIR";
+	bool color = name == "PointCloudColor";
+	const int pointCount = SyntheticScene::DepthWidth * SyntheticScene::DepthHeight;
+	int textureWidth = color ? SyntheticScene::ColorWidth : SyntheticScene::DepthWidth;
+	int textureHeight = color ? SyntheticScene::ColorHeight : SyntheticScene::DepthHeight;
+	int textureSize = color ? 3 * textureWidth * textureHeight : infrared ? textureWidth * textureHeight : 0;
+	TextureFormat textureFormat = color ? TextureFormat::Rgb8 : infrared ? TextureFormat::Y8 : TextureFormat::None;
+
+	std::vector<std::vector<float>> xyz(SceneFrames, std::vector<float>(3 * pointCount)), uv(SceneFrames, std::vector<float>(2 * pointCount));
+	std::vector<std::vector<uint8_t>> textures(SceneFrames, std::vector<uint8_t>(textureSize));
+	for (int i = 0; i < SceneFrames; i++)
+	{
+		SyntheticScene::FillPoints(xyz[i].data(), uv[i].data(), color, i);
+		if (color)
+			SyntheticScene::FillColor(textures[i].data(), 3, i);
+		else if (infrared)
+			SyntheticScene::FillInfrared(textures[i].data(), i);
+	}
+
+	PointCloudRendererOptions options;
+	options.levelOfDetail = true;
+	options.cameraTime = 1.0f;
+	FrameArena frameArena;
+	frameArena.Reserve((size_t)4 << 20);
+	CpuPointCloudRenderer renderer;
+	renderer.Init(SyntheticScene::DepthWidth, SyntheticScene::DepthHeight, textureWidth, textureHeight, textureFormat, OutputWidth, OutputHeight, 1.3f, options, &threadPool, &frameArena);
+	renderer.SetDepthFocalLength(SyntheticScene::DepthFocalLength);
+	std::vector<BYTE> output(3 * OutputWidth * OutputHeight);
+
+	TimeFrames(result, frameCount, [&](int i, double* stages)
+		{
+			int frame = i % SceneFrames;
+			auto start = std::chrono::steady_clock::now();
+			renderer.DrawFrame(pointCount, xyz[frame].data(), uv[frame].data(), textureSize ? textures[frame].data() : NULL, textureSize);
+			auto drawn = std::chrono::steady_clock::now();
+			renderer.ReadFrame(output.data(), (int)output.size());
+			stages[(int)Stage::Draw] = Milliseconds(start, drawn);
+			stages[(int)Stage::Output] = Milliseconds(drawn, std::chrono::steady_clock::now());
+		});
+	renderer.UnInit();
+	return result;
+}
+
+/// <summary>
+/// each pixel kernel converting a 1080p and a 4K frame, split into rows over 1, 2, 4... threads as the capture path does
+/// (16 row minimum). A frame is tens of MB across input and output, so this is mostly memory bandwidth bound and
+/// shows where more threads stop helping
+/// </summary>
+static std::vector<ScalingResult> RunKernelScaling(int frameCount)
+{
+	struct Kernel
+	{
+		const char* name;
+		void (*PixelKernels::*fn)(unsigned char*, const unsigned char*, int);
+		int inputBytesPerPixel;
+		int outputBytesPerPixel;
+		bool byteCount;						// ReverseBytes counts bytes rather than pixels
+	};
+	static const Kernel Kernels[] =
+	{
+		{ "RgbaToBgr", &PixelKernels::RgbaToBgr, 4, 3, false },
+		{ "ReverseToGrey", &PixelKernels::ReverseToGrey, 1, 3, false },
+		{ "ReverseBytes", &PixelKernels::ReverseBytes, 3, 3, true },
+		{ "MirrorYuy2", &PixelKernels::MirrorYuy2, 2, 2, false },
+	};
+	static const struct { const char* name; int width; int height; } Sizes[] = { { "1080p", 1920, 1080 }, { "4K", 3840, 2160 } };
+	const PixelKernels& kernels = PixelKernels::GetBest();
+
+	std::vector<ScalingResult> results;
+	for (const auto& size : Sizes)
+	{
+		int width = size.width;
+		std::vector<uint8_t> input((size_t)4 * size.width * size.height), output((size_t)4 * size.width * size.height);
+		for (size_t i = 0; i < input.size(); i++)
+			input[i] = (uint8_t)(i * 7 + (i >> 11));
+
+		for (const Kernel& kernel : Kernels)
+		{
+			auto fn = kernels.*kernel.fn;
+			int inputRowBytes = kernel.inputBytesPerPixel * width;
+			int outputRowBytes = kernel.outputBytesPerPixel * width;
+			int count = kernel.byteCount ? inputRowBytes : width;
+			const uint8_t* src = input.data();
+			uint8_t* dst = output.data();
+
+			for (int threads = 1; threads; threads = NextThreadCount(threads))
+			{
+				ThreadPool threadPool;
+				threadPool.Start(threads, false);
+				// row by row so that every kernel (MirrorYuy2 in particular) does the same thing, the reversing ones
+				// just don't turn the frame around
+				auto frame = [&]()
+					{
+						threadPool.ParallelFor(0, size.height, 16, [=](int rowBegin, int rowEnd)
+							{
+								for (int row = rowBegin; row < rowEnd; row++)
+									fn(dst + (size_t)row * outputRowBytes, src + (size_t)row * inputRowBytes, count);
+							});
+					};
+				for (int i = 0; i < WarmUpFrames; i++)
+					frame();
+				std::vector<double> milliseconds;
+				double cpuBegin = CpuSeconds();
+				for (int i = 0; i < frameCount; i++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					frame();
+					milliseconds.push_back(Milliseconds(start, std::chrono::steady_clock::now()));
+				}
+
+				ScalingResult result;
+				result.mode = std::string(kernel.name) + " " + size.name;
+				result.threads = threads;
+				result.drawMilliseconds = Median(milliseconds);
+				result.cpuMilliseconds = (CpuSeconds() - cpuBegin) * 1000.0 / frameCount;
+				results.push_back(result);
+				threadPool.Stop();
+			}
+		}
+	}
+	return results;
+}
+
+/// <summary>
+/// the CPU point cloud renderer drawing the scene's points in each of its modes into a 1080p frame, with 1, 2, 4...
+/// threads up to one per logical core (and that too). Each band of output rows only rasterises the points (or
+/// triangles) binned to it, so the work per frame should stay flat and the draw time drop in proportion to the threads
+/// </summary>
+static std::vector<ScalingResult> RunCpuRendererScaling(int frameCount)
+{
+	const int pointCount = SyntheticScene::DepthWidth * SyntheticScene::DepthHeight;
+	std::vector<float> xyz(3 * pointCount), uv(2 * pointCount);
+	std::vector<BYTE> infrared(pointCount);
+	SyntheticScene::FillPoints(xyz.data(), uv.data(), false, 0);
+	SyntheticScene::FillInfrared(infrared.data(), 0);
+
+	static const char* const Modes[] = { "points", "splats", "mesh" };
+	std::vector<ScalingResult> results;
+	for (const char* mode : Modes)
+	{
+		PointCloudRendererOptions options;
+		options.splatting = std::string(mode) == "splats";
+		options.mesh = std::string(mode) == "mesh";
+		options.cameraTime = 0.0f;
+
+		for (int threads = 1; threads; threads = NextThreadCount(threads))
+		{
+			ThreadPool threadPool;
+			threadPool.Start(threads, false);
+			FrameArena frameArena;
+			frameArena.Reserve((size_t)32 << 20);
+			CpuPointCloudRenderer renderer;
+			renderer.Init(SyntheticScene::DepthWidth, SyntheticScene::DepthHeight, SyntheticScene::DepthWidth, SyntheticScene::DepthHeight, TextureFormat::Y8, 1920, 1080, 1.3f, options, &threadPool, &frameArena);
+			renderer.SetDepthFocalLength(SyntheticScene::DepthFocalLength);
+
+			for (int i = 0; i < WarmUpFrames; i++)
+				renderer.DrawFrame(pointCount, xyz.data(), uv.data(), infrared.data(), pointCount);
+			std::vector<double> drawMilliseconds;
+			double cpuBegin = CpuSeconds();
+			for (int i = 0; i < frameCount; i++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				renderer.DrawFrame(pointCount, xyz.data(), uv.data(), infrared.data(), pointCount);
+				drawMilliseconds.push_back(Milliseconds(start, std::chrono::steady_clock::now()));
+			}
+
+			ScalingResult result;
+			result.mode = mode;
+			result.threads = threads;
+			result.drawMilliseconds = Median(drawMilliseconds);
+			result.cpuMilliseconds = (CpuSeconds() - cpuBegin) * 1000.0 / frameCount;
+			results.push_back(result);
+
+			renderer.UnInit();
+			threadPool.Stop();
+		}
+	}
+	return results;
+}
+
+static SceneGrid MakeSceneGrid()
+{
+	SceneGrid grid;
+	grid.width = SyntheticScene::DepthWidth;
+	grid.height = SyntheticScene::DepthHeight;
+	grid.focalLength = SyntheticScene::DepthFocalLength;
+	grid.xyz.resize(3 * grid.width * grid.height);
+	grid.uv.resize(2 * grid.width * grid.height);
+	grid.infrared.resize(grid.width * grid.height);
+	SyntheticScene::FillPoints(grid.xyz.data(), grid.uv.data(), false, 0);
+	SyntheticScene::FillInfrared(grid.infrared.data(), 0);
+	return grid;
+}
+
+// every step'th row and column of grid, as a depth stream at 1 / step of the resolution would see the scene
+static SceneGrid SubsampleGrid(const SceneGrid& grid, int step)
+{
+	SceneGrid subsampled;
+	subsampled.width = grid.width / step;
+	subsampled.height = grid.height / step;
+	subsampled.focalLength = grid.focalLength / step;
+	for (int row = 0; row < subsampled.height; row++)
+	{
+		for (int column = 0; column < subsampled.width; column++)
+		{
+			int pixel = row * step * grid.width + column * step;
+			subsampled.xyz.insert(subsampled.xyz.end(), &grid.xyz[3 * pixel], &grid.xyz[3 * pixel] + 3);
+			subsampled.uv.insert(subsampled.uv.end(), &grid.uv[2 * pixel], &grid.uv[2 * pixel] + 2);
+		}
+	}
+	subsampled.infrared = grid.infrared;
+	return subsampled;
+}
+
+static double Psnr(const std::vector<BYTE>& image, const std::vector<BYTE>& reference)
+{
+	double squaredError = 0.0;
+	for (size_t i = 0; i < image.size(); i++)
+	{
+		double difference = (double)image[i] - reference[i];
+		squaredError += difference * difference;
+	}
+	if (squaredError == 0.0)
+		return 100.0;						// identical
+	return 10.0 * std::log10(255.0 * 255.0 * image.size() / squaredError);
+}
+
+// the fraction of pixels that differ from the background
+static double Coverage(const std::vector<BYTE>& image, const std::vector<BYTE>& background)
+{
+	size_t covered = 0;
+	for (size_t i = 0; i < image.size(); i += 3)
+		covered += image[i] != background[i] || image[i + 1] != background[i + 1] || image[i + 2] != background[i + 2];
+	return 3.0 * covered / image.size();
+}
+
+/// <summary>
+/// draw grid frameCount times (after the warm up) from the fixed camera at cameraTime 1 into a width x height output
+/// on one thread, so the times compare the work rather than the scheduling. Reads the last frame back into image, and
+/// compares it to a frame with no depth for the coverage
+/// </summary>
+static QualityResult RenderQuality(const char* mode, const PointCloudRendererOptions& rendererOptions, const SceneGrid& grid, int width, int height, int frameCount, std::vector<BYTE>& image)
+{
+	PointCloudRendererOptions options = rendererOptions;
+	options.cameraTime = 1.0f;
+	ThreadPool threadPool;
+	threadPool.Start(1, false);
+	FrameArena frameArena;
+	frameArena.Reserve((size_t)16 << 20);
+	CpuPointCloudRenderer renderer;
+	renderer.Init(grid.width, grid.height, SyntheticScene::DepthWidth, SyntheticScene::DepthHeight, TextureFormat::Y8, width, height, 1.3f, options, &threadPool, &frameArena);
+	renderer.SetDepthFocalLength(grid.focalLength);
+
+	unsigned int pointCount = grid.width * grid.height;
+	int textureSize = (int)grid.infrared.size();
+	for (int i = 0; i < WarmUpFrames; i++)
+		renderer.DrawFrame(pointCount, grid.xyz.data(), grid.uv.data(), grid.infrared.data(), textureSize);
+	std::vector<double> drawMilliseconds;
+	for (int i = 0; i < frameCount; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		renderer.DrawFrame(pointCount, grid.xyz.data(), grid.uv.data(), grid.infrared.data(), textureSize);
+		drawMilliseconds.push_back(Milliseconds(start, std::chrono::steady_clock::now()));
+	}
+	unsigned int drawnPoints = options.mesh ? pointCount : renderer.GetSelectedPointCount();
+	image.resize(3 * width * height);
+	renderer.ReadFrame(image.data(), (int)image.size());
+	std::vector<float> noDepth(grid.xyz.size(), 0.0f);
+	std::vector<BYTE> background(image.size());
+	renderer.DrawFrame(pointCount, noDepth.data(), grid.uv.data(), grid.infrared.data(), textureSize);
+	renderer.ReadFrame(background.data(), (int)background.size());
+
+	QualityResult result;
+	result.mode = mode;
+	result.width = width;
+	result.height = height;
+	result.points = drawnPoints;
+	result.drawMilliseconds = Median(drawMilliseconds);
+	result.psnr = 0.0;
+	result.coverage = Coverage(image, background);
+	renderer.UnInit();
+	threadPool.Stop();
+	return result;
+}
+
+/// <summary>
+/// level of detail: the full density points against the thinned ones (a minimum footprint of 1 and 2 output pixels) at
+/// the default 640x480 output and smaller ones, where more of the points land on the same pixel
+/// </summary>
+static std::vector<QualityResult> RunLevelOfDetail(int frameCount)
+{
+	SceneGrid grid = MakeSceneGrid();
+	static const struct { int width; int height; } Sizes[] = { { 640, 480 }, { 320, 240 }, { 160, 120 } };
+	std::vector<QualityResult> results;
+	for (const auto& size : Sizes)
+	{
+		PointCloudRendererOptions options;
+		options.levelOfDetail = false;
+		std::vector<BYTE> reference, image;
+		results.push_back(RenderQuality("full", options, grid, size.width, size.height, frameCount, reference));
+		results.back().psnr = Psnr(reference, reference);
+
+		options.levelOfDetail = true;
+		for (float footprint : { 1.0f, 2.0f })
+		{
+			options.minPointFootprint = footprint;
+			results.push_back(RenderQuality(footprint == 1.0f ? "lod1" : "lod2", options, grid, size.width, size.height, frameCount, image));
+			results.back().psnr = Psnr(image, reference);
+		}
+	}
+	return results;
+}
+
+/// <summary>
+/// splatting: single pixel points against splats, from the full depth grid and from every second row and column (a
+/// quarter of the points, whose halved focal length doubles the splats), at 640x480 and upscaled to 1080p where points
+/// alone leave holes. Splats of 1 grid spacing (the default) leave gaps between the discs, 1.5 covers them. The reference
+/// is the full density splats of the same size, and of 1.5 for the points
+/// </summary>
+static std::vector<QualityResult> RunSplatting(int frameCount)
+{
+	SceneGrid grid = MakeSceneGrid();
+	SceneGrid quarter = SubsampleGrid(grid, 2);
+	static const struct { int width; int height; } Sizes[] = { { 640, 480 }, { 1920, 1080 } };
+	std::vector<QualityResult> results;
+	for (const auto& size : Sizes)
+	{
+		PointCloudRendererOptions options;
+		options.splatting = true;
+		std::vector<BYTE> reference, image;
+		for (float splatSize : { 1.0f, 1.5f })
+		{
+			options.splatSize = splatSize;
+			results.push_back(RenderQuality(splatSize == 1.0f ? "splats" : "splats 1.5", options, grid, size.width, size.height, frameCount, reference));
+			results.back().psnr = Psnr(reference, reference);
+			results.push_back(RenderQuality(splatSize == 1.0f ? "splats quarter" : "splats 1.5 quarter", options, quarter, size.width, size.height, frameCount, image));
+			results.back().psnr = Psnr(image, reference);
+		}
+
+		options.splatting = false;
+		results.push_back(RenderQuality("points", options, grid, size.width, size.height, frameCount, image));
+		results.back().psnr = Psnr(image, reference);
+		results.push_back(RenderQuality("points quarter", options, quarter, size.width, size.height, frameCount, image));
+		results.back().psnr = Psnr(image, reference);
+	}
+	return results;
+}
+
+/// <summary>
+/// mesh: the triangle mesh against single pixel points and splats, from the full depth grid and from every second row
+/// and column, at 640x480 and 1080p. The reference is the full density mesh
+/// </summary>
+static std::vector<QualityResult> RunMesh(int frameCount)
+{
+	SceneGrid grid = MakeSceneGrid();
+	SceneGrid half = SubsampleGrid(grid, 2);
+	static const struct { int width; int height; } Sizes[] = { { 640, 480 }, { 1920, 1080 } };
+	std::vector<QualityResult> results;
+	for (const auto& size : Sizes)
+	{
+		PointCloudRendererOptions options;
+		options.mesh = true;
+		std::vector<BYTE> reference, image;
+		results.push_back(RenderQuality("mesh", options, grid, size.width, size.height, frameCount, reference));
+		results.back().psnr = Psnr(reference, reference);
+		results.push_back(RenderQuality("mesh half", options, half, size.width, size.height, frameCount, image));
+		results.back().psnr = Psnr(image, reference);
+
+		options.mesh = false;
+		results.push_back(RenderQuality("points", options, grid, size.width, size.height, frameCount, image));
+		results.back().psnr = Psnr(image, reference);
+		options.splatting = true;
+		options.splatSize = 1.5f;
+		results.push_back(RenderQuality("splats 1.5", options, grid, size.width, size.height, frameCount, image));
+		results.back().psnr = Psnr(image, reference);
+		results.push_back(RenderQuality("splats 1.5 half", options, half, size.width, size.height, frameCount, image));
+		results.back().psnr = Psnr(image, reference);
+	}
+	return results;
+}
+
+/// <summary>
+/// the producer publishing frameCount 640x480 24bpp frames into a 3 slot shared frame ring at the camera's frame rate,
+/// as RealSenseCam does, to 1, 2 and 4 readers waiting in Read
+/// </summary>
+static std::vector<RingResult> RunSharedFrameRing(int frameCount)
+{
+#ifdef _WIN32
+	std::string name = "vcam-realsense-benchmark-" + std::to_string(GetCurrentProcessId());
+#else
+	std::string name = "vcam-realsense-benchmark-" + std::to_string(getpid());
+#endif
+	SharedFrameFormat format = { OutputWidth, OutputHeight, 3 };
+	std::vector<RingResult> results;
+	for (int readerCount : { 1, 2, 4 })
+	{
+		SharedFrameRing producer;
+		if (!producer.Create(name.c_str(), format.GetBytes(), 3))
+			break;
+
+		std::atomic<bool> stop(false);
+		std::vector<int> framesRead(readerCount);
+		std::vector<double> averageLatency(readerCount), maxLatency(readerCount);
+		std::vector<std::thread> readers;
+		for (int r = 0; r < readerCount; r++)
+		{
+			readers.emplace_back([&, r]()
+				{
+					SharedFrameRing reader;
+					reader.Open(name.c_str());
+					std::vector<unsigned char> frame(format.GetBytes());
+					uint64_t sequence = 0;
+					SharedFrameFormat readFormat;
+					while (!stop)
+					{
+						if (reader.Read(frame.data(), frame.size(), sequence, 20, readFormat))
+							framesRead[r]++;
+					}
+					averageLatency[r] = reader.GetAverageLatencyMicroseconds();
+					maxLatency[r] = reader.GetMaxLatencyMicroseconds();
+				});
+		}
+
+		auto frameInterval = std::chrono::microseconds(1000000 / SyntheticScene::FrameRate);
+		auto nextFrame = std::chrono::steady_clock::now() + frameInterval;
+		for (int i = 0; i < frameCount; i++)
+		{
+			std::this_thread::sleep_until(nextFrame);
+			nextFrame += frameInterval;
+			SyntheticScene::FillColor(producer.BeginWrite(), 3, i);
+			producer.EndWrite(format);
+		}
+		// the last frame's readers have had a frame interval to copy it
+		std::this_thread::sleep_until(nextFrame);
+		stop = true;
+		for (auto& reader : readers)
+			reader.join();
+		producer.Close();
+
+		RingResult result;
+		result.readers = readerCount;
+		result.published = frameCount;
+		result.minFramesRead = *std::min_element(framesRead.begin(), framesRead.end());
+		result.averageLatencyMicroseconds = 0.0;
+		for (double latency : averageLatency)
+			result.averageLatencyMicroseconds += latency / readerCount;
+		result.maxLatencyMicroseconds = *std::max_element(maxLatency.begin(), maxLatency.end());
+		results.push_back(result);
+	}
+	return results;
+}
+
+static void WriteQuality(FILE* file, const char* name, const std::vector<QualityResult>& quality, bool last)
+{
+	fprintf(file, "  \"%s\": [\n", name);
+	for (size_t i = 0; i < quality.size(); i++)
+	{
+		fprintf(file, "    { \"mode\": \"%s\", \"width\": %d, \"height\": %d, \"points\": %u, \"drawP50\": %.3f, \"psnr\": %.2f, \"coverage\": %.3f }%s\n",
+			quality[i].mode.c_str(), quality[i].width, quality[i].height, quality[i].points, quality[i].drawMilliseconds, quality[i].psnr, quality[i].coverage,
+			i + 1 == quality.size() ? "" : ",");
+	}
+	fprintf(file, "  ]%s\n", last ? "" : ",");
+}
+
+static void WriteRing(FILE* file, const std::vector<RingResult>& ring)
+{
+	fprintf(file, "  \"sharedFrameRing\": [\n");
+	for (size_t i = 0; i < ring.size(); i++)
+	{
+		fprintf(file, "    { \"readers\": %d, \"published\": %d, \"minFramesRead\": %d, \"averageLatencyMicroseconds\": %.1f, \"maxLatencyMicroseconds\": %.1f }%s\n",
+			ring[i].readers, ring[i].published, ring[i].minFramesRead, ring[i].averageLatencyMicroseconds, ring[i].maxLatencyMicroseconds,
+			i + 1 == ring.size() ? "" : ",");
+	}
+	fprintf(file, "  ]\n");
+}
+
+static void WriteScaling(FILE* file, const char* name, const std::vector<ScalingResult>& scaling, bool last)
+{
+	fprintf(file, "  \"%s\": [\n", name);
+	for (size_t i = 0; i < scaling.size(); i++)
+	{
+		// speedup against the same mode on one thread
+		size_t first = i;
+		while (first > 0 && scaling[first - 1].mode == scaling[i].mode)
+			first--;
+		fprintf(file, "    { \"mode\": \"%s\", \"threads\": %d, \"p50\": %.3f, \"cpuPerFrameMilliseconds\": %.3f, \"speedup\": %.2f }%s\n",
+			scaling[i].mode.c_str(), scaling[i].threads, scaling[i].drawMilliseconds, scaling[i].cpuMilliseconds, scaling[first].drawMilliseconds / scaling[i].drawMilliseconds,
+			i + 1 == scaling.size() ? "" : ",");
+	}
+	fprintf(file, "  ]%s\n", last ? "" : ",");
+}
+
+static void WritePercentiles(FILE* file, const char* name, std::vector<double> samples, bool last)
+{
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) { return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))]; };
+	fprintf(file, "        \"%s\": { \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+		name, percentile(0.5), percentile(0.9), percentile(0.99), samples.back(), last ? "" : ",");
+}
+
+static void WriteResult(FILE* file, const TypeResult& result, bool last)
+{
+	fprintf(file, "    {\n      \"type\": \"%s\",\n", result.type);
+	if (!result.error.empty())
+	{
+		fprintf(file, "      \"error\": \"%s\"\n    }%s\n", result.error.c_str(), last ? "" : ",");
+		return;
+	}
+
+	fprintf(file, "      \"frames\": %d,\n", result.frames);
+	fprintf(file, "      \"fps\": %.2f,\n", result.frames / result.seconds);
+	fprintf(file, "      \"cpuSeconds\": %.3f,\n", result.cpuSeconds);
+	fprintf(file, "      \"cpuPerFrameMilliseconds\": %.3f,\n", result.cpuSeconds * 1000.0 / result.frames);
+	fprintf(file, "      \"peakMemoryKB\": %u,\n", (unsigned int)(result.peakMemoryBytes >> 10));
+	fprintf(file, "      \"milliseconds\": {\n");
+
+	// only the stages this type goes through
+	std::vector<int> stages;
+	for (int stage = 0; stage < (int)Stage::Count; stage++)
+	{
+		if (*std::max_element(result.stageMilliseconds[stage].begin(), result.stageMilliseconds[stage].end()) > 0.0)
+			stages.push_back(stage);
+	}
+	WritePercentiles(file, "frame", result.frameMilliseconds, stages.empty());
+	for (size_t i = 0; i < stages.size(); i++)
+		WritePercentiles(file, StageNames[stages[i]], result.stageMilliseconds[stages[i]], i + 1 == stages.size());
+	fprintf(file, "      }\n    }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char* argv[])
+{
+	int frameCount = argc > 1 ? atoi(argv[1]) : 0;
+	if (frameCount <= 0)
+		frameCount = DefaultFrameCount;
+	FILE* file = argc > 2 ? fopen(argv[2], "w") : stdout;
+	if (!file)
+	{
+		fprintf(stderr, "Couldn't open %s\n", argv[2]);
+		return 1;
+	}
+
+	// in RealSenseCamType order
+	ThreadPool threadPool;
+	threadPool.Start(0, false);
+	std::vector<TypeResult> results;
+	results.push_back(RunKernelType("IR", frameCount, threadPool));
+	results.push_back(RunKernelType("Color", frameCount, threadPool));
+	for (const char* type : { "ColorizedDepth", "ColorAlignedDepth" })
+	{
+		TypeResult result;
+		result.type = type;
+		result.error = "needs librealsense";
+		results.push_back(result);
+	}
+	results.push_back(RunPointCloudType("PointCloud", frameCount, threadPool));
+	results.push_back(RunPointCloudType("PointCloudIR", frameCount, threadPool));
+	results.push_back(RunPointCloudType("PointCloudColor", frameCount, threadPool));
+	results.push_back(RunKernelType("ColorYuy2", frameCount, threadPool));
+	threadPool.Stop();
+
+	std::vector<ScalingResult> kernelScaling = RunKernelScaling(std::max(1, frameCount / 4));
+	std::vector<ScalingResult> rendererScaling = RunCpuRendererScaling(std::max(1, frameCount / 4));
+	std::vector<QualityResult> levelOfDetail = RunLevelOfDetail(std::max(1, frameCount / 4));
+	std::vector<QualityResult> splatting = RunSplatting(std::max(1, frameCount / 4));
+	std::vector<QualityResult> mesh = RunMesh(std::max(1, frameCount / 4));
+	std::vector<RingResult> ring = RunSharedFrameRing(std::max(1, frameCount / 4));
+
+	fprintf(file, "{\n  \"warmUpFrames\": %d,\n  \"cores\": %u,\n  \"kernels\": \"%s\",\n  \"results\": [\n",
+		WarmUpFrames, std::thread::hardware_concurrency(), PixelKernels::GetVariantName(PixelKernels::GetBestVariant()));
+	for (size_t i = 0; i < results.size(); i++)
+		WriteResult(file, results[i], i + 1 == results.size());
+	fprintf(file, "  ],\n");
+	WriteScaling(file, "kernelScaling", kernelScaling, false);
+	WriteScaling(file, "cpuRendererScaling", rendererScaling, false);
+	WriteQuality(file, "levelOfDetail", levelOfDetail, false);
+	WriteQuality(file, "splatting", splatting, false);
+	WriteQuality(file, "mesh", mesh, false);
+	WriteRing(file, ring);
+	fprintf(file, "}\n");
+	if (file != stdout)
+		fclose(file);
+	return 0;
+}
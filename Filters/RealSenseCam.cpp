@@ -1,6 +1,12 @@
 #include "RealSenseCam.h"
 
+#include <librealsense2/rsutil.h>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <future>
+#include <string>
+#include <vector>
 
 // rather than add to library list in program settings, just add the library dependencies here
 #pragma comment(lib, "d3d11")           // direct3D library
@@ -17,97 +23,506 @@ RealSenseCam::~RealSenseCam()
 
 HRESULT RealSenseCam::Init(RealSenseCamType type)
 {
-	m_Type = type;
-	// clip out all points more distant than this in meters
-	float clippingDistanceZ = 1.3f;
+	return Init(type, GetSharedContext(), std::string());
+}
 
-	// TODO work out how to get this logging into Debug Output console in VS2019
-	rs2::log_to_console(RS2_LOG_SEVERITY_DEBUG);
-	rs2::log_to_file(rs2_log_severity::RS2_LOG_SEVERITY_ALL, "librealsense.log");
-	rs2::log(RS2_LOG_SEVERITY_DEBUG, "Starting Init()");
+/// <summary>
+/// one context for the whole process, so the devices are only enumerated once however often the camera is
+/// (re)opened; the context follows devices coming and going by itself.
+/// Never destroyed, librealsense may already be shut down by the time the DLL's statics are
+/// </summary>
+const rs2::context& RealSenseCam::GetSharedContext()
+{
+	static const rs2::context* context = new rs2::context();
+	return *context;
+}
+
+/// <summary>
+/// push the region of interest and depth range down to the depth sensor as far as it goes. The range goes to the
+/// sensors with min and max distance options (L500), or into the depth table's clamp on a D400 that is already in
+/// advanced mode (turning it on resets the device, so that's left to the user); either way the sensor zeroes the depths
+/// out of range. No sensor crops its frames, but the D400s can at least meter auto exposure on the region.
+/// </summary>
+/// <param name="region">in depth pixels (inclusive), NULL for the whole frame</param>
+/// <returns>true if the sensor clamps the depth range itself, otherwise it's up to the host</returns>
+bool RealSenseCam::ConfigureDepthSensor(const rs2::device& device, const rs2::region_of_interest* region, float minDistance, float maxDistance)
+{
+	bool clamped = false;
+	m_SavedDepthSensor = DepthSensorSettings();
+	m_SavedDepthSensor.device = device;
+	try
+	{
+		rs2::depth_sensor depthSensor = device.first<rs2::depth_sensor>();
+		if (depthSensor.supports(RS2_OPTION_MIN_DISTANCE) && depthSensor.supports(RS2_OPTION_MAX_DISTANCE))
+		{
+			m_SavedDepthSensor.minDistance = depthSensor.get_option(RS2_OPTION_MIN_DISTANCE);
+			m_SavedDepthSensor.maxDistance = depthSensor.get_option(RS2_OPTION_MAX_DISTANCE);
+			m_SavedDepthSensor.distances = true;
+			depthSensor.set_option(RS2_OPTION_MIN_DISTANCE, minDistance);
+			depthSensor.set_option(RS2_OPTION_MAX_DISTANCE, maxDistance);
+			clamped = true;
+		}
+		else if (device.is<rs400::advanced_mode>() && device.as<rs400::advanced_mode>().is_enabled())
+		{
+			// the clamp is in depth units, which the table has in micrometers
+			rs400::advanced_mode advanced = device.as<rs400::advanced_mode>();
+			STDepthTableControl depthTable = advanced.get_depth_table();
+			m_SavedDepthSensor.table = depthTable;
+			m_SavedDepthSensor.depthTable = true;
+			float unitsPerMeter = 1e6f / depthTable.depthUnits;
+			depthTable.depthClampMin = (int32_t)(minDistance * unitsPerMeter);
+			depthTable.depthClampMax = (int32_t)std::min(maxDistance * unitsPerMeter + 1.0f, 65535.0f);
+			advanced.set_depth_table(depthTable);
+			clamped = true;
+		}
 
-	// set up the Realsense config object for the desired device/streams pipeline
-	rs2::config Cfg;
+		if (region && depthSensor.is<rs2::roi_sensor>())
+		{
+			rs2::roi_sensor roiSensor = depthSensor.as<rs2::roi_sensor>();
+			m_SavedDepthSensor.roi = roiSensor.get_region_of_interest();
+			m_SavedDepthSensor.region = true;
+			roiSensor.set_region_of_interest(*region);
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		// the host does whatever the sensor didn't
+		OutputDebugStringA("Depth sensor options: ");
+		OutputDebugStringA(ex.what());
+		OutputDebugStringA("\n");
+	}
+	return clamped;
+}
+
+void RealSenseCam::RestoreDepthSensor()
+{
+	DepthSensorSettings saved = m_SavedDepthSensor;
+	m_SavedDepthSensor = DepthSensorSettings();
+	if (!saved.device)
+		return;
+
+	try
+	{
+		rs2::depth_sensor depthSensor = saved.device.first<rs2::depth_sensor>();
+		if (saved.distances)
+		{
+			depthSensor.set_option(RS2_OPTION_MIN_DISTANCE, saved.minDistance);
+			depthSensor.set_option(RS2_OPTION_MAX_DISTANCE, saved.maxDistance);
+		}
+		if (saved.depthTable)
+			saved.device.as<rs400::advanced_mode>().set_depth_table(saved.table);
+		if (saved.region)
+			depthSensor.as<rs2::roi_sensor>().set_region_of_interest(saved.roi);
+	}
+	catch (const std::exception& ex)
+	{
+		// unplugged, most likely, and then there's nothing left to restore
+		OutputDebugStringA("Depth sensor options: ");
+		OutputDebugStringA(ex.what());
+		OutputDebugStringA("\n");
+	}
+}
+
+template <RealSenseCamType Type>
+rs2::frame RealSenseCam::GetTexture(const rs2::frameset& frames)
+{
+	return rs2::frame();
+}
 
+template <>
+rs2::frame RealSenseCam::GetTexture<RealSenseCamType::PointCloudIR>(const rs2::frameset& frames)
+{
+	return frames.get_infrared_frame();
+}
+
+template <>
+rs2::frame RealSenseCam::GetTexture<RealSenseCamType::PointCloudColor>(const rs2::frameset& frames)
+{
+	return frames.get_color_frame();
+}
+
+/// <summary>
+/// the point cloud types: calculate the points, draw them and read the frame back
+/// </summary>
+template <RealSenseCamType Type>
+void RealSenseCam::ProcessFrames(rs2::frameset& frames, BYTE* frameBuffer, int frameSize, LARGE_INTEGER& outputStart)
+{
+	PointCloudFrame pointCloud = CalculatePointCloud(frames);
+	// Upload the vertices to Direct3D
+	// Draw the pointcloud and copy to the framebuffer
+	DrawPointCloud(pointCloud);
+	QueryPerformanceCounter(&outputStart);
+	m_Renderer->ReadFrame(frameBuffer, frameSize);
+	m_HaveDrawnFrame = true;
+}
+
+template <>
+void RealSenseCam::ProcessFrames<RealSenseCamType::IR>(rs2::frameset& frames, BYTE* frameBuffer, int frameSize, LARGE_INTEGER& outputStart)
+{
+	// IR is 1 byte per pixel so we need to copy to R, G and B
+	// might as well invert while we're there
+	auto ir = frames.get_infrared_frame();
+	invert8bppToRGB(frameBuffer, frameSize, ir);
+}
+
+template <>
+void RealSenseCam::ProcessFrames<RealSenseCamType::Color>(rs2::frameset& frames, BYTE* frameBuffer, int frameSize, LARGE_INTEGER& outputStart)
+{
+	auto color = frames.get_color_frame();
+	invert24bppToRGB(frameBuffer, frameSize, color);
+}
+
+template <>
+void RealSenseCam::ProcessFrames<RealSenseCamType::ColorizedDepth>(rs2::frameset& frames, BYTE* frameBuffer, int frameSize, LARGE_INTEGER& outputStart)
+{
+	auto colorized_depth = m_Colorizer.colorize(frames.get_depth_frame());
+	invert24bppToRGB(frameBuffer, frameSize, colorized_depth);
+}
+
+template <>
+void RealSenseCam::ProcessFrames<RealSenseCamType::ColorAlignedDepth>(rs2::frameset& frames, BYTE* frameBuffer, int frameSize, LARGE_INTEGER& outputStart)
+{
+	// align the color frame to the depth frame (so we end up with the smaller depth frame with color mapped onto it)
+	// TODO color frames will only be reenabled after I rebuild realsense with OpenMP set to FALSE, since it results
+	// in 100% CPU utilisation when handling color frames by the looks
+	frames = m_AlignToDepth.process(frames);
+	auto color = frames.get_color_frame();
+	invert24bppToRGB(frameBuffer, frameSize, color);
+}
+
+template <>
+void RealSenseCam::ProcessFrames<RealSenseCamType::ColorYuy2>(rs2::frameset& frames, BYTE* frameBuffer, int frameSize, LARGE_INTEGER& outputStart)
+{
+	auto color = frames.get_color_frame();
+	mirrorYuy2(frameBuffer, frameSize, color);
+}
+
+template <RealSenseCamType Type>
+void RealSenseCam::SelectPipeline()
+{
+	m_ProcessFrames = &RealSenseCam::ProcessFrames<Type>;
+	m_GetTexture = &RealSenseCam::GetTexture<Type>;
+}
+
+/// <summary>
+/// settle the streams for a type: the sensor streams to ask for and the output frame size, format and rate.
+/// Cheap (no device is touched), so the filter can offer its media type long before the camera is opened
+/// </summary>
+/// <param name="type">which type of stream to make</param>
+void RealSenseCam::Configure(RealSenseCamType type)
+{
+	// output frames per sensor frame for point cloud types, the extra frames redraw the last point cloud from the
+	// moving camera (2 for 60 fps output from the 30 fps sensor, 1 to just pass the sensor rate through)
+	int outputRateMultiplier = 2;
+
+	m_Type = type;
+	m_Config = rs2::config();
+	m_TextureFormat = TextureFormat::None;
+	m_OutputBytesPerPixel = 3;
 	switch (m_Type)
 	{
 	case RealSenseCamType::IR:
+		SelectPipeline<RealSenseCamType::IR>();
 		m_InputTexWidth = 320;
 		m_InputTexHeight = 240;
 		m_OutputWidth = 320;
 		m_OutputHeight = 240;
-		Cfg.enable_stream(RS2_STREAM_INFRARED, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_Y8, 30);
+		m_Config.enable_stream(RS2_STREAM_INFRARED, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_Y8, 30);
 		break;
 	case RealSenseCamType::Color:
+		SelectPipeline<RealSenseCamType::Color>();
 		m_InputTexWidth = 640;
 		m_InputTexHeight = 480;
 		m_OutputWidth = 640;
 		m_OutputHeight = 480;
 		// remember color streams go mental if OpenMP is enabled in RS2 build
-		Cfg.enable_stream(RS2_STREAM_COLOR, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_RGB8, 30);
+		m_Config.enable_stream(RS2_STREAM_COLOR, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_RGB8, 30);
+		break;
+	case RealSenseCamType::ColorYuy2:
+		SelectPipeline<RealSenseCamType::ColorYuy2>();
+		m_InputTexWidth = 640;
+		m_InputTexHeight = 480;
+		m_OutputWidth = 640;
+		m_OutputHeight = 480;
+		m_OutputBytesPerPixel = 2;
+		// straight from the sensor, so librealsense has nothing to convert
+		m_Config.enable_stream(RS2_STREAM_COLOR, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_YUYV, 30);
 		break;
 	case RealSenseCamType::ColorizedDepth:
+		SelectPipeline<RealSenseCamType::ColorizedDepth>();
 		m_InputDepthWidth = 320;
 		m_InputDepthHeight = 240;
 		m_OutputWidth = 320;
 		m_OutputHeight = 240;
-		Cfg.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
+		m_Config.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
 		break;
 	case RealSenseCamType::ColorAlignedDepth:
+		SelectPipeline<RealSenseCamType::ColorAlignedDepth>();
 		m_InputDepthWidth = 320;
 		m_InputDepthHeight = 240;
 		m_InputTexWidth = 640;
 		m_InputTexHeight = 480;
 		m_OutputWidth = 320;
 		m_OutputHeight = 240;
-		Cfg.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
+		m_Config.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
 		// remember color streams cause the CPU to go mental if OpenMP is enabled in RS2 build
-		Cfg.enable_stream(RS2_STREAM_COLOR, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_ANY, 30);
+		m_Config.enable_stream(RS2_STREAM_COLOR, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_ANY, 30);
 		break;
 	case RealSenseCamType::PointCloud:
+		SelectPipeline<RealSenseCamType::PointCloud>();
 		m_InputDepthWidth = 320;
 		m_InputDepthHeight = 240;
 		m_InputTexWidth = 320;
 		m_InputTexHeight = 240;
 		m_OutputWidth = 640;
 		m_OutputHeight = 480;
-		Cfg.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
-		m_Renderer = new PointCloudRenderer();
-		m_Renderer->Init(m_InputDepthWidth, m_InputDepthHeight, m_InputTexWidth, m_InputTexHeight, m_OutputWidth, m_OutputHeight, clippingDistanceZ);
+		m_Config.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
 		break;
 	case RealSenseCamType::PointCloudIR:
+		SelectPipeline<RealSenseCamType::PointCloudIR>();
+		m_TextureFormat = TextureFormat::Y8;
 		m_InputDepthWidth = 320;
 		m_InputDepthHeight = 240;
 		m_InputTexWidth = 320;
 		m_InputTexHeight = 240;
 		m_OutputWidth = 640;
 		m_OutputHeight = 480;
-		Cfg.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
-		Cfg.enable_stream(RS2_STREAM_INFRARED, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_Y8, 30);
+		m_Config.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
+		m_Config.enable_stream(RS2_STREAM_INFRARED, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_Y8, 30);
 		// No need for AlignTo - IR is automatically aligned with depth
-		m_Renderer = new PointCloudRenderer();
-		m_Renderer->Init(m_InputDepthWidth, m_InputDepthHeight, m_InputTexWidth, m_InputTexHeight, m_OutputWidth, m_OutputHeight, clippingDistanceZ);
 		break;
 	case RealSenseCamType::PointCloudColor:
+		SelectPipeline<RealSenseCamType::PointCloudColor>();
+		m_TextureFormat = TextureFormat::Rgb8;
 		m_InputDepthWidth = 320;
 		m_InputDepthHeight = 240;
 		m_InputTexWidth = 640;
 		m_InputTexHeight = 480;
 		m_OutputWidth = 640;
 		m_OutputHeight = 480;
-		Cfg.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
-		Cfg.enable_stream(RS2_STREAM_COLOR, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_RGBA8, 30);  // remember color streams go mental if OpenMP is enabled in RS2 build
-		m_Renderer = new PointCloudRenderer();
-		m_Renderer->Init(m_InputDepthWidth, m_InputDepthHeight, m_InputTexWidth, m_InputTexHeight, m_OutputWidth, m_OutputHeight, clippingDistanceZ);
+		m_Config.enable_stream(RS2_STREAM_DEPTH, m_InputDepthWidth, m_InputDepthHeight, RS2_FORMAT_Z16, 30);
+		m_Config.enable_stream(RS2_STREAM_COLOR, m_InputTexWidth, m_InputTexHeight, RS2_FORMAT_RGB8, 30);  // remember color streams go mental if OpenMP is enabled in RS2 build
 		break;
 	default:
 		assert(false);
 	}
 
+	// only the point cloud types have a camera that moves between sensor frames
+	m_OutputRateMultiplier = IsPointCloudType() ? outputRateMultiplier : 1;
+
+	// and only they can render at whatever size the pin was connected at
+	if (IsPointCloudType() && m_RequestedOutputWidth > 0)
+	{
+		m_OutputWidth = m_RequestedOutputWidth;
+		m_OutputHeight = m_RequestedOutputHeight;
+	}
+}
+
+/// <summary>
+/// change the output size of a point cloud type. Before Init it's just remembered, once streaming the threads that use
+/// the renderer are stopped (leaving the realsense pipeline streaming), the renderer recreates its output sized
+/// resources and the threads start again. Much quicker than UnInit/Init, which stops the sensor and rebuilds everything
+/// </summary>
+/// <param name="width">output frame width</param>
+/// <param name="height">output frame height</param>
+/// <returns>E_INVALIDARG for a different size of a type that passes the sensor frames through</returns>
+HRESULT RealSenseCam::SetOutputSize(int width, int height)
+{
+	if (width == m_OutputWidth && height == m_OutputHeight)
+		return S_OK;
+	if (!IsPointCloudType())
+		return E_INVALIDARG;
+
+	m_RequestedOutputWidth = width;
+	m_RequestedOutputHeight = height;
+	m_OutputWidth = width;
+	m_OutputHeight = height;
+
+	// not streaming (yet), Init will pick the size up
+	if (!m_Renderer)
+		return S_OK;
+
+	// stop everything that draws with the renderer, but not the pipe: a producer waiting on it gets the next sensor frame
+	bool producing = m_ProducerRunning;
+	bool pipelined = m_Pipelined;
+	m_ProducerRunning = false;
+	StopPipeline();
+	if (m_ProducerThread.joinable())
+		m_ProducerThread.join();
+
+	// the output sized buffers (the CPU renderer's targets, the pipelined RGBA frames) grow from the frame arena if
+	// they have to, which is allowed while nothing is streaming through it
+	m_FrameArena.Unseal();
+	HRESULT hr = m_Renderer->Resize(width, height);
+
+	m_Pipelined = pipelined;
+	if (m_Pipelined)
+		StartPipeline();
+	m_FrameArena.Seal();
+	if (producing)
+		StartProducer();
+	return hr;
+}
+
+HRESULT RealSenseCam::Init(RealSenseCamType type, const rs2::context& context, const std::string& serialNumber)
+{
+	// the filter tries again every time its graph runs, so a failed attempt mustn't leave anything behind
+	HRESULT hr;
+	try
+	{
+		hr = StartCamera(type, context, serialNumber);
+	}
+	catch (const std::exception& ex)
+	{
+		OutputDebugStringA("Couldn't start the camera: ");
+		OutputDebugStringA(ex.what());
+		OutputDebugStringA("\n");
+		hr = E_FAIL;
+	}
+	if (FAILED(hr))
+		UnInit();
+	return hr;
+}
+
+/// <summary>
+/// Init's work: open the pipeline and whatever the type renders with. Can throw (rs2::error), and leaves things
+/// half started when it fails, Init cleans up after it
+/// </summary>
+HRESULT RealSenseCam::StartCamera(RealSenseCamType type, const rs2::context& context, const std::string& serialNumber)
+{
+	Configure(type);
+	m_Pipe = rs2::pipeline(context);
+	// clip out all points more distant than this in meters
+	float clippingDistanceZ = 1.3f;
+	// and nearer than this (0 for none). The range is clamped by the sensor where it can, otherwise as the depth frames are
+	// cropped (the renderer clips the far end anyway, so a whole frame is only copied for the near end)
+	float minDistanceZ = 0.0f;
+	// point cloud types: only deproject and draw this part of the depth frame, left, top, right and bottom as fractions
+	// of its size (the whole frame by default). It's cropped out before the points are calculated, so all the per-point
+	// work after that scales with its area
+	float depthRegion[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+	// threads used by the per-frame kernels (including the streaming thread), 0 for one per core
+	int threadCount = 0;
+	// pin each worker to its own core (off, since the filter lives in whatever app opened the camera and shares its cores)
+	bool pinThreads = false;
+	// one block for the intermediate buffers: a few MB of input sized ones, plus for the point cloud types the output sized
+	// pipelined frames (and the CPU renderer's colour and depth buffers), which run to 100 MB or so at 4K
+	size_t frameArenaBytes = (size_t)4 << 20;
+	if (IsPointCloudType())
+		frameArenaBytes += (size_t)(4 * RenderBufferCount + 8) * m_OutputWidth * m_OutputHeight;
+	// only the first process to open the camera streams from it, any others show the frames it shares. Off by default:
+	// a lone app would pay an extra copy of every frame (and the ring's latency), and the producer keeps the camera
+	// streaming until the filter is destroyed so that other processes don't lose their frames when its graph stops
+	bool shareFrames = false;
+	// overlap acquisition, rendering and conversion of successive frames for point cloud types
+	// (higher throughput at the cost of up to two frames of extra latency)
+	bool pipelined = true;
+	// point cloud types: skip recalculating the points while the depth frame is static (block averages within
+	// depthChangeThreshold depth units), and just redraw while the IR/color frame is too (within textureChangeThreshold levels)
+	bool dirtyFrameDetection = true;
+	int depthChangeThreshold = 8;
+	int textureChangeThreshold = 6;
+	// optional point cloud rendering modes
+	PointCloudRendererOptions rendererOptions;
+	rendererOptions.levelOfDetail = true;		// thin out points that would project to less than a pixel apart
+	rendererOptions.minPointFootprint = 1.0f;
+	rendererOptions.splatting = false;			// draw points as depth sized discs rather than single pixels
+	rendererOptions.splatSize = 1.0f;
+	rendererOptions.mesh = false;				// join the depth grid up into triangles for solid surfaces
+	rendererOptions.meshMaxDepthJump = 0.05f;
+	rendererOptions.supersample = 1;			// anti-aliasing: render 2x2 (etc.) pixels per output pixel and filter them down
+	rendererOptions.downsampleFilter = DownsampleFilter::Box;
+	rendererOptions.msaaSamples = 1;			// or multisample on the GPU (supersampled on the CPU renderer)
+	rendererOptions.orientation = OutputOrientation::Upright;	// or Mirrored like the IR and color types, Flipped, Rotated180
+	rendererOptions.cameraMode = CameraMode::Drift;	// or Static (frames are only redrawn when the camera moves), Path, User
+	// (the CPU renderer's colour and depth buffers are render sized)
+	if (IsPointCloudType() && rendererOptions.supersample > 1)
+		frameArenaBytes += (size_t)8 * (rendererOptions.supersample * rendererOptions.supersample - 1) * m_OutputWidth * m_OutputHeight;
+	// render the point cloud in software rather than with Direct3D (no GPU, or as a reference for the GPU output)
+	bool cpuRenderer = false;
+
+	// TODO work out how to get this logging into Debug Output console in VS2019
+	rs2::log_to_console(RS2_LOG_SEVERITY_DEBUG);
+	rs2::log_to_file(rs2_log_severity::RS2_LOG_SEVERITY_ALL, "librealsense.log");
+	rs2::log(RS2_LOG_SEVERITY_DEBUG, "Starting Init()");
+
+	// the Realsense config object for the desired streams (from Configure), and device if there is one
+	if (!serialNumber.empty())
+		m_Config.enable_device(serialNumber);
+
+	// one producer per camera type across all processes, everyone else is a reader
+	// (a particular device, like the benchmark's synthetic one, is private to its caller)
+	m_ShareFrames = shareFrames && serialNumber.empty();
+	if (m_ShareFrames)
+	{
+		m_SharedFramesName = "vcam-realsense-" + std::to_string((int)m_Type);
+		if (!m_SharedFrames.TryLockProducer(m_SharedFramesName.c_str()))
+		{
+			OutputDebugStringA("Showing frames shared by another process\n");
+			return S_OK;
+		}
+	}
+
+	m_ThreadPool.Start(threadCount, pinThreads);
+	m_FrameArena.Release();
+	m_FrameArena.Reserve(frameArenaBytes);
+	m_RenderBufferSize = 0;
+
+	m_HaveDrawnFrame = false;
+	m_NextOutputTime = std::chrono::steady_clock::time_point();
+	m_SynthesizedFrameCount = 0;
+	m_SynthesizedFrameTicks = 0;
+
+	// block sums of the depth and texture frames for dirty frame detection
+	m_DirtyFrameDetection = dirtyFrameDetection && IsPointCloudType();
+	m_DepthChangeThreshold = depthChangeThreshold;
+	m_TextureChangeThreshold = textureChangeThreshold;
+	m_DirtyFrameStats = DirtyFrameStats();
+	m_CalculateTicks = m_SavedCalculateTicks = m_DrawTicks = m_SavedDrawTicks = 0;
+	m_CalculateCount = m_DrawCount = 0;
+	for (auto& ticks : m_StageTicks)
+		ticks = 0;
+	// the depth frames are cropped to the region of interest before anything else sees them
+	int depthLeft = (int)(depthRegion[0] * m_InputDepthWidth + 0.5f);
+	int depthTop = (int)(depthRegion[1] * m_InputDepthHeight + 0.5f);
+	m_DepthCrop.SetRegion(m_InputDepthWidth, m_InputDepthHeight, depthLeft, depthTop, (int)(depthRegion[2] * m_InputDepthWidth + 0.5f), (int)(depthRegion[3] * m_InputDepthHeight + 0.5f));
+	m_DepthCrop.SetDepthRange(0, 0);
+	int depthWidth = m_DepthCrop.GetWidth();
+	int depthHeight = m_DepthCrop.GetHeight();
+	rs2::region_of_interest depthRoi = { depthLeft, depthTop, depthLeft + depthWidth - 1, depthTop + depthHeight - 1 };
+	bool croppedDepth = depthWidth < m_InputDepthWidth || depthHeight < m_InputDepthHeight;
+
+	if (m_DirtyFrameDetection)
+	{
+		m_DepthSignature.Init(depthWidth, depthHeight, 2, 2, &m_FrameArena);
+		if (m_Type == RealSenseCamType::PointCloudIR)
+			m_TextureSignature.Init(m_InputTexWidth, m_InputTexHeight, 1, 1, &m_FrameArena);
+		else if (m_Type == RealSenseCamType::PointCloudColor)
+			m_TextureSignature.Init(m_InputTexWidth, m_InputTexHeight, 3, 1, &m_FrameArena);
+	}
+
+	// warm the renderer up (device, shaders and buffers) on another thread while the pipeline starts,
+	// neither needs the other until the depth intrinsics are set. (The future waits for it on the way out too)
+	std::future<void> rendererReady;
+	if (IsPointCloudType())
+	{
+		// one left by an Init that was never UnInit
+		if (m_Renderer)
+		{
+			m_Renderer->UnInit();
+			delete m_Renderer;
+		}
+		m_Renderer = cpuRenderer ? (PointCloudRendererBase*)new CpuPointCloudRenderer() : new PointCloudRenderer();
+		rendererReady = std::async(std::launch::async, [=]()
+			{
+				m_Renderer->Init(depthWidth, depthHeight, m_InputTexWidth, m_InputTexHeight, m_TextureFormat, m_OutputWidth, m_OutputHeight, clippingDistanceZ, rendererOptions, &m_ThreadPool, &m_FrameArena);
+			});
+	}
+
 	// now try to resolve the config and start!
-	if (Cfg.can_resolve(((std::shared_ptr<rs2_pipeline>)m_Pipe)))
+	if (m_Config.can_resolve(((std::shared_ptr<rs2_pipeline>)m_Pipe)))
 		{
-		m_Pipe.start(Cfg);
+		m_Pipe.start(m_Config);
 
 		// Debug logging to work out which devices/streams we got in our profile
 		OutputDebugStringA("Pipeline Profile: \n");
@@ -132,19 +547,72 @@ HRESULT RealSenseCam::Init(RealSenseCamType type)
 			OutputDebugStringA("\n");
 		}
 
+		// the renderer estimates point spacing from the depth intrinsics, and rebuilds the points along each
+		// depth pixel's ray (deprojected at unit depth, as rs2::pointcloud does, distortion and all) of the cropped frames
+		if (m_Renderer)
+		{
+			rendererReady.get();
+			rs2::video_stream_profile depthProfile = activeProfile.get_stream(RS2_STREAM_DEPTH);
+			rs2_intrinsics depthIntrinsics = m_DepthCrop.CropIntrinsics(depthProfile.get_intrinsics());
+			m_Renderer->SetDepthFocalLength(depthIntrinsics.fx);
+
+			std::vector<float> depthRays(2 * depthWidth * depthHeight);
+			for (int row = 0; row < depthHeight; row++)
+			{
+				for (int col = 0; col < depthWidth; col++)
+				{
+					float pixel[2] = { (float)col, (float)row };
+					float point[3];
+					rs2_deproject_pixel_to_point(point, &depthIntrinsics, pixel, 1.0f);
+					depthRays[2 * (row * depthWidth + col)] = point[0];
+					depthRays[2 * (row * depthWidth + col) + 1] = point[1];
+				}
+			}
+			m_Renderer->SetDepthRays(depthRays.data());
+
+			// and the depth range is clamped by the sensor, or by the crop in depth units. Only if there's a region or a
+			// near clamp: the sensor settings outlast the process, so they're left alone when there's nothing to set
+			bool cropOrClamp = croppedDepth || minDistanceZ > 0.0f;
+			if (cropOrClamp && !ConfigureDepthSensor(activeProfile.get_device(), croppedDepth ? &depthRoi : NULL, minDistanceZ, clippingDistanceZ))
+			{
+				float unitsPerMeter = 1.0f / activeProfile.get_device().first<rs2::depth_sensor>().get_depth_scale();
+				m_DepthCrop.SetDepthRange((uint16_t)(minDistanceZ * unitsPerMeter), (uint16_t)std::min(clippingDistanceZ * unitsPerMeter + 1.0f, 65535.0f));
+			}
+		}
+
+		m_Pipelined = pipelined && m_Renderer != NULL;
+		if (m_Pipelined)
+			StartPipeline();
+
+		// from here on streaming shouldn't need any more buffers
+		m_FrameArena.Seal();
+
+		if (m_ShareFrames)
+			StartProducer();
+
 		return S_OK;
 	}
 
+	// no device for the config: leave the camera for another process to try
 	return E_FAIL;
 }
 
 void RealSenseCam::UnInit()
 {
+	// leave the sensor as we found it, while it still streams (the exposure region can't be set on a stopped sensor, and
+	// stopping the producer stops the pipe)
+	RestoreDepthSensor();
+
+	// the producer and stage threads use the renderer and the pipe, so they go first
+	StopProducer();
+	StopPipeline();
+
 	// uninit the point cloud renderer if it was initialized
 	if (m_Renderer)
 	{
 		m_Renderer->UnInit();
 		delete m_Renderer;
+		m_Renderer = NULL;
 	}
 
 	// stop the realsense pipeline
@@ -156,106 +624,559 @@ void RealSenseCam::UnInit()
 	{
 		// well, we tried. no need to throw an exception on shutdown
 	}
+
+	m_ThreadPool.Stop();
+
+	char buffer[16];
+	OutputDebugStringA("Frame arena: ");
+	OutputDebugStringA(_itoa(m_FrameArena.GetAllocationCount(), buffer, 10));
+	OutputDebugStringA(" buffers, ");
+	OutputDebugStringA(_itoa((int)(m_FrameArena.GetBytesAllocated() >> 10), buffer, 10));
+	OutputDebugStringA(" KB, ");
+	OutputDebugStringA(_itoa(m_FrameArena.GetSteadyStateAllocationCount(), buffer, 10));
+	OutputDebugStringA(" steady-state allocations\n");
+	m_FrameArena.Release();
+
+	if (m_DirtyFrameDetection)
+	{
+		DirtyFrameStats stats = GetDirtyFrameStats();
+		OutputDebugStringA("Dirty frame detection: ");
+		OutputDebugStringA(_itoa(stats.frames, buffer, 10));
+		OutputDebugStringA(" frames, ");
+		OutputDebugStringA(_itoa(stats.pointsReused, buffer, 10));
+		OutputDebugStringA(" reused points, ");
+		OutputDebugStringA(_itoa(stats.framesReused, buffer, 10));
+		OutputDebugStringA(" redrawn, ");
+		OutputDebugStringA(_itoa((int)stats.savedMilliseconds, buffer, 10));
+		OutputDebugStringA(" ms saved\n");
+	}
+	m_LastPointCloud = PointCloudFrame();
+
+	if (m_SynthesizedFrameCount > 0)
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		OutputDebugStringA("Synthesized frames: ");
+		OutputDebugStringA(_itoa(m_SynthesizedFrameCount, buffer, 10));
+		OutputDebugStringA(", ");
+		OutputDebugStringA(_itoa((int)(m_SynthesizedFrameTicks * 1000000 / frequency.QuadPart / m_SynthesizedFrameCount), buffer, 10));
+		OutputDebugStringA(" us each\n");
+	}
+
+	if (m_SharedFrames.GetReadCount() > 0)
+	{
+		OutputDebugStringA("Shared frames: ");
+		OutputDebugStringA(_itoa(m_SharedFrames.GetReadCount(), buffer, 10));
+		OutputDebugStringA(" read, ");
+		OutputDebugStringA(_itoa((int)m_SharedFrames.GetAverageLatencyMicroseconds(), buffer, 10));
+		OutputDebugStringA(" us average latency, ");
+		OutputDebugStringA(_itoa((int)m_SharedFrames.GetMaxLatencyMicroseconds(), buffer, 10));
+		OutputDebugStringA(" us max\n");
+	}
+	m_SharedFrames.Close();
+	m_SharedFrames.UnlockProducer();
+	m_SharedSequence = 0;
 }
 
-void RealSenseCam::GetCamFrame(BYTE* frameBuffer, int frameSize)
+bool RealSenseCam::GetCamFrame(BYTE* frameBuffer, int frameSize)
 {
 	// just make sure that we've correctly set the output frame size
-	assert(frameSize == m_OutputWidth * m_OutputHeight * 3);
+	assert(frameSize == m_OutputWidth * m_OutputHeight * m_OutputBytesPerPixel);
 
-	// Block program until frames arrive if we need to, but take the most recent and discard older frames
-	rs2::frameset frames = m_Pipe.wait_for_frames();
+	if (!m_ShareFrames)
+		return RenderCamFrame(frameBuffer, frameSize);
 
-	switch (m_Type)
+	// our own producer has given up, nobody else can take over from it while we hold the lock
+	if (m_SharedFrames.IsProducer() && !m_ProducerRunning)
 	{
-	case RealSenseCamType::IR:
+		ClearFrame(frameBuffer, frameSize);
+		return false;
+	}
+
+	// the producer process (this one included) renders into the ring, so every process reads its frames from there
+	if (m_SharedFrames.IsOpen() || m_SharedFrames.Open(m_SharedFramesName.c_str()))
 	{
-		// IR is 1 byte per pixel so we need to copy to R, G and B
-		// might as well invert while we're there
-		auto ir = frames.get_infrared_frame();
-		invert8bppToRGB(frameBuffer, frameSize, ir);
+		if (ReadSharedFrame(frameBuffer, frameSize, m_SharedSequence, SharedFrameTimeoutMs))
+			return true;
 	}
-	break;
-	case RealSenseCamType::Color:
+	else
 	{
-		auto color = frames.get_color_frame();
-		invert24bppToRGB(frameBuffer, frameSize, color);
+		// no producer yet, or it never got streaming: don't spin
+		std::this_thread::sleep_for(std::chrono::microseconds(GetFrameInterval() / 10));
 	}
-	break;
-	case RealSenseCamType::ColorizedDepth:
+
+	// nothing new (or a copy torn by the producer): see if the camera is free, and show the latest frame again, or black
+	// if there isn't one, rather than whatever the sample held before
+	TakeOverProducer();
+	uint64_t latest = 0;
+	if (!m_SharedFrames.IsOpen() || !ReadSharedFrame(frameBuffer, frameSize, latest, 0))
+		ClearFrame(frameBuffer, frameSize);
+	return true;
+}
+
+/// <summary>
+/// read the next frame from the shared ring into an output frame. The producer renders at whatever size its own pin
+/// was connected at, so a frame of another size is copied out of the ring and scaled to ours
+/// </summary>
+/// <returns>false if there was no new frame within timeoutMs (frameBuffer may have been written to)</returns>
+bool RealSenseCam::ReadSharedFrame(BYTE* frameBuffer, int frameSize, uint64_t& sequence, int timeoutMs)
+{
+	SharedFrameFormat outputFormat = { (uint32_t)m_OutputWidth, (uint32_t)m_OutputHeight, (uint32_t)m_OutputBytesPerPixel };
+	SharedFrameFormat format = m_SharedFrames.GetLatestFormat();
+	bool scaled = !(format == outputFormat);
+	if (scaled && m_SharedFrameCopy.size() < m_SharedFrames.GetMaxFrameBytes())
+		m_SharedFrameCopy.resize(m_SharedFrames.GetMaxFrameBytes());
+
+	BYTE* target = scaled ? m_SharedFrameCopy.data() : frameBuffer;
+	size_t targetBytes = scaled ? m_SharedFrameCopy.size() : (size_t)frameSize;
+	if (!m_SharedFrames.Read(target, targetBytes, sequence, timeoutMs, format))
+		return false;
+
+	// the producer may have been resized since GetLatestFormat
+	if (format == outputFormat)
 	{
-		auto colorized_depth = m_Colorizer.colorize(frames.get_depth_frame());
-		invert24bppToRGB(frameBuffer, frameSize, colorized_depth);
+		if (scaled)
+			memcpy(frameBuffer, target, frameSize);
+		return true;
 	}
-	break;
-	case RealSenseCamType::ColorAlignedDepth:
+	if (!scaled || format.bytesPerPixel != outputFormat.bytesPerPixel || format.GetBytes() > targetBytes)
+		return false;
+	scaleFrame(frameBuffer, target, format);
+	return true;
+}
+/// <summary>
+/// fill an output frame with black (YUY2 black isn't zeroes)
+/// </summary>
+void RealSenseCam::ClearFrame(BYTE* frameBuffer, int frameSize)
+{
+	if (m_OutputBytesPerPixel == 2)
 	{
-		// align the color frame to the depth frame (so we end up with the smaller depth frame with color mapped onto it)
-		// TODO color frames will only be reenabled after I rebuild realsense with OpenMP set to FALSE, since it results
-		// in 100% CPU utilisation when handling color frames by the looks
-		frames = m_AlignToDepth.process(frames);
-		auto color = frames.get_color_frame();
-		invert24bppToRGB(frameBuffer, frameSize, color);
+		for (int i = 0; i + 1 < frameSize; i += 2)
+		{
+			frameBuffer[i] = 16;
+			frameBuffer[i + 1] = 128;
+		}
 	}
-	break;
-	case RealSenseCamType::PointCloud:
+	else
+	{
+		memset(frameBuffer, 0, frameSize);
+	}
+}
+
+/// <summary>
+/// render the next frame from the camera into an output frame, either for GetCamFrame
+/// directly or into the shared frame ring on the producer thread
+/// </summary>
+/// <param name="frameBuffer">output buffer, 24bpp</param>
+/// <param name="frameSize">output buffer size in bytes</param>
+/// <returns>false (with the frame cleared) if the pipelined stages have stopped, there won't be any more frames</returns>
+bool RealSenseCam::RenderCamFrame(BYTE* frameBuffer, int frameSize)
+{
+	LARGE_INTEGER start, end;
+	if (m_Pipelined)
 	{
-		auto depth = frames.get_depth_frame();
-		m_Points = m_PointCloud.calculate(depth);
-		rs2_error* e = nullptr;
-		int pointsCount = rs2_get_frame_points_count((rs2_frame*)m_Points, &e);
-		if (e != NULL)
+		// present stage: take the oldest rendered frame, convert it into the output and hand the buffer back.
+		// The queue is only closed when a stage has exited (the device went away) or the pipeline is being stopped
+		BYTE* rgbaFrame;
+		if (!m_RenderedFrames.Pop(rgbaFrame))
 		{
-			OutputDebugStringA("Error calculating points: \n");
-			OutputDebugStringA(rs2_get_error_message(e));
+			ClearFrame(frameBuffer, frameSize);
+			return false;
 		}
-		// Upload the vertices to Direct3D
-		// Draw the pointcloud and copy to the framebuffer
-		m_Renderer->RenderFrame(frameBuffer, frameSize, pointsCount, (const float*)m_Points.get_vertices(), (const float*)m_Points.get_texture_coordinates(), NULL, 0); // FIXME no color frame
+		QueryPerformanceCounter(&start);
+		m_Renderer->ConvertFrame(frameBuffer, frameSize, rgbaFrame);
+		QueryPerformanceCounter(&end);
+		m_StageTicks[(int)FrameStage::Output] = end.QuadPart - start.QuadPart;
+		m_FreeRenderBuffers.Push(rgbaFrame);
+		return true;
 	}
-	break;
-	case RealSenseCamType::PointCloudIR:
+
+	rs2::frameset frames;
+	if (m_OutputRateMultiplier > 1)
 	{
-		auto depth = frames.get_depth_frame();
-		auto ir = frames.get_infrared_frame();
-		m_PointCloud.map_to(ir);
-		m_Points = m_PointCloud.calculate(depth);
-		rs2_error* e = nullptr;
-		int pointsCount = rs2_get_frame_points_count((rs2_frame*)m_Points, &e);
-		if (e != NULL)
+		// keep to the output frame rate, redrawing the last point cloud when the sensor has nothing new yet
+		WaitForOutputSlot();
+		if (!m_Pipe.poll_for_frames(&frames) && m_HaveDrawnFrame)
 		{
-			OutputDebugStringA("Error calculating points: \n");
-			OutputDebugStringA(rs2_get_error_message(e));
+			SynthesizeFrame();
+			QueryPerformanceCounter(&start);
+			m_Renderer->ReadFrame(frameBuffer, frameSize);
+			QueryPerformanceCounter(&end);
+			m_StageTicks[(int)FrameStage::Output] = end.QuadPart - start.QuadPart;
+			return true;
 		}
-		// Upload the vertices to Direct3D
-		// Draw the pointcloud and copy to the framebuffer
-		m_Renderer->RenderFrame(frameBuffer, frameSize, pointsCount, (const float*)m_Points.get_vertices(), (const float*)m_Points.get_texture_coordinates(), ir.get_data(), ir.get_data_size());
 	}
-	break;
-	case RealSenseCamType::PointCloudColor:
+
+	// Block program until frames arrive if we need to, but take the most recent and discard older frames
+	QueryPerformanceCounter(&start);
+	if (!frames)
+		frames = m_Pipe.wait_for_frames();
+	QueryPerformanceCounter(&end);
+	m_StageTicks[(int)FrameStage::Acquire] = end.QuadPart - start.QuadPart;
+	start = end;
+
+	(this->*m_ProcessFrames)(frames, frameBuffer, frameSize, start);
+
+	// the point cloud types time their calculate and draw stages separately, so output is just the readback
+	QueryPerformanceCounter(&end);
+	m_StageTicks[(int)FrameStage::Output] = end.QuadPart - start.QuadPart;
+	return true;
+}
+
+/// <summary>
+/// calculate the point cloud for the depth frame in the frameset, with texture coordinates
+/// mapped to the IR or color frame for the types that have one.
+/// The depth frame is cropped to the region of interest and depth range first (m_DepthCrop), so only those points are
+/// calculated. With dirty frame detection the last points are reused while the depth frame hasn't changed,
+/// and the frame is marked unchanged if the texture hasn't either.
+/// </summary>
+/// <param name="frames">input frameset from the pipeline</param>
+/// <returns>the points, the frame they are textured from and the points count</returns>
+PointCloudFrame RealSenseCam::CalculatePointCloud(rs2::frameset frames)
+{
+	PointCloudFrame pointCloud;
+	pointCloud.texture = m_GetTexture(frames);
+
+	rs2::frame depth = frames.get_depth_frame();
+	if (!m_DepthCrop.IsPassThrough())
+		depth = m_DepthCrop.process(depth);
+	if (m_DirtyFrameDetection)
 	{
-		rs2::video_frame color = frames.get_color_frame();
-		m_PointCloud.map_to(color);
-		auto depth = frames.get_depth_frame();
-		m_Points = m_PointCloud.calculate(depth);
-		rs2_error* e = nullptr;
-		int pointsCount = rs2_get_frame_points_count((rs2_frame*)m_Points, &e);
-		if (e != NULL)
+		m_DirtyFrameStats.frames++;
+		bool depthChanged = m_DepthSignature.Update(depth.get_data(), m_DepthChangeThreshold);
+		bool textureChanged = pointCloud.texture && m_TextureSignature.Update(pointCloud.texture.get_data(), m_TextureChangeThreshold);
+		if (!depthChanged && m_LastPointCloud.points)
 		{
-			OutputDebugStringA("Error calculating points: \n");
-			OutputDebugStringA(rs2_get_error_message(e));
+			// the texture coordinates of the last points still map into this texture
+			pointCloud.points = m_LastPointCloud.points;
+			pointCloud.pointsCount = m_LastPointCloud.pointsCount;
+			pointCloud.unchanged = !textureChanged;
+
+			m_DirtyFrameStats.pointsReused++;
+			m_SavedCalculateTicks += m_CalculateTicks / m_CalculateCount;
+			m_StageTicks[(int)FrameStage::Calculate] = 0;
+			return pointCloud;
 		}
+	}
+
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
 
-		// Upload the vertices to Direct3D
-		// Draw the pointcloud and copy to the framebuffer
-		m_Renderer->RenderFrame(frameBuffer, frameSize, pointsCount, (const float*)m_Points.get_vertices(), (const float*)m_Points.get_texture_coordinates(), color.get_data(), color.get_data_size());
+	if (pointCloud.texture)
+		m_PointCloud.map_to(pointCloud.texture);
+	pointCloud.points = m_PointCloud.calculate(depth);
+	rs2_error* e = nullptr;
+	pointCloud.pointsCount = rs2_get_frame_points_count((rs2_frame*)pointCloud.points, &e);
+	if (e != NULL)
+	{
+		OutputDebugStringA("Error calculating points: \n");
+		OutputDebugStringA(rs2_get_error_message(e));
 	}
-	break;
-	default:
-		break;
+
+	QueryPerformanceCounter(&end);
+	m_CalculateTicks += end.QuadPart - start.QuadPart;
+	m_CalculateCount++;
+	m_StageTicks[(int)FrameStage::Calculate] = end.QuadPart - start.QuadPart;
+
+	if (m_DirtyFrameDetection)
+		m_LastPointCloud = pointCloud;
+	return pointCloud;
+}
+
+/// <summary>
+/// draw a point cloud into the renderer, or just redraw the last one if nothing has changed
+/// </summary>
+/// <param name="pointCloud">from CalculatePointCloud</param>
+void RealSenseCam::DrawPointCloud(const PointCloudFrame& pointCloud)
+{
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+
+	if (pointCloud.unchanged)
+	{
+		m_Renderer->RedrawFrame();
+	}
+	else
+	{
+		const rs2::frame& texture = pointCloud.texture;
+		m_Renderer->DrawFrame(pointCloud.pointsCount, (const float*)pointCloud.points.get_vertices(), (const float*)pointCloud.points.get_texture_coordinates(),
+			texture ? texture.get_data() : NULL, texture ? texture.get_data_size() : 0);
+	}
+
+	QueryPerformanceCounter(&end);
+	LONGLONG ticks = end.QuadPart - start.QuadPart;
+	m_StageTicks[(int)FrameStage::Draw] = ticks;
+	if (pointCloud.unchanged)
+	{
+		// only count what a full draw would have cost on top of the redraw
+		m_DirtyFrameStats.framesReused++;
+		if (m_DrawCount > 0 && m_DrawTicks / m_DrawCount > ticks)
+			m_SavedDrawTicks += m_DrawTicks / m_DrawCount - ticks;
+	}
+	else
+	{
+		m_DrawTicks += ticks;
+		m_DrawCount++;
+	}
+}
+
+DirtyFrameStats RealSenseCam::GetDirtyFrameStats() const
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	DirtyFrameStats stats = m_DirtyFrameStats;
+	stats.savedMilliseconds = (double)(m_SavedCalculateTicks + m_SavedDrawTicks) * 1000.0 / frequency.QuadPart;
+	return stats;
+}
+
+/// <summary>
+/// start the acquire and render stage threads for the pipelined mode, with two
+/// RGBA output-sized buffers circulating between the render and present stages
+/// </summary>
+void RealSenseCam::StartPipeline()
+{
+	// the buffers from the last start do unless the output has grown since (SetOutputSize)
+	size_t renderBufferSize = (size_t)4 * m_OutputWidth * m_OutputHeight;
+	if (renderBufferSize > m_RenderBufferSize)
+	{
+		for (int i = 0; i < RenderBufferCount; ++i)
+			m_RenderBuffers[i] = m_FrameArena.Allocate(renderBufferSize);
+		m_RenderBufferSize = renderBufferSize;
+	}
+
+	m_PointCloudFrames.Reset(2);
+	m_RenderedFrames.Reset(RenderBufferCount);
+	m_FreeRenderBuffers.Reset(RenderBufferCount);
+	for (int i = 0; i < RenderBufferCount; ++i)
+		m_FreeRenderBuffers.Push(m_RenderBuffers[i]);
+
+	m_PipelineRunning = true;
+	m_AcquireThread = std::thread(&RealSenseCam::AcquireLoop, this);
+	m_RenderThread = std::thread(&RealSenseCam::RenderLoop, this);
+}
+
+void RealSenseCam::StopPipeline()
+{
+	if (!m_PipelineRunning)
+		return;
+
+	m_PipelineRunning = false;
+	m_PointCloudFrames.Close();
+	m_RenderedFrames.Close();
+	m_FreeRenderBuffers.Close();
+	if (m_AcquireThread.joinable())
+		m_AcquireThread.join();
+	if (m_RenderThread.joinable())
+		m_RenderThread.join();
+	m_Pipelined = false;
+}
+
+/// <summary>
+/// acquire stage: wait for framesets and calculate their point clouds.
+/// Blocks on the queue to the render stage when it is full.
+/// </summary>
+void RealSenseCam::AcquireLoop()
+{
+	try
+	{
+		while (m_PipelineRunning)
+		{
+			// poll with a timeout so that StopPipeline isn't held up by a stalled device
+			rs2::frameset frames;
+			LARGE_INTEGER start, end;
+			QueryPerformanceCounter(&start);
+			if (!m_Pipe.try_wait_for_frames(&frames, 100))
+				continue;
+			QueryPerformanceCounter(&end);
+			m_StageTicks[(int)FrameStage::Acquire] = end.QuadPart - start.QuadPart;
+
+			if (!m_PointCloudFrames.Push(CalculatePointCloud(frames)))
+				break;
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		OutputDebugStringA("Acquire stage stopped: ");
+		OutputDebugStringA(ex.what());
+		OutputDebugStringA("\n");
+	}
+	m_PointCloudFrames.Close();
+}
+
+/// <summary>
+/// render stage: draw each point cloud and copy the rendered RGBA frame into a free buffer
+/// for the present stage (GetCamFrame) to convert
+/// </summary>
+void RealSenseCam::RenderLoop()
+{
+	PointCloudFrame pointCloud;
+	BYTE* rgbaFrame;
+	bool haveDrawnFrame = false;
+	while (m_PipelineRunning)
+	{
+		bool newFrame;
+		if (m_OutputRateMultiplier > 1 && haveDrawnFrame)
+		{
+			// render to the output frame rate, redrawing the last point cloud whenever the acquire stage has nothing new yet
+			WaitForOutputSlot();
+			newFrame = m_PointCloudFrames.TryPop(pointCloud);
+			// the acquire stage has stopped, so pass that on rather than redrawing the last frame for ever
+			if (!newFrame && m_PointCloudFrames.IsClosed())
+				break;
+		}
+		else
+		{
+			if (!m_PointCloudFrames.Pop(pointCloud))
+				break;
+			newFrame = true;
+		}
+
+		if (newFrame)
+		{
+			DrawPointCloud(pointCloud);
+			haveDrawnFrame = true;
+		}
+		else
+		{
+			SynthesizeFrame();
+		}
+
+		if (!m_FreeRenderBuffers.Pop(rgbaFrame))
+			break;
+		m_Renderer->ReadFrameRgba(rgbaFrame);
+		if (!m_RenderedFrames.Push(rgbaFrame))
+			break;
+	}
+	m_RenderedFrames.Close();
+}
+
+/// <summary>
+/// the largest frame this type can be asked for, which the shared ring's slots are sized for so that a producer can be
+/// resized without the readers having to find another ring
+/// </summary>
+size_t RealSenseCam::GetMaxOutputFrameBytes() const
+{
+	size_t pixels = (size_t)m_OutputWidth * m_OutputHeight;
+	if (IsPointCloudType())
+	{
+		for (const SIZE& size : PointCloudOutputSizes)
+			pixels = std::max(pixels, (size_t)size.cx * size.cy);
+	}
+	return pixels * m_OutputBytesPerPixel;
+}
+
+/// <summary>
+/// start rendering frames into the shared frame ring on a thread of our own,
+/// now that this process has the producer lock and a streaming pipeline
+/// </summary>
+void RealSenseCam::StartProducer()
+{
+	if (!m_SharedFrames.Create(m_SharedFramesName.c_str(), GetMaxOutputFrameBytes(), SharedFrameSlots))
+	{
+		OutputDebugStringA("Couldn't create the shared frame ring\n");
+		return;
+	}
+
+	m_ProducerRunning = true;
+	m_ProducerThread = std::thread(&RealSenseCam::ProducerLoop, this);
+}
+
+void RealSenseCam::StopProducer()
+{
+	// (the thread may have stopped by itself)
+	if (!m_ProducerThread.joinable())
+		return;
+
+	// stopping the pipe releases a producer blocked waiting for frames
+	m_ProducerRunning = false;
+	StopPipeline();
+	try
+	{
+		m_Pipe.stop();
+	}
+	catch (const std::exception&)
+	{
+	}
+	if (m_ProducerThread.joinable())
+		m_ProducerThread.join();
+}
+
+/// <summary>
+/// producer: render each frame straight into the next slot of the shared frame ring
+/// </summary>
+void RealSenseCam::ProducerLoop()
+{
+	int frameSize = m_OutputWidth * m_OutputHeight * m_OutputBytesPerPixel;
+	SharedFrameFormat format = { (uint32_t)m_OutputWidth, (uint32_t)m_OutputHeight, (uint32_t)m_OutputBytesPerPixel };
+	while (m_ProducerRunning)
+	{
+		try
+		{
+			BYTE* frameBuffer = m_SharedFrames.BeginWrite();
+			if (!RenderCamFrame(frameBuffer, frameSize))
+			{
+				// the pipelined stages have stopped: no more frames, GetCamFrame ends the stream
+				OutputDebugStringA("Producer stopped, the camera has no more frames\n");
+				m_ProducerRunning = false;
+				break;
+			}
+			m_SharedFrames.EndWrite(format);
+		}
+		catch (const std::exception& ex)
+		{
+			// the slot stays unpublished, readers keep showing the last frame
+			OutputDebugStringA("Producer frame failed: ");
+			OutputDebugStringA(ex.what());
+			OutputDebugStringA("\n");
+		}
 	}
 }
 
+/// <summary>
+/// the producer has gone (or stalled) without publishing for a while, so if its lock is free
+/// this process opens the camera itself, and readers carry on from the same ring
+/// </summary>
+void RealSenseCam::TakeOverProducer()
+{
+	if (m_SharedFrames.IsProducer() || !m_SharedFrames.TryLockProducer(m_SharedFramesName.c_str()))
+		return;
+
+	OutputDebugStringA("Taking over as the frame producer\n");
+	m_SharedFrames.Close();
+	Init(m_Type);
+}
+
+/// <summary>
+/// sleep until the next output frame is due. If we've fallen more than a frame behind
+/// (or this is the first frame) the schedule restarts from now rather than trying to catch up.
+/// </summary>
+void RealSenseCam::WaitForOutputSlot()
+{
+	auto interval = std::chrono::microseconds(GetFrameInterval() / 10);
+	auto now = std::chrono::steady_clock::now();
+	if (m_NextOutputTime + interval < now)
+		m_NextOutputTime = now;
+	else
+		std::this_thread::sleep_until(m_NextOutputTime);
+	m_NextOutputTime += interval;
+}
+
+/// <summary>
+/// redraw the last point cloud from the camera's current position, timing it for the synthesized frame counters
+/// </summary>
+void RealSenseCam::SynthesizeFrame()
+{
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	m_Renderer->RedrawFrame();
+	QueryPerformanceCounter(&end);
+
+	m_SynthesizedFrameCount++;
+	m_SynthesizedFrameTicks += end.QuadPart - start.QuadPart;
+	m_StageTicks[(int)FrameStage::Draw] = end.QuadPart - start.QuadPart;
+}
+
 /// <summary>
 /// assuming the 8bits per pixel is an IR intensity value
 /// then replicate it in the R, G and B bytes of the output frame buffer
@@ -266,15 +1187,15 @@ void RealSenseCam::GetCamFrame(BYTE* frameBuffer, int frameSize)
 /// <param name="frame">input video frame</param>
 void RealSenseCam::invert8bppToRGB(BYTE * frameBuffer, int frameSize, rs2::video_frame frame)
 {
-	int pixelCount = frame.get_height() * frame.get_width();
+	int width = frame.get_width();
+	int pixelCount = frame.get_height() * width;
 	auto data = (BYTE*)frame.get_data();
-	for (int i = 0; i < pixelCount; ++i)
-	{
-		BYTE val = data[(pixelCount - i) - 1];
-		frameBuffer[3 * i] = val;
-		frameBuffer[3 * i + 1] = val;
-		frameBuffer[3 * i + 2] = val;
-	}
+	auto reverseToGrey = m_PixelKernels->ReverseToGrey;
+	m_ThreadPool.ParallelFor(0, frame.get_height(), 16, [=](int rowBegin, int rowEnd)
+		{
+			// output rows [rowBegin, rowEnd) come from the same number of rows counting back from the end
+			reverseToGrey(frameBuffer + 3 * rowBegin * width, data + pixelCount - rowEnd * width, (rowEnd - rowBegin) * width);
+		});
 }
 
 /// <summary>
@@ -287,12 +1208,58 @@ void RealSenseCam::invert8bppToRGB(BYTE * frameBuffer, int frameSize, rs2::video
 /// <param name="frame">input video frame</param>
 void RealSenseCam::invert24bppToRGB(BYTE * frameBuffer, int frameSize, rs2::video_frame frame)
 {
-	int pixelCount = frame.get_height() * frame.get_width();
+	int width = frame.get_width();
+	int pixelCount = frame.get_height() * width;
 	auto data = (BYTE*)frame.get_data();
-	for (int i = 0; i < pixelCount; ++i)
+	auto reverseBytes = m_PixelKernels->ReverseBytes;
+	m_ThreadPool.ParallelFor(0, frame.get_height(), 16, [=](int rowBegin, int rowEnd)
+		{
+			// turning the frame around byte by byte reverses each pixel's bytes as well as the pixel order
+			reverseBytes(frameBuffer + 3 * rowBegin * width, data + 3 * (pixelCount - rowEnd * width), 3 * (rowEnd - rowBegin) * width);
+		});
+}
+
+/// <summary>
+/// copy a YUYV frame into a YUY2 output frame, mirrored like the RGB types.
+/// YUY2 frames are top-down (RGB24 frames are bottom-up, which is why those are turned all the way around),
+/// so the rows stay in place and each is only mirrored, a whole macropixel at a time
+/// </summary>
+/// <param name="frameBuffer">output buffer, YUY2</param>
+/// <param name="frameSize">output buffer size in bytes</param>
+/// <param name="frame">input video frame, YUYV</param>
+void RealSenseCam::mirrorYuy2(BYTE * frameBuffer, int frameSize, rs2::video_frame frame)
+{
+	int width = frame.get_width();
+	auto data = (BYTE*)frame.get_data();
+	auto mirror = m_PixelKernels->MirrorYuy2;
+	m_ThreadPool.ParallelFor(0, frame.get_height(), 16, [=](int rowBegin, int rowEnd)
+		{
+			for (int row = rowBegin; row < rowEnd; row++)
+				mirror(frameBuffer + 2 * row * width, data + 2 * row * width, width);
+		});
+}
+
+/// <summary>
+/// nearest neighbour scale a frame from the shared ring (the producer's output size) to our output size, stretching it
+/// if the aspect ratios differ. YUY2 goes a whole macropixel at a time so the chroma pairs stay together.
+/// Plain loops: a reader process hasn't started the thread pool
+/// </summary>
+/// <param name="frameBuffer">output buffer, our size</param>
+/// <param name="source">the producer's frame, same format</param>
+/// <param name="sourceFormat">its size</param>
+void RealSenseCam::scaleFrame(BYTE * frameBuffer, const BYTE * source, const SharedFrameFormat& sourceFormat)
+{
+	int sourceWidth = (int)sourceFormat.width;
+	int sourceHeight = (int)sourceFormat.height;
+	int unitBytes = m_OutputBytesPerPixel == 2 ? 4 : m_OutputBytesPerPixel;	// a macropixel of YUY2, or a pixel
+	int unitPixels = m_OutputBytesPerPixel == 2 ? 2 : 1;
+	int units = m_OutputWidth / unitPixels;
+	int sourceUnits = sourceWidth / unitPixels;
+	for (int row = 0; row < m_OutputHeight; row++)
 	{
-		frameBuffer[3 * i] = data[3 * (pixelCount - i) - 1];
-		frameBuffer[3 * i + 1] = data[3 * (pixelCount - i) - 2];
-		frameBuffer[3 * i + 2] = data[3 * (pixelCount - i) - 3];
+		const BYTE* sourceRow = source + (size_t)(row * sourceHeight / m_OutputHeight) * sourceWidth * m_OutputBytesPerPixel;
+		BYTE* outputRow = frameBuffer + (size_t)row * m_OutputWidth * m_OutputBytesPerPixel;
+		for (int unit = 0; unit < units; unit++)
+			memcpy(outputRow + unit * unitBytes, sourceRow + (unit * sourceUnits / units) * unitBytes, unitBytes);
 	}
 }
@@ -4,7 +4,21 @@
 
 #include <windows.h>
 #include <librealsense2/rs.hpp>
+#include <librealsense2/rs_advanced_mode.hpp>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BoundedQueue.h"
+#include "FrameArena.h"
+#include "FrameSignature.h"
+#include "CpuPointCloudRenderer.h"
+#include "DepthCrop.h"
+#include "PixelKernels.h"
 #include "PointCloudRenderer.h"
+#include "SharedFrameRing.h"
+#include "ThreadPool.h"
 
 enum class RealSenseCamType
 {
@@ -14,7 +28,40 @@ enum class RealSenseCamType
 	ColorAlignedDepth,
 	PointCloud,
 	PointCloudIR,
-	PointCloudColor
+	PointCloudColor,
+	ColorYuy2			// Color as the sensor sends it (YUYV), output as YUY2 with no color space conversion
+};
+
+// the output sizes offered for the point cloud types on top of the 80x60 multiples up to 640x480 that every type has,
+// since they render at any size: 720p, 1080p, 1440p and 4K
+static const SIZE PointCloudOutputSizes[] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+
+// points calculated from one frameset, plus the IR/color frame their texture coordinates refer to
+struct PointCloudFrame
+{
+	rs2::points points;
+	rs2::frame texture;					// empty for the plain PointCloud type
+	int pointsCount = 0;
+	bool unchanged = false;				// same depth and texture as the last frame, so the renderer can just redraw
+};
+
+// the per-frame stages timed by RealSenseCam::GetStageTicks
+enum class FrameStage
+{
+	Acquire,		// waiting for a frameset from the pipeline
+	Calculate,		// point cloud calculation (0 when the last points were reused)
+	Draw,			// rendering the point cloud, or redrawing it for a synthesized frame
+	Output,			// conversion (or readback) into the output frame
+	Count
+};
+
+// counters for dirty frame detection (read them once streaming has stopped, they aren't synchronised)
+struct DirtyFrameStats
+{
+	unsigned int frames = 0;			// depth frames checked
+	unsigned int pointsReused = 0;		// depth unchanged, so the last points were reused
+	unsigned int framesReused = 0;		// texture unchanged as well, so the last frame was just redrawn
+	double savedMilliseconds = 0.0;		// estimated from the average cost of the work skipped
 };
 
 class RealSenseCam
@@ -22,14 +69,41 @@ class RealSenseCam
 public:
 	RealSenseCam();
 	~RealSenseCam();
+	// settle the output frame size, format and rate for a type without opening the camera (Init does this too)
+	void Configure(RealSenseCamType type);
 	HRESULT Init(RealSenseCamType type);
+	// stream from one particular device in context (e.g. a software device) rather than whatever is plugged in,
+	// the frames aren't shared with other processes. A failed Init has already been UnInit
+	HRESULT Init(RealSenseCamType type, const rs2::context& context, const std::string& serialNumber);
 	void UnInit();
-	void GetCamFrame(BYTE* frameBuffer, int frameSize);
+	// false (with the frame cleared) once the camera has stopped delivering frames for good, so the stream should end
+	bool GetCamFrame(BYTE* frameBuffer, int frameSize);
+	const FrameArena& GetFrameArena() const { return m_FrameArena; }
+	int GetOutputWidth() const { return m_OutputWidth; }
+	int GetOutputHeight() const { return m_OutputHeight; }
+	int GetOutputBytesPerPixel() const { return m_OutputBytesPerPixel; }
+	bool IsPointCloudType() const { return m_Type == RealSenseCamType::PointCloud || m_Type == RealSenseCamType::PointCloudIR || m_Type == RealSenseCamType::PointCloudColor; }
+
+	// render the point cloud types at another output size (the others are the sensor's size, E_INVALIDARG).
+	// Once streaming, only the renderer's output sized resources are recreated, the sensor keeps streaming.
+	// Not while GetCamFrame is running (the filter calls it while its pin is being connected)
+	HRESULT SetOutputSize(int width, int height);
+
+	// output frame interval in 100ns units (REFERENCE_TIME), shorter than the sensor's when frames are synthesized in between
+	LONGLONG GetFrameInterval() const { return SensorFrameInterval / m_OutputRateMultiplier; }
+
+	DirtyFrameStats GetDirtyFrameStats() const;
+
+	// QueryPerformanceCounter ticks of the latest frame through each stage, updated by whichever thread runs the stage
+	LONGLONG GetStageTicks(FrameStage stage) const { return m_StageTicks[(int)stage]; }
 
 private:
 	RealSenseCamType m_Type;			// which type of stream to make (IR, color, point cloud etc)
+	rs2::config m_Config;				// the streams for m_Type, from Configure
+	TextureFormat m_TextureFormat = TextureFormat::None;	// what the point cloud types texture the points from
 	rs2::pipeline m_Pipe;
 	rs2::align m_AlignToDepth;			// Define the align object. It will be used to align RGB to depth TODO: necessary, if using point cloud map_to?
+	DepthCrop m_DepthCrop;				// the region of interest and depth range, applied to the depth frames before m_PointCloud
 	rs2::pointcloud m_PointCloud;		// RS2 pointcloud helper
 	rs2::points m_Points;				// persist the points between frames in case we want to display again
 	rs2::colorizer m_Colorizer;			// Helper to colorize depth images - not needed when RGB colors are used
@@ -37,9 +111,120 @@ private:
 	int m_InputTexWidth, m_InputTexHeight;	// Dimensions of the color/IR texture input frame
 	int m_OutputWidth, m_OutputHeight;	// Dimensions of the output video frame (can be different to input frame size for point cloud types)
 										// Needs to match what gets provided in output media sample frame buffer!
-	PointCloudRenderer* m_Renderer = NULL;		// Custom class that uses Direct3D to project point cloud data to a texture and copy back to the frame
+	int m_OutputBytesPerPixel = 3;		// 3 for RGB24, 2 for YUY2
+	int m_RequestedOutputWidth = 0;		// from SetOutputSize, kept by Configure for the point cloud types (0 for the default)
+	int m_RequestedOutputHeight = 0;
+	PointCloudRendererBase* m_Renderer = NULL;	// Custom class that uses Direct3D (or the CPU) to project point cloud data to a texture and copy back to the frame
+	ThreadPool m_ThreadPool;			// shared by all the per-frame kernels (here and in the renderer)
+	FrameArena m_FrameArena;			// every intermediate buffer of the capture path, allocated during Init
+	std::atomic<LONGLONG> m_StageTicks[(int)FrameStage::Count];
+	const PixelKernels* m_PixelKernels = &PixelKernels::GetBest();	// format conversions, the best variant for this CPU
+
+	// Output rate multiplier (point cloud types only): the sensor runs at 30 fps, and in between its frames the
+	// last point cloud is redrawn from the drifting camera's current position, paced to the output frame interval
+	static const LONGLONG SensorFrameInterval = 333333;	// 30 fps
+	int m_OutputRateMultiplier = 1;
+	std::chrono::steady_clock::time_point m_NextOutputTime;
+	bool m_HaveDrawnFrame = false;		// something to redraw (non-pipelined mode)
+	unsigned int m_SynthesizedFrameCount = 0;
+	LONGLONG m_SynthesizedFrameTicks = 0;	// QueryPerformanceCounter ticks spent redrawing
+
+	// Dirty frame detection (point cloud types only): the acquire side compares block sums of each depth and texture frame
+	// with the last changed one (FrameSignature), reusing the last points and flagging frames that can just be redrawn
+	bool m_DirtyFrameDetection = false;
+	int m_DepthChangeThreshold = 8;
+	int m_TextureChangeThreshold = 6;
+	FrameSignature m_DepthSignature;
+	FrameSignature m_TextureSignature;
+	PointCloudFrame m_LastPointCloud;
+	DirtyFrameStats m_DirtyFrameStats;
+	LONGLONG m_CalculateTicks = 0;		// acquire side: time spent calculating points
+	LONGLONG m_SavedCalculateTicks = 0;
+	unsigned int m_CalculateCount = 0;
+	LONGLONG m_DrawTicks = 0;			// render side: time spent in full draws
+	LONGLONG m_SavedDrawTicks = 0;
+	unsigned int m_DrawCount = 0;
+
+	// Pipelined mode (point cloud types only): acquire+deproject, render and convert run as three stages on
+	// their own threads so that frame N+1 is deprojected while frame N is rendered and frame N-1 is converted
+	// into the output by GetCamFrame. The bounded queues between the stages provide the back-pressure.
+	bool m_Pipelined = false;
+	std::atomic<bool> m_PipelineRunning { false };
+	std::thread m_AcquireThread;
+	std::thread m_RenderThread;
+	BoundedQueue<PointCloudFrame> m_PointCloudFrames;	// acquire -> render
+	BoundedQueue<BYTE*> m_RenderedFrames;				// render -> present (RGBA, output sized)
+	BoundedQueue<BYTE*> m_FreeRenderBuffers;			// present -> render, recycled RGBA buffers (in the frame arena)
+	static const int RenderBufferCount = 2;
+	BYTE* m_RenderBuffers[RenderBufferCount];			// kept across StopPipeline/StartPipeline unless the output grows
+	size_t m_RenderBufferSize = 0;
+
+	// Frame sharing: the first process to get the producer lock owns the pipeline and renders every output frame
+	// into a shared memory ring on its producer thread. GetCamFrame in every process (the producer's included)
+	// copies the latest frame out of the ring, and a reader whose producer has gone quiet takes over the camera.
+	static const int SharedFrameSlots = 3;
+	static const int SharedFrameTimeoutMs = 1000;
+	bool m_ShareFrames = false;
+	std::string m_SharedFramesName;		// of the producer lock and the ring, one per camera type
+	SharedFrameRing m_SharedFrames;
+	uint64_t m_SharedSequence = 0;		// last frame read from the ring
+	std::vector<BYTE> m_SharedFrameCopy;	// a reader connected at another size than the producer's copies its frames here to scale them
+	std::atomic<bool> m_ProducerRunning { false };
+	std::thread m_ProducerThread;
+
+	// The per-type frame path, compiled for each RealSenseCamType and selected once at Init (SelectPipeline)
+	// so that RenderCamFrame makes one indirect call rather than switching on the type every frame.
+	// outputStart is moved on by the types that time their calculate and draw stages separately
+	template <RealSenseCamType Type>
+	void ProcessFrames(rs2::frameset& frames, BYTE* frameBuffer, int frameSize, LARGE_INTEGER& outputStart);
+	// the IR/color frame the points are textured from, empty for the types without one
+	template <RealSenseCamType Type>
+	static rs2::frame GetTexture(const rs2::frameset& frames);
+	template <RealSenseCamType Type>
+	void SelectPipeline();
+	void (RealSenseCam::*m_ProcessFrames)(rs2::frameset& frames, BYTE* frameBuffer, int frameSize, LARGE_INTEGER& outputStart) = NULL;
+	rs2::frame (*m_GetTexture)(const rs2::frameset& frames) = NULL;
+
+	static const rs2::context& GetSharedContext();
+	bool ConfigureDepthSensor(const rs2::device& device, const rs2::region_of_interest* region, float minDistance, float maxDistance);
+	void RestoreDepthSensor();
+
+	// the depth sensor settings ConfigureDepthSensor changed, as they were before: they outlive the stream (the depth
+	// table until the camera is power cycled), so UnInit puts them back for the next process to open the camera
+	struct DepthSensorSettings
+	{
+		rs2::device device;
+		bool distances = false;
+		float minDistance = 0.0f;
+		float maxDistance = 0.0f;
+		bool depthTable = false;
+		STDepthTableControl table = {};
+		bool region = false;
+		rs2::region_of_interest roi = {};
+	};
+	DepthSensorSettings m_SavedDepthSensor;
+	size_t GetMaxOutputFrameBytes() const;
+
+	HRESULT StartCamera(RealSenseCamType type, const rs2::context& context, const std::string& serialNumber);
+	bool RenderCamFrame(BYTE* frameBuffer, int frameSize);
+	PointCloudFrame CalculatePointCloud(rs2::frameset frames);
+	void DrawPointCloud(const PointCloudFrame& pointCloud);
+	void StartPipeline();
+	void StopPipeline();
+	void AcquireLoop();
+	void RenderLoop();
+	void StartProducer();
+	void StopProducer();
+	void ProducerLoop();
+	void TakeOverProducer();
+	bool ReadSharedFrame(BYTE* frameBuffer, int frameSize, uint64_t& sequence, int timeoutMs);
+	void ClearFrame(BYTE* frameBuffer, int frameSize);
+	void WaitForOutputSlot();
+	void SynthesizeFrame();
 
 	// helper functions for mapping RS frames to output directshow frames (includes inverting etc.)
 	void invert8bppToRGB(BYTE* frameBuffer, int frameSize, rs2::video_frame frame);
 	void invert24bppToRGB(BYTE* frameBuffer, int frameSize, rs2::video_frame frame);
+	void mirrorYuy2(BYTE* frameBuffer, int frameSize, rs2::video_frame frame);
+	void scaleFrame(BYTE* frameBuffer, const BYTE* source, const SharedFrameFormat& sourceFormat);
 };
@@ -0,0 +1,358 @@
+#include "SharedFrameRing.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// the ring's atomics are shared between processes, which only works if they don't hide a lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64 bit atomics must be lock free");
+
+SharedFrameRing::SharedFrameRing() :
+#ifdef _WIN32
+	m_Mapping(nullptr), m_FrameEvents{ nullptr, nullptr },
+#endif
+	m_ProducerLock(InvalidLock), m_Header(nullptr), m_MappedBytes(0), m_WriteSequence(0), m_ReadCount(0), m_TotalLatencyNanoseconds(0.0), m_MaxLatencyNanoseconds(0)
+{
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+	Close();
+	UnlockProducer();
+}
+
+bool SharedFrameRing::TryLockProducer(const char* name)
+{
+	if (IsProducer())
+		return true;
+
+#ifdef _WIN32
+	// no sharing allowed, so only one process can have the file open; closing the handle (or dying) deletes it
+	char tempPath[MAX_PATH];
+	GetTempPathA(MAX_PATH, tempPath);
+	std::string path = std::string(tempPath) + name + ".lock";
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	m_ProducerLock = file;
+#else
+	std::string path = std::string("/tmp/") + name + ".lock";
+	int fd = open(path.c_str(), O_CREAT | O_RDWR, 0600);
+	if (fd < 0)
+		return false;
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	m_ProducerLock = fd;
+#endif
+	return true;
+}
+
+void SharedFrameRing::UnlockProducer()
+{
+	if (!IsProducer())
+		return;
+
+#ifdef _WIN32
+	CloseHandle(m_ProducerLock);
+#else
+	close(m_ProducerLock);
+#endif
+	m_ProducerLock = InvalidLock;
+}
+
+bool SharedFrameRing::Create(const char* name, size_t maxFrameBytes, int slotCount)
+{
+	// our own ring again (the producer restarting after a resize): keep it, rather than closing it on the readers
+	if (m_Header && m_CreatedName == name && m_Header->frameBytes == maxFrameBytes && m_Header->slotCount == (uint32_t)slotCount)
+		return true;
+	Close();
+
+	// each slot is a cache line of SlotHeader followed by the frame
+	uint64_t slotStride = HeaderBytes + ((maxFrameBytes + 63) & ~(size_t)63);
+	size_t bytes = HeaderBytes + (size_t)(slotCount * slotStride);
+	if (!Map(name, bytes, true))
+		return false;
+
+	// a ring left by an earlier producer with the same layout carries on from its sequence numbers,
+	// so readers that are already attached don't see the frames go backwards
+	bool sameLayout = m_Header->magic == Magic && m_Header->version == Version && m_Header->frameBytes == maxFrameBytes && m_Header->slotCount == (uint32_t)slotCount;
+	if (!sameLayout)
+	{
+		m_Header->magic = 0;
+		std::atomic_thread_fence(std::memory_order_release);
+		m_Header->version = Version;
+		m_Header->slotCount = slotCount;
+		m_Header->frameBytes = maxFrameBytes;
+		m_Header->slotStride = slotStride;
+		m_Header->latestSequence.store(0, std::memory_order_relaxed);
+		m_Header->closed.store(0, std::memory_order_relaxed);
+		for (int i = 0; i < slotCount; i++)
+		{
+			SlotHeader* slot = (SlotHeader*)((unsigned char*)m_Header + HeaderBytes + i * slotStride);
+			slot->sequence.store(0, std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		m_Header->magic = Magic;
+	}
+	m_WriteSequence = m_Header->latestSequence.load(std::memory_order_relaxed);
+	m_Header->closed.store(0, std::memory_order_release);
+	m_CreatedName = name;
+
+	OpenEvents(name);
+	return true;
+}
+
+bool SharedFrameRing::Open(const char* name)
+{
+	Close();
+	if (!Map(name, 0, false))
+		return false;
+
+	bool valid = m_MappedBytes >= HeaderBytes && m_Header->magic == Magic && m_Header->version == Version
+		&& m_MappedBytes >= HeaderBytes + m_Header->slotCount * m_Header->slotStride && !m_Header->closed.load(std::memory_order_acquire);
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	OpenEvents(name);
+	return true;
+}
+
+void SharedFrameRing::Close()
+{
+	if (m_Header && !m_CreatedName.empty())
+	{
+		// readers still mapping the ring keep it alive until they see this and close it too
+		m_Header->closed.store(1, std::memory_order_release);
+#ifndef _WIN32
+		shm_unlink(("/" + m_CreatedName).c_str());
+#endif
+	}
+	m_CreatedName.clear();
+
+#ifdef _WIN32
+	for (auto& event : m_FrameEvents)
+	{
+		if (event)
+			CloseHandle(event);
+		event = nullptr;
+	}
+	if (m_Header)
+		UnmapViewOfFile(m_Header);
+	if (m_Mapping)
+		CloseHandle(m_Mapping);
+	m_Mapping = nullptr;
+#else
+	if (m_Header)
+		munmap(m_Header, m_MappedBytes);
+#endif
+	m_Header = nullptr;
+	m_MappedBytes = 0;
+}
+
+unsigned char* SharedFrameRing::BeginWrite()
+{
+	m_WriteSequence++;
+	SlotHeader* slot = (SlotHeader*)Slot(m_WriteSequence);
+
+	// readers that catch the slot from here on will throw their copy away
+	slot->sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	return (unsigned char*)slot + HeaderBytes;
+}
+
+void SharedFrameRing::EndWrite(const SharedFrameFormat& format)
+{
+	SlotHeader* slot = (SlotHeader*)Slot(m_WriteSequence);
+	slot->timestamp = Now();
+	slot->format = format;
+	slot->sequence.store(m_WriteSequence, std::memory_order_release);
+	m_Header->latestSequence.store(m_WriteSequence, std::memory_order_release);
+
+#ifdef _WIN32
+	// the event for the frame after this one goes unsignalled before this frame's is signalled
+	if (m_FrameEvents[0] && m_FrameEvents[1])
+	{
+		ResetEvent(m_FrameEvents[(m_WriteSequence + 1) % 2]);
+		SetEvent(m_FrameEvents[m_WriteSequence % 2]);
+	}
+#endif
+}
+
+SharedFrameFormat SharedFrameRing::GetLatestFormat() const
+{
+	SharedFrameFormat format = { 0, 0, 0 };
+	uint64_t latest = m_Header ? m_Header->latestSequence.load(std::memory_order_acquire) : 0;
+	if (latest != 0)
+	{
+		// a hint only (the slot can be rewritten under us), Read returns the format of the frame it actually copied
+		const SlotHeader* slot = (const SlotHeader*)Slot(latest);
+		format = slot->format;
+	}
+	return format;
+}
+
+bool SharedFrameRing::Read(unsigned char* frame, size_t frameBytes, uint64_t& sequence, int timeoutMs, SharedFrameFormat& format)
+{
+	if (!m_Header)
+		return false;
+
+	int64_t deadline = Now() + (int64_t)timeoutMs * 1000000;
+	int tornReads = 0;
+	for (;;)
+	{
+		if (m_Header->closed.load(std::memory_order_acquire))
+		{
+			Close();
+			return false;
+		}
+
+
+		// a new producer with a different layout starts again from 0, so any other number is a new frame
+		uint64_t latest = m_Header->latestSequence.load(std::memory_order_acquire);
+		if (latest != 0 && latest != sequence)
+		{
+			SlotHeader* slot = (SlotHeader*)Slot(latest);
+			uint64_t before = slot->sequence.load(std::memory_order_acquire);
+			if (before == latest)
+			{
+				int64_t timestamp = slot->timestamp;
+				SharedFrameFormat slotFormat = slot->format;
+				size_t slotBytes = std::min(slotFormat.GetBytes(), (size_t)m_Header->frameBytes);
+				memcpy(frame, (unsigned char*)slot + HeaderBytes, std::min(frameBytes, slotBytes));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot->sequence.load(std::memory_order_relaxed) == before)
+				{
+					sequence = latest;
+					format = slotFormat;
+
+					int64_t latency = Now() - timestamp;
+					m_ReadCount++;
+					m_TotalLatencyNanoseconds += (double)latency;
+					m_MaxLatencyNanoseconds = std::max(m_MaxLatencyNanoseconds, latency);
+					return true;
+				}
+			}
+
+			// overwritten while we were copying, the producer has moved on so try the latest again, giving it the core
+			// in case it's sharing ours. A producer lapping the ring faster than we can copy a frame out isn't going
+			// to let us have one, so don't keep trying
+			if (++tornReads < MaxTornReads && Now() < deadline)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			return false;
+		}
+
+		int64_t remaining = deadline - Now();
+		if (remaining <= 0)
+			return false;
+		WaitForFrame(sequence, (int)std::min<int64_t>(remaining / 1000000 + 1, timeoutMs));
+	}
+}
+
+unsigned char* SharedFrameRing::Slot(uint64_t sequence) const
+{
+	return (unsigned char*)m_Header + HeaderBytes + (sequence % m_Header->slotCount) * m_Header->slotStride;
+}
+
+bool SharedFrameRing::Map(const char* name, size_t bytes, bool create)
+{
+#ifdef _WIN32
+	std::string mappingName = std::string("Local\\") + name;
+	if (create)
+		m_Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, mappingName.c_str());
+	else
+		m_Mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, mappingName.c_str());
+	if (!m_Mapping)
+		return false;
+
+	// a reader maps the whole section, whatever size the producer made it
+	m_Header = (RingHeader*)MapViewOfFile(m_Mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, bytes);
+	if (!m_Header)
+	{
+		Close();
+		return false;
+	}
+
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(m_Header, &info, sizeof(info));
+	m_MappedBytes = create ? bytes : info.RegionSize;
+#else
+	std::string shmName = std::string("/") + name;
+	int fd = create ? shm_open(shmName.c_str(), O_CREAT | O_RDWR, 0600) : shm_open(shmName.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if ((create && ftruncate(fd, bytes) != 0) || fstat(fd, &info) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	bytes = (size_t)info.st_size;
+
+	void* view = mmap(NULL, bytes, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+	m_Header = (RingHeader*)view;
+	m_MappedBytes = bytes;
+#endif
+	return true;
+}
+
+void SharedFrameRing::OpenEvents(const char* name)
+{
+#ifdef _WIN32
+	for (int i = 0; i < 2; i++)
+	{
+		std::string eventName = std::string("Local\\") + name + "-frame" + std::to_string(i);
+		m_FrameEvents[i] = CreateEventA(NULL, TRUE, FALSE, eventName.c_str());
+	}
+#else
+	(void)name;
+#endif
+}
+
+void SharedFrameRing::WaitForFrame(uint64_t sequence, int timeoutMs)
+{
+#ifdef _WIN32
+	// wake up every few ms regardless, in case the events were toggled past us
+	if (m_FrameEvents[0] && m_FrameEvents[1])
+	{
+		WaitForSingleObject(m_FrameEvents[(sequence + 1) % 2], (DWORD)std::min(timeoutMs, 5));
+		return;
+	}
+	Sleep(1);
+#else
+	(void)sequence;
+	(void)timeoutMs;
+	std::this_thread::sleep_for(std::chrono::microseconds(500));
+#endif
+}
+
+int64_t SharedFrameRing::Now()
+{
+	// QueryPerformanceCounter / CLOCK_MONOTONIC underneath, both comparable between processes
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
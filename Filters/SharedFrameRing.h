@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// the size of a frame in the ring, which can change from frame to frame (the producer's output is resized)
+struct SharedFrameFormat
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytesPerPixel;
+	size_t GetBytes() const { return (size_t)width * height * bytesPerPixel; }
+	bool operator==(const SharedFrameFormat& other) const { return width == other.width && height == other.height && bytesPerPixel == other.bytesPerPixel; }
+};
+
+// Ring of finished output frames in named shared memory, so that every process with the filter loaded can show the
+// one RealSense pipeline. One producer (whoever wins TryLockProducer) renders straight into the slots; any number of
+// readers copy out the latest frame.
+// Each slot carries a sequence number used as a seqlock: the producer zeroes it before writing the slot and stores
+// the frame's sequence number after, a reader copies the slot and keeps the copy only if the sequence number was the
+// same before and after. The slots are sized for the largest frame the producer will write, and each frame's size goes
+// in its slot's header, so there is one ring per camera whatever size the producer (or any reader) is connected at.
+// The ring is a file mapping on Windows and POSIX shared memory elsewhere. The producer marks the ring closed when it
+// goes, and removes the shared memory's name, so readers let go of it and pick up the next producer's ring.
+class SharedFrameRing
+{
+public:
+	SharedFrameRing();
+	~SharedFrameRing();
+
+	// process-wide producer election via an exclusive lock file, released by UnlockProducer or when the process dies
+	bool TryLockProducer(const char* name);
+	void UnlockProducer();
+	bool IsProducer() const { return m_ProducerLock != InvalidLock; }
+
+	// producer: create (or take over) the ring with slotCount slots of up to maxFrameBytes each
+	bool Create(const char* name, size_t maxFrameBytes, int slotCount);
+	// reader: map a ring created by a producer, fails if there isn't one yet (or its producer has closed it)
+	bool Open(const char* name);
+	// the producer's Close closes the ring for its readers too
+	void Close();
+	bool IsOpen() const { return m_Header != nullptr; }
+
+	// producer: BeginWrite returns the next slot to render into (of GetMaxFrameBytes), EndWrite publishes it
+	unsigned char* BeginWrite();
+	void EndWrite(const SharedFrameFormat& format);
+	size_t GetMaxFrameBytes() const { return m_Header ? (size_t)m_Header->frameBytes : 0; }
+
+	// reader: the size of the latest frame (all 0 before the first one), to pick a buffer to Read it into
+	SharedFrameFormat GetLatestFormat() const;
+	// reader: wait up to timeoutMs for a frame newer than sequence, copy it into frame (up to frameBytes of it) and
+	// update sequence and format. Sequence 0 takes whatever the latest frame is. A ring its producer has closed is
+	// closed here as well, so the next Open finds the new producer's
+	bool Read(unsigned char* frame, size_t frameBytes, uint64_t& sequence, int timeoutMs, SharedFrameFormat& format);
+
+	// reader latency (publish to copy-out), in microseconds
+	unsigned int GetReadCount() const { return m_ReadCount; }
+	double GetAverageLatencyMicroseconds() const { return m_ReadCount ? m_TotalLatencyNanoseconds / 1000.0 / m_ReadCount : 0.0; }
+	double GetMaxLatencyMicroseconds() const { return m_MaxLatencyNanoseconds / 1000.0; }
+
+private:
+	static const uint32_t Magic = 0x56435246;	// "VCRF"
+	static const uint32_t Version = 2;
+	static const size_t HeaderBytes = 64;
+	static const int MaxTornReads = 8;		// copies overwritten under a reader before it gives up on the frame
+
+	struct RingHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t slotCount;
+		std::atomic<uint32_t> closed;		// set by the producer's Close
+		uint64_t frameBytes;				// the most a slot holds
+		uint64_t slotStride;
+		std::atomic<uint64_t> latestSequence;	// 0 until the first frame
+	};
+
+	struct SlotHeader
+	{
+		std::atomic<uint64_t> sequence;		// 0 while being written
+		int64_t timestamp;					// steady clock nanoseconds at publish
+		SharedFrameFormat format;
+	};
+
+#ifdef _WIN32
+	typedef void* LockHandle;
+	static constexpr LockHandle InvalidLock = nullptr;
+	void* m_Mapping;
+	void* m_FrameEvents[2];					// manual reset, alternately signalled by odd and even frames
+#else
+	typedef int LockHandle;
+	static constexpr LockHandle InvalidLock = -1;
+#endif
+	LockHandle m_ProducerLock;
+	std::string m_CreatedName;				// the producer's ring, empty for a reader
+	RingHeader* m_Header;
+	size_t m_MappedBytes;
+	uint64_t m_WriteSequence;				// sequence of the slot being written
+
+	unsigned int m_ReadCount;
+	double m_TotalLatencyNanoseconds;
+	int64_t m_MaxLatencyNanoseconds;
+
+	unsigned char* Slot(uint64_t sequence) const;
+	bool Map(const char* name, size_t bytes, bool create);
+	void OpenEvents(const char* name);
+	void WaitForFrame(uint64_t sequence, int timeoutMs);
+	static int64_t Now();
+};
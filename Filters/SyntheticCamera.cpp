@@ -0,0 +1,114 @@
+#include "SyntheticCamera.h"
+
+#include <chrono>
+
+const char* const SyntheticCamera::SerialNumber = "000000000001";
+
+SyntheticCamera::SyntheticCamera(bool depth, bool infrared, rs2_format colorFormat) :
+	m_DepthSensor(m_Device.add_sensor("Stereo Module")), m_ColorSensor(m_Device.add_sensor("RGB Camera")), m_ColorBytesPerPixel(colorFormat == RS2_FORMAT_RGBA8 ? 4 : colorFormat == RS2_FORMAT_YUYV ? 2 : 3), m_Running(false)
+{
+	m_Device.register_info(RS2_CAMERA_INFO_SERIAL_NUMBER, SerialNumber);
+
+	// no distortion, so the point cloud is the plain pinhole deprojection
+	rs2_intrinsics depthIntrinsics = { DepthWidth, DepthHeight, DepthWidth / 2.0f, DepthHeight / 2.0f, DepthFocalLength, DepthFocalLength, RS2_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+	rs2_intrinsics colorIntrinsics = { ColorWidth, ColorHeight, ColorWidth / 2.0f, ColorHeight / 2.0f, ColorFocalLength, ColorFocalLength, RS2_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+
+	if (depth)
+	{
+		m_DepthProfile = m_DepthSensor.add_video_stream({ RS2_STREAM_DEPTH, 0, 0, DepthWidth, DepthHeight, FrameRate, 2, RS2_FORMAT_Z16, depthIntrinsics });
+		m_DepthSensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, DepthUnits);
+	}
+	if (infrared)
+		m_InfraredProfile = m_DepthSensor.add_video_stream({ RS2_STREAM_INFRARED, 1, 1, DepthWidth, DepthHeight, FrameRate, 1, RS2_FORMAT_Y8, depthIntrinsics });
+	if (colorFormat != RS2_FORMAT_ANY)
+		m_ColorProfile = m_ColorSensor.add_video_stream({ RS2_STREAM_COLOR, 0, 2, ColorWidth, ColorHeight, FrameRate, m_ColorBytesPerPixel, colorFormat, colorIntrinsics });
+
+	// the color camera sits to the side of the depth camera, infrared is the depth camera's own
+	rs2_extrinsics identity = { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } };
+	rs2_extrinsics depthToColor = { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { ColorBaseline, 0, 0 } };
+	if (m_DepthProfile && m_InfraredProfile)
+		m_DepthProfile.register_extrinsics_to(m_InfraredProfile, identity);
+	if (m_DepthProfile && m_ColorProfile)
+		m_DepthProfile.register_extrinsics_to(m_ColorProfile, depthToColor);
+
+	// frames with the same timestamp come out of the pipeline as one frameset
+	m_Device.create_matcher(RS2_MATCHER_DEFAULT);
+	m_Device.add_to(m_Context);
+}
+
+SyntheticCamera::~SyntheticCamera()
+{
+	Stop();
+}
+
+void SyntheticCamera::Start()
+{
+	if (m_Running)
+		return;
+
+	m_Running = true;
+	m_Thread = std::thread(&SyntheticCamera::FrameLoop, this);
+}
+
+void SyntheticCamera::Stop()
+{
+	m_Running = false;
+	if (m_Thread.joinable())
+		m_Thread.join();
+}
+
+/// <summary>
+/// push a frame to each stream at the sensor's frame rate until stopped.
+/// librealsense drops the frames of streams that aren't open yet.
+/// </summary>
+void SyntheticCamera::FrameLoop()
+{
+	auto interval = std::chrono::microseconds(1000000 / FrameRate);
+	auto nextFrameTime = std::chrono::steady_clock::now();
+	for (int frameNumber = 1; m_Running; frameNumber++)
+	{
+		try
+		{
+			if (m_DepthProfile)
+			{
+				uint8_t* depth = new uint8_t[DepthWidth * DepthHeight * 2];
+				FillDepth((uint16_t*)depth, frameNumber);
+				PushFrame(m_DepthSensor, m_DepthProfile, depth, DepthWidth * 2, 2, frameNumber);
+			}
+			if (m_InfraredProfile)
+			{
+				uint8_t* infrared = new uint8_t[DepthWidth * DepthHeight];
+				FillInfrared(infrared, frameNumber);
+				PushFrame(m_DepthSensor, m_InfraredProfile, infrared, DepthWidth, 1, frameNumber);
+			}
+			if (m_ColorProfile)
+			{
+				uint8_t* color = new uint8_t[ColorWidth * ColorHeight * m_ColorBytesPerPixel];
+				FillColor(color, m_ColorBytesPerPixel, frameNumber);
+				PushFrame(m_ColorSensor, m_ColorProfile, color, ColorWidth * m_ColorBytesPerPixel, m_ColorBytesPerPixel, frameNumber);
+			}
+		}
+		catch (const std::exception&)
+		{
+			// the sensors are being stopped or started under us, just carry on with the next frame
+		}
+
+		nextFrameTime += interval;
+		std::this_thread::sleep_until(nextFrameTime);
+	}
+}
+
+void SyntheticCamera::PushFrame(rs2::software_sensor& sensor, const rs2::stream_profile& profile, uint8_t* pixels, int stride, int bytesPerPixel, int frameNumber)
+{
+	rs2_software_video_frame frame = {};
+	frame.pixels = pixels;
+	frame.deleter = [](void* pixels) { delete[] (uint8_t*)pixels; };
+	frame.stride = stride;
+	frame.bpp = bytesPerPixel;
+	frame.timestamp = frameNumber * 1000.0 / FrameRate;
+	frame.domain = RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK;
+	frame.frame_number = frameNumber;
+	frame.profile = profile.get();
+	frame.depth_units = DepthUnits;
+	sensor.on_video_frame(frame);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <librealsense2/rs.hpp>
+#include <librealsense2/hpp/rs_internal.hpp>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "SyntheticScene.h"
+
+// Stand-in for a RealSense camera, for running the capture path without one (the benchmark).
+// A librealsense software device with the same depth (Z16 320x240), infrared (Y8 320x240) and color (640x480)
+// streams RealSenseCam asks for, fed at 30 fps from a thread with SyntheticScene's moving scene, so that every frame
+// differs (dirty frame detection never gets to skip anything) and the same frame number is always the same frame.
+// Only librealsense is used, nothing platform specific.
+class SyntheticCamera : public SyntheticScene
+{
+public:
+	// colorFormat is RGB8, RGBA8 or YUYV, or ANY for no color stream
+	SyntheticCamera(bool depth, bool infrared, rs2_format colorFormat);
+	~SyntheticCamera();
+
+	// the context holding the device, and its serial number for rs2::config::enable_device
+	const rs2::context& GetContext() const { return m_Context; }
+	std::string GetSerialNumber() const { return SerialNumber; }
+
+	// start/stop pushing frames, whether or not the device's streams have been opened yet
+	void Start();
+	void Stop();
+
+private:
+	static const char* const SerialNumber;
+
+	rs2::context m_Context;
+	rs2::software_device m_Device;
+	rs2::software_sensor m_DepthSensor;		// depth and infrared, like the stereo module
+	rs2::software_sensor m_ColorSensor;
+	rs2::stream_profile m_DepthProfile;		// empty for the streams we don't have
+	rs2::stream_profile m_InfraredProfile;
+	rs2::stream_profile m_ColorProfile;
+	int m_ColorBytesPerPixel;
+
+	std::atomic<bool> m_Running;
+	std::thread m_Thread;
+
+	void FrameLoop();
+	void PushFrame(rs2::software_sensor& sensor, const rs2::stream_profile& profile, uint8_t* pixels, int stride, int bytesPerPixel, int frameNumber);
+};
@@ -0,0 +1,134 @@
+#include "SyntheticScene.h"
+
+#include <cmath>
+
+const float SyntheticScene::DepthUnits = 0.001f;
+const float SyntheticScene::DepthFocalLength = 190.0f;
+const float SyntheticScene::ColorFocalLength = 380.0f;
+const float SyntheticScene::ColorBaseline = 0.015f;
+
+// the ball goes from side to side every 3 seconds, the stripes scroll 2 pixels a frame
+static const int BallPeriodFrames = 90;
+static const int BallRadius = 50;				// in depth pixels
+static const int StripeWidth = 16;
+
+static int BallCenterX(int frameNumber)
+{
+	return SyntheticScene::DepthWidth / 2 + (int)(90.0 * sin(frameNumber * 6.2831853 / BallPeriodFrames));
+}
+
+// distance from the ball's center squared, for a point in depth pixels
+static int BallDistanceSquared(int x, int y, int frameNumber)
+{
+	int dx = x - BallCenterX(frameNumber);
+	int dy = y - SyntheticScene::DepthHeight / 2;
+	return dx * dx + dy * dy;
+}
+
+void SyntheticScene::FillDepth(uint16_t* depth, int frameNumber)
+{
+	const int ballDepth = 750;
+	for (int y = 0; y < DepthHeight; y++)
+	{
+		// the wall is 1.1m away in the middle, leaning back towards the top
+		uint16_t wallDepth = (uint16_t)(1100 + (DepthHeight / 2 - y) * 3 / 2);
+		for (int x = 0; x < DepthWidth; x++)
+		{
+			int distanceSquared = BallDistanceSquared(x, y, frameNumber);
+			if (distanceSquared < BallRadius * BallRadius)
+				depth[y * DepthWidth + x] = (uint16_t)(ballDepth - (int)(3.0 * sqrt((double)(BallRadius * BallRadius - distanceSquared))));
+			else
+				depth[y * DepthWidth + x] = wallDepth;
+		}
+	}
+}
+
+void SyntheticScene::FillInfrared(uint8_t* infrared, int frameNumber)
+{
+	for (int y = 0; y < DepthHeight; y++)
+	{
+		for (int x = 0; x < DepthWidth; x++)
+		{
+			bool ball = BallDistanceSquared(x, y, frameNumber) < BallRadius * BallRadius;
+			bool stripe = ((x + 2 * frameNumber) / StripeWidth) % 2 == 0;
+			infrared[y * DepthWidth + x] = ball ? 230 : stripe ? 170 : 80;
+		}
+	}
+}
+
+static void ColorAt(int x, int y, int frameNumber, uint8_t* rgb)
+{
+	// the color camera has twice the resolution over about the same field of view
+	bool ball = BallDistanceSquared(x / 2, y / 2, frameNumber) < BallRadius * BallRadius;
+	bool stripe = ((x / 2 + 2 * frameNumber) / StripeWidth) % 2 == 0;
+	rgb[0] = ball ? 220 : stripe ? 200 : 60;
+	rgb[1] = ball ? 40 : (uint8_t)(y * 255 / SyntheticScene::ColorHeight);
+	rgb[2] = ball ? 40 : (uint8_t)(x * 255 / SyntheticScene::ColorWidth);
+}
+
+// BT.601 studio range, as the sensor sends it
+static uint8_t Luma(const uint8_t* rgb)
+{
+	return (uint8_t)((66 * rgb[0] + 129 * rgb[1] + 25 * rgb[2] + 128) / 256 + 16);
+}
+
+void SyntheticScene::FillColor(uint8_t* color, int bytesPerPixel, int frameNumber)
+{
+	for (int y = 0; y < ColorHeight; y++)
+	{
+		uint8_t* row = color + (size_t)y * ColorWidth * bytesPerPixel;
+		if (bytesPerPixel == 2)
+		{
+			// YUYV: two pixels to a macropixel, sharing their averaged chroma
+			for (int x = 0; x < ColorWidth; x += 2)
+			{
+				uint8_t left[3], right[3];
+				ColorAt(x, y, frameNumber, left);
+				ColorAt(x + 1, y, frameNumber, right);
+				int r = left[0] + right[0], g = left[1] + right[1], b = left[2] + right[2];
+				uint8_t* macropixel = row + 2 * x;
+				macropixel[0] = Luma(left);
+				macropixel[1] = (uint8_t)((-38 * r - 74 * g + 112 * b + 256) / 512 + 128);
+				macropixel[2] = Luma(right);
+				macropixel[3] = (uint8_t)((112 * r - 94 * g - 18 * b + 256) / 512 + 128);
+			}
+			continue;
+		}
+		for (int x = 0; x < ColorWidth; x++)
+		{
+			uint8_t* pixel = row + x * bytesPerPixel;
+			ColorAt(x, y, frameNumber, pixel);
+			if (bytesPerPixel == 4)
+				pixel[3] = 255;
+		}
+	}
+}
+
+void SyntheticScene::FillPoints(float* xyz, float* uv, bool mapToColor, int frameNumber)
+{
+	uint16_t* depth = new uint16_t[DepthWidth * DepthHeight];
+	FillDepth(depth, frameNumber);
+	for (int y = 0; y < DepthHeight; y++)
+	{
+		for (int x = 0; x < DepthWidth; x++)
+		{
+			// pinhole deprojection of the pixel's centre, then projection into the texture's camera
+			int i = y * DepthWidth + x;
+			float z = depth[i] * DepthUnits;
+			xyz[3 * i] = (x - DepthWidth / 2.0f) / DepthFocalLength * z;
+			xyz[3 * i + 1] = (y - DepthHeight / 2.0f) / DepthFocalLength * z;
+			xyz[3 * i + 2] = z;
+			if (mapToColor)
+			{
+				uv[2 * i] = (ColorFocalLength * (xyz[3 * i] + ColorBaseline) / z + ColorWidth / 2.0f) / ColorWidth;
+				uv[2 * i + 1] = (ColorFocalLength * xyz[3 * i + 1] / z + ColorHeight / 2.0f) / ColorHeight;
+			}
+			else
+			{
+				uv[2 * i] = (x + 0.5f) / DepthWidth;
+				uv[2 * i + 1] = (y + 0.5f) / DepthHeight;
+			}
+		}
+	}
+	delete[] depth;
+}
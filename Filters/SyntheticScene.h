@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// The deterministic moving scene SyntheticCamera streams: a ball sweeping across in front of a tilted wall, with a
+// striped texture that scrolls. Any frame of it can be made on its own, without librealsense, so the golden image
+// check and the tests get exactly the frames the camera would have sent.
+class SyntheticScene
+{
+public:
+	static const int DepthWidth = 320;
+	static const int DepthHeight = 240;
+	static const int ColorWidth = 640;
+	static const int ColorHeight = 480;
+	static const int FrameRate = 30;
+	static const float DepthUnits;				// meters
+	static const float DepthFocalLength;		// pixels, both streams centred and undistorted
+	static const float ColorFocalLength;
+	static const float ColorBaseline;			// meters from the depth camera along x
+
+	// the scene at a given frame
+	static void FillDepth(uint16_t* depth, int frameNumber);
+	static void FillInfrared(uint8_t* infrared, int frameNumber);
+	// bytesPerPixel 3 or 4 for RGB8/RGBA8, 2 for YUYV
+	static void FillColor(uint8_t* color, int bytesPerPixel, int frameNumber);
+	// the points rs2::pointcloud makes from FillDepth's frame: xyz and uv (into the infrared frame, or the color frame if mapToColor)
+	static void FillPoints(float* xyz, float* uv, bool mapToColor, int frameNumber);
+};
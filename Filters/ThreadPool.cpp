@@ -0,0 +1,214 @@
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+
+ThreadPool::ThreadPool() : m_Generation(0), m_Stopping(false), m_JobFunction(nullptr), m_JobContext(nullptr), m_RemainingTasks(0)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+	Stop();
+}
+
+void ThreadPool::Start(int threadCount, bool pinThreads)
+{
+	Stop();
+
+	int coreCount = std::max(1, (int)std::thread::hardware_concurrency());
+	if (threadCount <= 0)
+		threadCount = coreCount;
+
+	m_Stopping = false;
+	for (int i = 0; i < threadCount; ++i)
+		m_Queues.push_back(new TaskQueue());
+
+	// queue 0 belongs to whichever thread calls ParallelFor, the workers get the rest
+	for (int i = 1; i < threadCount; ++i)
+	{
+		m_Workers.emplace_back([this, i, pinThreads]()
+			{
+				if (pinThreads)
+					PinCurrentThread(i);
+				WorkerLoop(i);
+			});
+	}
+}
+
+void ThreadPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_WakeLock);
+		m_Stopping = true;
+	}
+	m_WakeCondition.notify_all();
+
+	for (auto& worker : m_Workers)
+		worker.join();
+	m_Workers.clear();
+
+	for (auto queue : m_Queues)
+		delete queue;
+	m_Queues.clear();
+}
+
+void ThreadPool::Run(int rowBegin, int rowEnd, int minRowsPerTask, JobFunction function, const void* context)
+{
+	int rows = rowEnd - rowBegin;
+	if (rows <= 0)
+		return;
+
+	int threadCount = (int)m_Queues.size();
+	std::unique_lock<std::mutex> job(m_JobLock, std::try_to_lock);
+	if (threadCount <= 1 || rows <= minRowsPerTask || !job.owns_lock())
+	{
+		function(context, rowBegin, rowEnd);
+		return;
+	}
+
+	// a few tasks per thread so there is something left to steal when the threads run unevenly
+	int taskCount = std::min(threadCount * TasksPerThread, (rows + minRowsPerTask - 1) / std::max(1, minRowsPerTask));
+	int rowsPerTask = (rows + taskCount - 1) / taskCount;
+	taskCount = (rows + rowsPerTask - 1) / rowsPerTask;
+
+	m_JobFunction = function;
+	m_JobContext = context;
+	m_RemainingTasks = taskCount;
+	for (int t = 0; t < taskCount; ++t)
+	{
+		int begin = rowBegin + t * rowsPerTask;
+		TaskQueue* queue = m_Queues[t % threadCount];
+		std::lock_guard<std::mutex> lock(queue->lock);
+		queue->tasks[(queue->head + queue->count) % TasksPerThread] = { begin, std::min(rowEnd, begin + rowsPerTask) };
+		++queue->count;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_WakeLock);
+		++m_Generation;
+	}
+	m_WakeCondition.notify_all();
+
+	// work alongside the pool, then wait for any tasks still running on the workers
+	while (RunOneTask(0))
+		;
+
+	std::unique_lock<std::mutex> lock(m_WakeLock);
+	m_DoneCondition.wait(lock, [this]() { return m_RemainingTasks == 0; });
+	m_JobFunction = nullptr;
+	m_JobContext = nullptr;
+}
+
+void ThreadPool::WorkerLoop(int queueIndex)
+{
+	unsigned int seenGeneration = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_WakeLock);
+			m_WakeCondition.wait(lock, [this, seenGeneration]() { return m_Stopping || m_Generation != seenGeneration; });
+			if (m_Stopping)
+				return;
+			seenGeneration = m_Generation;
+		}
+
+		while (RunOneTask(queueIndex))
+			;
+	}
+}
+
+bool ThreadPool::RunOneTask(int queueIndex)
+{
+	Task task;
+	if (!PopTask(queueIndex, task))
+		return false;
+
+	// a task can only exist while its job is running, so the job is still valid here
+	m_JobFunction(m_JobContext, task.begin, task.end);
+
+	if (--m_RemainingTasks == 0)
+	{
+		std::lock_guard<std::mutex> lock(m_WakeLock);
+		m_DoneCondition.notify_all();
+	}
+	return true;
+}
+
+bool ThreadPool::PopTask(int queueIndex, Task& task)
+{
+	// own queue first, from the front
+	{
+		TaskQueue* own = m_Queues[queueIndex];
+		std::lock_guard<std::mutex> lock(own->lock);
+		if (own->count > 0)
+		{
+			task = own->tasks[own->head];
+			own->head = (own->head + 1) % TasksPerThread;
+			--own->count;
+			return true;
+		}
+	}
+
+	// then steal from the back of everybody else's
+	int queueCount = (int)m_Queues.size();
+	for (int i = 1; i < queueCount; ++i)
+	{
+		TaskQueue* victim = m_Queues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(victim->lock);
+		if (victim->count > 0)
+		{
+			--victim->count;
+			task = victim->tasks[(victim->head + victim->count) % TasksPerThread];
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::PinCurrentThread(int index)
+{
+	// the index'th of the cores the process is allowed on (round again if there are fewer), so a host app's
+	// affinity mask is respected. Left alone if the mask can't be read
+#ifdef _WIN32
+	DWORD_PTR processMask, systemMask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) || processMask == 0)
+		return;
+	const int maskBits = (int)sizeof(DWORD_PTR) * 8;
+	int allowed = 0;
+	for (int bit = 0; bit < maskBits; ++bit)
+		allowed += (processMask >> bit) & 1;
+	int skip = index % allowed;
+	for (int bit = 0; bit < maskBits; ++bit)
+	{
+		if (((processMask >> bit) & 1) && skip-- == 0)
+		{
+			SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << bit);
+			return;
+		}
+	}
+#else
+	cpu_set_t processSet;
+	if (sched_getaffinity(0, sizeof(processSet), &processSet) != 0 || CPU_COUNT(&processSet) == 0)
+		return;
+	int skip = index % CPU_COUNT(&processSet);
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+	{
+		if (CPU_ISSET(cpu, &processSet) && skip-- == 0)
+		{
+			cpu_set_t cpuSet;
+			CPU_ZERO(&cpuSet);
+			CPU_SET(cpu, &cpuSet);
+			pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+			return;
+		}
+	}
+#endif
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small work-stealing thread pool shared by the per-frame kernels (format conversion, vertex clipping etc.)
+// Work is submitted as a range of rows which is cut into tasks and dealt out to per-thread queues,
+// idle threads then steal from the back of the other queues. The calling (streaming) thread also takes
+// part, so a pool started with a single thread degenerates to a plain loop on the caller.
+class ThreadPool
+{
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	// threadCount includes the calling thread; 0 means one per logical core
+	// pinThreads sets the affinity of each worker to its own core of the process's affinity mask (the caller is left alone)
+	void Start(int threadCount, bool pinThreads);
+	void Stop();
+	int GetThreadCount() const { return (int)m_Queues.size(); }
+
+	// Calls fn(begin, end) over [rowBegin, rowEnd) in chunks of at least minRowsPerTask rows and returns
+	// once every row has been processed. If another ParallelFor is already running (e.g. from another
+	// thread) the rows are just processed on the calling thread.
+	// fn is called through a plain function pointer and context rather than a std::function so that
+	// submitting a job never touches the heap.
+	template <typename Fn>
+	void ParallelFor(int rowBegin, int rowEnd, int minRowsPerTask, const Fn& fn)
+	{
+		Run(rowBegin, rowEnd, minRowsPerTask, [](const void* context, int begin, int end) { (*static_cast<const Fn*>(context))(begin, end); }, &fn);
+	}
+
+private:
+	typedef void (*JobFunction)(const void* context, int begin, int end);
+	static const int TasksPerThread = 4;	// tasks dealt to each queue per job, so there is something left to steal
+
+	struct Task
+	{
+		int begin;
+		int end;
+	};
+
+	// fixed size deque: the owner pops from the front, thieves from the back
+	struct TaskQueue
+	{
+		std::mutex lock;
+		Task tasks[TasksPerThread];
+		int head = 0;
+		int count = 0;
+	};
+
+	std::vector<std::thread> m_Workers;
+	std::vector<TaskQueue*> m_Queues;		// one per worker plus one (index 0) for the calling thread
+	std::mutex m_JobLock;					// one ParallelFor at a time
+	std::mutex m_WakeLock;
+	std::condition_variable m_WakeCondition;
+	std::condition_variable m_DoneCondition;
+	unsigned int m_Generation;				// bumped for each job so sleeping workers know to wake up
+	bool m_Stopping;
+	JobFunction m_JobFunction;
+	const void* m_JobContext;
+	std::atomic<int> m_RemainingTasks;
+
+	void Run(int rowBegin, int rowEnd, int minRowsPerTask, JobFunction function, const void* context);
+	void WorkerLoop(int queueIndex);
+	bool RunOneTask(int queueIndex);
+	bool PopTask(int queueIndex, Task& task);
+	static void PinCurrentThread(int index);
+};
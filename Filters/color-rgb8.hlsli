@@ -0,0 +1,26 @@
+/* RGB8 color frame in a raw buffer, 3 bytes per texel and tightly packed (no per pixel expansion to RGBA on the CPU).
+   Filtered here the same way as the MIN_MAG_MIP_LINEAR, clamped sampler does for the textures of the other formats */
+ByteAddressBuffer colorBuffer : register(t0);
+cbuffer color_buffer_size : register(b0) {
+    uint2 colorSize;    // texels
+};
+
+float3 LoadRgb(uint2 texel) {
+    // raw loads are 32 bit aligned, so take the two words the texel's 3 bytes fall in
+    uint offset = 3 * (texel.y * colorSize.x + texel.x);
+    uint2 words = colorBuffer.Load2(offset & ~3u);
+    uint shift = (offset & 3) * 8;
+    uint rgb = shift == 0 ? words.x : (words.x >> shift) | (words.y << (32 - shift));
+    return float3(rgb & 0xff, (rgb >> 8) & 0xff, (rgb >> 16) & 0xff) / 255.0;
+}
+
+float4 SampleRgb(float2 uv) {
+    float2 pos = uv * colorSize - 0.5;
+    float2 f = frac(pos);
+    int2 maxTexel = (int2)colorSize - 1;
+    uint2 a = (uint2)clamp((int2)floor(pos), 0, maxTexel);
+    uint2 b = (uint2)clamp((int2)floor(pos) + 1, 0, maxTexel);
+    float3 top = lerp(LoadRgb(uint2(a.x, a.y)), LoadRgb(uint2(b.x, a.y)), f.x);
+    float3 bottom = lerp(LoadRgb(uint2(a.x, b.y)), LoadRgb(uint2(b.x, b.y)), f.x);
+    return float4(lerp(top, bottom, f.y), 1.0);
+}
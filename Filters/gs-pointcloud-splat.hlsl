@@ -0,0 +1,35 @@
+cbuffer GS_CONSTANT_BUFFER : register(b0)
+{
+    float2 splatClipScale;  // splat radius per meter of depth, times the projection x and y scales
+};
+
+/* outputs from vertex shader go here */
+struct vs_out {
+    float4 position_clip : SV_POSITION;
+    float2 color_tex_uv : TEXCOORD0;
+    float depth_local : TEXCOORD1;
+};
+
+/* one corner of the splat quad, the pixel shader cuts the disc out of it */
+struct gs_out {
+    float4 position_clip : SV_POSITION;
+    float2 color_tex_uv : TEXCOORD0;
+    float2 splat_coord : TEXCOORD1;     // -1..1 across the quad
+};
+
+static const float2 corners[4] = { float2(-1, 1), float2(1, 1), float2(-1, -1), float2(1, -1) };
+
+[maxvertexcount(4)]
+void main(point vs_out input[1], inout TriangleStream<gs_out> output) {
+    // offsetting a point by r in view space x/y moves it by r times the projection scale in clip space
+    // (before the divide by w), and the radius in meters grows linearly with the point's depth
+    float2 radius_clip = splatClipScale * input[0].depth_local;
+
+    gs_out vertex = (gs_out)0;
+    vertex.color_tex_uv = input[0].color_tex_uv;
+    for (int i = 0; i < 4; i++) {
+        vertex.position_clip = input[0].position_clip + float4(corners[i] * radius_clip, 0.0, 0.0);
+        vertex.splat_coord = corners[i];
+        output.Append(vertex);
+    }
+}
@@ -0,0 +1,12 @@
+#include "color-rgb8.hlsli"
+
+/* outputs from vertex shader go here. can be interpolated to pixel shader */
+struct vs_out {
+    float4 position_clip : SV_POSITION; // required output of VS
+    float2 color_tex_uv : TEXCOORD0;
+};
+
+float4 main(vs_out input) : SV_TARGET {
+    // sample the RGB8 buffer to assign the color
+    return SampleRgb(input.color_tex_uv);
+}
@@ -0,0 +1,24 @@
+Texture2D colorTex: register(t0);
+SamplerState colorTexSampler : register(s0)
+{
+    Filter = MIN_MAG_MIP_LINEAR;
+    AddressU = Wrap;
+    AddressV = Wrap;
+};
+
+/* outputs from geometry shader go here */
+struct gs_out {
+    float4 position_clip : SV_POSITION;
+    float2 color_tex_uv : TEXCOORD0;
+    float2 splat_coord : TEXCOORD1;
+};
+
+float4 main(gs_out input) : SV_TARGET {
+    // round splats: drop the corners of the quad
+    if (dot(input.splat_coord, input.splat_coord) > 1.0)
+        discard;
+
+    // the whole splat takes the colour of its point, from the single channel (R8) IR texture
+    float grey = colorTex.Sample(colorTexSampler, input.color_tex_uv).r;
+    return float4(grey, grey, grey, 1.0);
+}
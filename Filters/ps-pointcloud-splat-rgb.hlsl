@@ -0,0 +1,17 @@
+#include "color-rgb8.hlsli"
+
+/* outputs from geometry shader go here */
+struct gs_out {
+    float4 position_clip : SV_POSITION;
+    float2 color_tex_uv : TEXCOORD0;
+    float2 splat_coord : TEXCOORD1;
+};
+
+float4 main(gs_out input) : SV_TARGET {
+    // round splats: drop the corners of the quad
+    if (dot(input.splat_coord, input.splat_coord) > 1.0)
+        discard;
+
+    // the whole splat takes the colour of its point, from the RGB8 buffer
+    return SampleRgb(input.color_tex_uv);
+}
@@ -1,28 +1,37 @@
 cbuffer VS_CONSTANT_BUFFER : register(b0)
 {
     matrix worldViewProj;
+    float depthScale;                   // meters per unit of packed depth
 }
 
+/* x/z, y/z of each depth pixel */
+Buffer<float2> depthRays : register(t0);
+
 /* vertex attributes go here to input to the vertex shader */
 struct vs_in {
-    float3 position_local : SV_POSITION;
-    float2 color_tex_uv : TEXCOORD0;
+    uint2 packed : PACKED;              // PackedVertex: uv and the pixel's high bits, depth and the pixel's low bits
 };
 
 /* outputs from vertex shader go here. can be interpolated to pixel shader */
 struct vs_out {
     float4 position_clip : SV_POSITION; // required output of VS
     float2 color_tex_uv : TEXCOORD0;
+    float depth_local : TEXCOORD1;      // sensor depth, for sizing splats in the geometry shader
 };
 
 vs_out main(vs_in input) {
-    // TODO if calculating point cloud geometry, use SV_VertexID %/div width 
-    // to compute x,y position of vertex #ID, then we only need to pass depth frame
-    // And then fill a separate color buffer as well (or texcoord and texture)
+    // unpack the vertex, its position is the depth along its pixel's ray
+    uint depth = input.packed.y & 0xffff;
+    uint pixel = (input.packed.y >> 16) | ((input.packed.x >> 28) << 16);
+    float z = depth * depthScale;
+    float3 position_local = float3(depthRays[pixel] * z, z);
 
-    // for now though just convert the inputs to float4s and transform vertex position
     vs_out output = (vs_out)0;          // zero the memory first
-    output.position_clip = mul(float4(input.position_local, 1.0), worldViewProj);
-    output.color_tex_uv = input.color_tex_uv;
+    output.position_clip = mul(float4(position_local, 1.0), worldViewProj);
+    // depth 0 is a dropped mesh vertex, a NaN position culls every triangle touching it
+    if (depth == 0)
+        output.position_clip = asfloat(0x7fc00000).xxxx;
+    output.color_tex_uv = float2(input.packed.x & 0x3fff, (input.packed.x >> 14) & 0x3fff) / 16383.0;
+    output.depth_local = z;
     return output;
 }
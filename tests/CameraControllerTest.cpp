@@ -0,0 +1,164 @@
+// CameraController: the pose in each mode, Update reporting exactly when the pose changed, and the clock making the
+// motion independent of the update rate.
+
+#include "CameraController.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <thread>
+
+using namespace DirectX;
+
+static bool Near(float a, float b, float tolerance = 1e-6f)
+{
+	return std::fabs(a - b) <= tolerance;
+}
+
+static void TestStatic()
+{
+	CameraController camera;
+	camera.SetMode(CameraMode::Static);
+	CHECK(camera.GetMode() == CameraMode::Static);
+	CHECK(camera.Update(0.0));		// the first pose is always a change
+	CHECK(!camera.Update(1.0));
+	CHECK(!camera.Update());
+	CHECK(XMVectorGetX(camera.GetEye()) == 0.0f && XMVectorGetY(camera.GetEye()) == 0.0f && XMVectorGetZ(camera.GetEye()) == 0.0f);
+
+	// changing the mode forgets the pose, so the next Update reports a change even if it lands in the same place
+	camera.SetMode(CameraMode::Static);
+	CHECK(camera.Update(2.0));
+}
+
+static void TestDrift()
+{
+	// the orbit: radius 0.2 m round (0, -0.2, 0), once every 4 pi seconds
+	CameraController camera;
+	CHECK(camera.GetMode() == CameraMode::Drift);
+	double maxError = 0.0;
+	for (int i = 0; i < 2000; i++)
+	{
+		double time = i * 0.0137;
+		camera.Update(time);
+		float x = (float)std::sin(time / 2.0) / 5.0f;
+		float y = -0.2f + (float)std::cos(time / 2.0) / 5.0f;
+		maxError = std::fmax(maxError, std::fmax(std::fabs(XMVectorGetX(camera.GetEye()) - x), std::fabs(XMVectorGetY(camera.GetEye()) - y)));
+		CHECK(XMVectorGetZ(camera.GetEye()) == 0.0f);
+	}
+	printf("drift: %.2e m from the exact circle at most\n", maxError);
+	CHECK(maxError < 1e-4);
+
+	// a moving camera changes every time the clock does, and not when it doesn't
+	CHECK(camera.Update(5.0));
+	CHECK(!camera.Update(5.0));
+	CHECK(camera.Update(5.01));
+
+	// a clock that's been running for days is still on the circle, and the end of the period wraps round
+	camera.Update(1.0e6);
+	CHECK(std::isfinite(XMVectorGetX(camera.GetEye())));
+	camera.Update(4.0 * XM_PI - 1e-9);
+	CHECK(Near(XMVectorGetX(camera.GetEye()), 0.0f, 1e-4f) && Near(XMVectorGetY(camera.GetEye()), 0.0f, 1e-4f));
+}
+
+static void TestFixedTime()
+{
+	CameraController camera;
+	camera.SetFixedTime(1.0f);
+	CHECK(camera.Update());
+	CHECK(!camera.Update());
+	float x = XMVectorGetX(camera.GetEye());
+	CHECK(Near(x, (float)std::sin(0.5) / 5.0f, 1e-4f));
+
+	// Reset forgets the pose, the fixed time puts the camera back in the same place
+	camera.Reset();
+	CHECK(camera.Update());
+	CHECK(XMVectorGetX(camera.GetEye()) == x);
+}
+
+static void TestPath()
+{
+	CameraController camera;
+	camera.SetMode(CameraMode::Path);
+	CameraKeyframe keyframes[3] =
+	{
+		{ 0.0f, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+		{ 2.0f, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+		{ 4.0f, { 1.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 2.0f } },
+	};
+	camera.SetPath(keyframes, 3);
+
+	// linear between keyframes, exact on them
+	camera.Update(1.0);
+	CHECK(Near(XMVectorGetX(camera.GetEye()), 0.5f));
+	camera.Update(2.0);
+	CHECK(XMVectorGetX(camera.GetEye()) == 1.0f && XMVectorGetY(camera.GetEye()) == 0.0f);
+	camera.Update(3.0);
+	CHECK(XMVectorGetX(camera.GetEye()) == 1.0f && Near(XMVectorGetY(camera.GetEye()), 0.5f));
+
+	// and looping after the last one
+	camera.Update(5.0);
+	CHECK(Near(XMVectorGetX(camera.GetEye()), 0.5f) && XMVectorGetY(camera.GetEye()) == 0.0f);
+
+	// one keyframe holds still there, none is the static pose
+	camera.SetPath(keyframes + 1, 1);
+	CHECK(camera.Update(7.0));
+	CHECK(XMVectorGetX(camera.GetEye()) == 1.0f);
+	CHECK(!camera.Update(8.0));
+	camera.SetPath(keyframes, 0);
+	camera.Update(1.0);
+	CHECK(XMVectorGetX(camera.GetEye()) == 0.0f);
+
+	// more than MaxKeyframes keeps the first MaxKeyframes
+	CameraKeyframe many[CameraController::MaxKeyframes + 4];
+	for (int i = 0; i < CameraController::MaxKeyframes + 4; i++)
+	{
+		CameraKeyframe keyframe = { (float)i, { (float)i, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+		many[i] = keyframe;
+	}
+	camera.SetPath(many, CameraController::MaxKeyframes + 4);
+	camera.Update(CameraController::MaxKeyframes - 1.5);
+	CHECK(Near(XMVectorGetX(camera.GetEye()), CameraController::MaxKeyframes - 1.5f, 1e-5f));
+}
+
+static void TestUserPose()
+{
+	CameraController camera;
+	camera.SetMode(CameraMode::User);
+	CHECK(camera.Update(0.0));
+	CHECK(!camera.Update(1.0));
+
+	// set from another thread, picked up by the next Update
+	std::thread other([&]() { camera.SetUserPose({ 0.1f, 0.2f, 0.3f }, { 0.0f, 0.0f, 1.0f }); });
+	other.join();
+	CHECK(camera.Update(2.0));
+	CHECK(XMVectorGetY(camera.GetEye()) == 0.2f);
+	CHECK(!camera.Update(3.0));
+
+	// the view matrix takes the eye to the origin and the look at point straight ahead along +z
+	XMVECTOR eye = XMVector3TransformCoord(camera.GetEye(), camera.GetView());
+	CHECK(Near(XMVectorGetX(eye), 0.0f, 1e-5f) && Near(XMVectorGetY(eye), 0.0f, 1e-5f) && Near(XMVectorGetZ(eye), 0.0f, 1e-5f));
+	XMVECTOR lookAt = XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, 1.0f, 1.0f), camera.GetView());
+	float distance = std::sqrt(0.1f * 0.1f + 0.2f * 0.2f + 0.7f * 0.7f);
+	CHECK(Near(XMVectorGetX(lookAt), 0.0f, 1e-5f) && Near(XMVectorGetY(lookAt), 0.0f, 1e-5f) && Near(XMVectorGetZ(lookAt), distance, 1e-5f));
+}
+
+static void TestUpdateRate()
+{
+	// the same second of drift updated at 30 and 60 fps ends in the same place
+	CameraController at30, at60;
+	for (int frame = 0; frame <= 30; frame++)
+		at30.Update(frame / 30.0);
+	for (int frame = 0; frame <= 60; frame++)
+		at60.Update(frame / 60.0);
+	CHECK(XMVector3Equal(at30.GetEye(), at60.GetEye()));
+}
+
+int main()
+{
+	TestStatic();
+	TestDrift();
+	TestFixedTime();
+	TestPath();
+	TestUserPose();
+	TestUpdateRate();
+	return TestResult("CameraControllerTest");
+}
@@ -0,0 +1,113 @@
+// FrameArena hands out aligned, separate buffers from the block reserved up front, grows only when it has to, and
+// keeps count of what happened after Seal.
+
+#include "FrameArena.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+static bool IsAligned(const void* buffer)
+{
+	return ((uintptr_t)buffer & 63) == 0;
+}
+
+static void TestReservedAllocations()
+{
+	FrameArena frameArena;
+	frameArena.Reserve((size_t)1 << 20);
+	CHECK(frameArena.GetHeapAllocationCount() == 1);
+	CHECK(frameArena.GetBytesReserved() == (size_t)1 << 20);
+
+	// odd sizes still start on their own cache line, and don't overlap
+	static const size_t Sizes[] = { 1, 63, 64, 65, 1000, 4096, 12345 };
+	std::vector<unsigned char*> buffers;
+	size_t expectedBytes = 0;
+	for (size_t bytes : Sizes)
+	{
+		unsigned char* buffer = frameArena.Allocate(bytes);
+		CHECK(buffer != nullptr);
+		CHECK(IsAligned(buffer));
+		memset(buffer, (int)buffers.size() + 1, bytes);
+		buffers.push_back(buffer);
+		expectedBytes += (bytes + 63) & ~(size_t)63;
+	}
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		bool intact = true;
+		for (size_t b = 0; b < Sizes[i]; b++)
+			intact = intact && buffers[i][b] == (unsigned char)(i + 1);
+		CHECK(intact);
+	}
+	CHECK(frameArena.GetBytesAllocated() == expectedBytes);
+	CHECK(frameArena.GetAllocationCount() == sizeof(Sizes) / sizeof(Sizes[0]));
+
+	// all of that came out of the one reserved block
+	CHECK(frameArena.GetHeapAllocationCount() == 1);
+
+	float* floats = frameArena.Allocate<float>(100);
+	CHECK(IsAligned(floats));
+	CHECK(frameArena.GetHeapAllocationCount() == 1);
+}
+
+static void TestGrowth()
+{
+	FrameArena frameArena;
+	frameArena.Reserve(4096);
+	unsigned char* first = frameArena.Allocate(4096);
+	CHECK(frameArena.GetHeapAllocationCount() == 1);
+
+	// past the reservation a new block is added, at least MinBlockSize so small buffers don't each get one
+	unsigned char* second = frameArena.Allocate(100);
+	CHECK(frameArena.GetHeapAllocationCount() == 2);
+	CHECK(IsAligned(second));
+	CHECK(second < first || second >= first + 4096);
+	frameArena.Allocate(100);
+	CHECK(frameArena.GetHeapAllocationCount() == 2);
+
+	// Reserve only adds a block if what's left isn't enough
+	frameArena.Reserve(64);
+	CHECK(frameArena.GetHeapAllocationCount() == 2);
+
+	// and a buffer bigger than that gets a block of its own size
+	unsigned char* big = frameArena.Allocate((size_t)3 << 20);
+	CHECK(IsAligned(big));
+	CHECK(frameArena.GetHeapAllocationCount() == 3);
+}
+
+static void TestSealing()
+{
+	FrameArena frameArena;
+	frameArena.Reserve(1 << 16);
+	frameArena.Allocate(1000);
+	frameArena.Seal();
+	CHECK(frameArena.GetSteadyStateAllocationCount() == 0);
+
+	// a resize grows the output sized buffers with the arena unsealed, which isn't a steady-state allocation
+	frameArena.Unseal();
+	unsigned char* grown = frameArena.Allocate((size_t)2 << 20);
+	CHECK(grown != nullptr);
+	frameArena.Seal();
+	CHECK(frameArena.GetSteadyStateAllocationCount() == 0);
+	CHECK(frameArena.GetHeapAllocationCount() == 2);
+
+	// Release frees everything and starts the counts again
+	frameArena.Release();
+	CHECK(frameArena.GetHeapAllocationCount() == 0);
+	CHECK(frameArena.GetBytesReserved() == 0);
+	CHECK(frameArena.GetBytesAllocated() == 0);
+	CHECK(frameArena.GetAllocationCount() == 0);
+	CHECK(frameArena.GetSteadyStateAllocationCount() == 0);
+	frameArena.Reserve(1 << 16);
+	CHECK(IsAligned(frameArena.Allocate(10)));
+	CHECK(frameArena.GetHeapAllocationCount() == 1);
+}
+
+int main()
+{
+	TestReservedAllocations();
+	TestGrowth();
+	TestSealing();
+	return TestResult("FrameArenaTest");
+}
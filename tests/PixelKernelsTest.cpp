@@ -0,0 +1,137 @@
+// Every PixelKernels variant this CPU supports gives exactly the scalar kernels' output, for any length and alignment
+// (the SIMD loops' tails included), and a frame split into row bands on the thread pool comes out the same as whole.
+
+#include "PixelKernels.h"
+#include "ThreadPool.h"
+#include "TestCheck.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+typedef void (*Kernel)(unsigned char* dst, const unsigned char* src, int count);
+
+static std::vector<unsigned char> RandomBytes(size_t count, unsigned int seed)
+{
+	std::vector<unsigned char> bytes(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		bytes[i] = (unsigned char)(seed >> 24);
+	}
+	return bytes;
+}
+
+// run kernel and the scalar one over count units from src + srcOffset into dst + dstOffset, and compare everything,
+// including the guard bytes either side of the output
+static bool SameAsScalar(Kernel kernel, Kernel scalar, int count, int srcBytesPerUnit, int dstBytesPerUnit, int srcOffset, int dstOffset)
+{
+	const int guard = 64;
+	std::vector<unsigned char> src = RandomBytes(srcOffset + (size_t)count * srcBytesPerUnit + guard, count * 31 + srcOffset);
+	std::vector<unsigned char> expected(dstOffset + (size_t)count * dstBytesPerUnit + guard, 0xcd), actual(expected);
+	scalar(expected.data() + dstOffset, src.data() + srcOffset, count);
+	kernel(actual.data() + dstOffset, src.data() + srcOffset, count);
+	return expected == actual;
+}
+
+static void TestVariantsMatchScalar()
+{
+	const PixelKernels& scalar = PixelKernels::Get(KernelVariant::Scalar);
+	CHECK(PixelKernels::IsSupported(KernelVariant::Scalar));
+	CHECK(PixelKernels::IsSupported(PixelKernels::GetBestVariant()));
+	CHECK(&PixelKernels::GetBest() == &PixelKernels::Get(PixelKernels::GetBestVariant()));
+
+	// every length up to a few SIMD widths (so each tail length is hit), then whole rows and frames
+	std::vector<int> counts;
+	for (int count = 0; count <= 100; count++)
+		counts.push_back(count);
+	static const int LongCounts[] = { 255, 256, 257, 640, 1279, 1920, 640 * 480, 1920 * 1080 };
+	counts.insert(counts.end(), LongCounts, LongCounts + sizeof(LongCounts) / sizeof(LongCounts[0]));
+
+	for (int v = 0; v < (int)KernelVariant::Count; v++)
+	{
+		KernelVariant variant = (KernelVariant)v;
+		if (!PixelKernels::IsSupported(variant))
+		{
+			printf("%s: not supported here, skipped\n", PixelKernels::GetVariantName(variant));
+			continue;
+		}
+		const PixelKernels& kernels = PixelKernels::Get(variant);
+		int mismatches = 0;
+		for (int count : counts)
+		{
+			// aligned, and off by a byte or a few either side
+			for (int offset = 0; offset < 4; offset++)
+			{
+				int srcOffset = offset, dstOffset = (3 * offset) % 4;
+				mismatches += !SameAsScalar(kernels.RgbaToBgr, scalar.RgbaToBgr, count, 4, 3, srcOffset, dstOffset);
+				mismatches += !SameAsScalar(kernels.ReverseToGrey, scalar.ReverseToGrey, count, 1, 3, srcOffset, dstOffset);
+				mismatches += !SameAsScalar(kernels.ReverseBytes, scalar.ReverseBytes, count, 1, 1, srcOffset, dstOffset);
+				if (count % 2 == 0)
+					mismatches += !SameAsScalar(kernels.MirrorYuy2, scalar.MirrorYuy2, count, 2, 2, srcOffset, dstOffset);
+			}
+		}
+		printf("%s: %d mismatches\n", PixelKernels::GetVariantName(variant), mismatches);
+		CHECK(mismatches == 0);
+	}
+}
+
+// the scalar kernels themselves, on something small enough to write out
+static void TestScalarReference()
+{
+	const PixelKernels& scalar = PixelKernels::Get(KernelVariant::Scalar);
+	const unsigned char rgba[8] = { 1, 2, 3, 255, 4, 5, 6, 255 };
+	unsigned char bgr[6];
+	scalar.RgbaToBgr(bgr, rgba, 2);
+	const unsigned char expectedBgr[6] = { 3, 2, 1, 6, 5, 4 };
+	CHECK(memcmp(bgr, expectedBgr, 6) == 0);
+
+	const unsigned char grey[2] = { 10, 20 };
+	unsigned char reversedGrey[6];
+	scalar.ReverseToGrey(reversedGrey, grey, 2);
+	const unsigned char expectedGrey[6] = { 20, 20, 20, 10, 10, 10 };
+	CHECK(memcmp(reversedGrey, expectedGrey, 6) == 0);
+
+	// Y0 U Y1 V Y2 U' Y3 V' mirrored: Y3 U' Y2 V' Y1 U Y0 V
+	const unsigned char yuy2[8] = { 10, 100, 11, 200, 12, 101, 13, 201 };
+	unsigned char mirrored[8];
+	scalar.MirrorYuy2(mirrored, yuy2, 4);
+	const unsigned char expectedYuy2[8] = { 13, 101, 12, 201, 11, 100, 10, 200 };
+	CHECK(memcmp(mirrored, expectedYuy2, 8) == 0);
+}
+
+// as RealSenseCam turns frames round: row band [begin, end) of the output is the reverse of the input's mirror band
+static void TestParallelRowBands()
+{
+	const int width = 1280, height = 720, rowBytes = 3 * width;
+	std::vector<unsigned char> frame = RandomBytes((size_t)rowBytes * height, 7);
+	std::vector<unsigned char> whole(frame.size()), banded(frame.size());
+	const PixelKernels& kernels = PixelKernels::GetBest();
+	PixelKernels::Get(KernelVariant::Scalar).ReverseBytes(whole.data(), frame.data(), (int)frame.size());
+
+	static const int ThreadCounts[] = { 1, 2, 4, 7 };
+	for (int threadCount : ThreadCounts)
+	{
+		ThreadPool threadPool;
+		threadPool.Start(threadCount, false);
+		static const int RowsPerTask[] = { 1, 5, 16, 1000 };
+		for (int minRows : RowsPerTask)
+		{
+			memset(banded.data(), 0, banded.size());
+			threadPool.ParallelFor(0, height, minRows, [&](int begin, int end)
+				{
+					kernels.ReverseBytes(banded.data() + begin * rowBytes, frame.data() + (height - end) * rowBytes, (end - begin) * rowBytes);
+				});
+			CHECK(banded == whole);
+		}
+		threadPool.Stop();
+	}
+}
+
+int main()
+{
+	TestScalarReference();
+	TestVariantsMatchScalar();
+	TestParallelRowBands();
+	return TestResult("PixelKernelsTest");
+}
@@ -0,0 +1,263 @@
+// SharedFrameRing: frames and their sizes get from the producer to the readers, a reader never keeps a torn copy
+// however fast the producer laps the ring, and several readers at once see the frames promptly.
+
+#include "SharedFrameRing.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static std::string RingName(const char* test)
+{
+#ifdef _WIN32
+	return std::string("vcam-ring-test-") + test + "-" + std::to_string(GetCurrentProcessId());
+#else
+	return std::string("vcam-ring-test-") + test + "-" + std::to_string(getpid());
+#endif
+}
+
+static void RemoveRing(const std::string& name)
+{
+#ifdef _WIN32
+	(void)name;		// the mapping goes with its last handle
+#else
+	shm_unlink(("/" + name).c_str());
+	unlink(("/tmp/" + name + ".lock").c_str());
+#endif
+}
+
+// every byte of a frame is its sequence number's low byte, so a copy mixing two frames shows
+static void FillFrame(unsigned char* frame, const SharedFrameFormat& format, uint64_t sequence)
+{
+	memset(frame, (int)(sequence & 0xff), format.GetBytes());
+}
+
+static bool IsWholeFrame(const unsigned char* frame, const SharedFrameFormat& format, uint64_t sequence)
+{
+	// every byte the same as the one after it (memcmp, so the check doesn't take much longer than the copy)
+	size_t bytes = format.GetBytes();
+	return bytes == 0 || (frame[0] == (unsigned char)(sequence & 0xff) && memcmp(frame, frame + 1, bytes - 1) == 0);
+}
+
+static void TestFormats()
+{
+	std::string name = RingName("formats");
+	{
+		SharedFrameRing producer, reader;
+		CHECK(!reader.Open(name.c_str()));		// no producer yet
+		CHECK(producer.Create(name.c_str(), 64 * 48 * 3, 3));
+		CHECK(producer.GetMaxFrameBytes() == 64 * 48 * 3);
+		CHECK(reader.Open(name.c_str()));
+
+		SharedFrameFormat none = reader.GetLatestFormat();
+		CHECK(none.width == 0 && none.height == 0 && none.bytesPerPixel == 0);
+		std::vector<unsigned char> frame(64 * 48 * 3);
+		uint64_t sequence = 0;
+		SharedFrameFormat format;
+		CHECK(!reader.Read(frame.data(), frame.size(), sequence, 0, format));
+
+		// a small frame, then a bigger one: each comes out with its own size
+		SharedFrameFormat small = { 32, 24, 3 }, big = { 64, 48, 3 };
+		FillFrame(producer.BeginWrite(), small, 1);
+		producer.EndWrite(small);
+		CHECK(reader.GetLatestFormat() == small);
+		CHECK(reader.Read(frame.data(), frame.size(), sequence, 10, format));
+		CHECK(sequence == 1 && format == small);
+		CHECK(IsWholeFrame(frame.data(), small, 1));
+
+		FillFrame(producer.BeginWrite(), big, 2);
+		producer.EndWrite(big);
+		CHECK(reader.Read(frame.data(), frame.size(), sequence, 10, format));
+		CHECK(sequence == 2 && format == big);
+		CHECK(IsWholeFrame(frame.data(), big, 2));
+
+		// nothing newer: a timeout. Sequence 0 takes the latest again
+		CHECK(!reader.Read(frame.data(), frame.size(), sequence, 10, format));
+		uint64_t latest = 0;
+		CHECK(reader.Read(frame.data(), frame.size(), latest, 0, format));
+		CHECK(latest == 2);
+
+		// a buffer smaller than the frame only gets what fits
+		std::vector<unsigned char> part(100 + 1, 0x55);
+		latest = 0;
+		CHECK(reader.Read(part.data(), 100, latest, 0, format));
+		CHECK(format == big && part[99] == 2 && part[100] == 0x55);
+
+		// a producer taking over a ring of the same layout carries on from its sequence numbers
+		SharedFrameRing takeover;
+		CHECK(takeover.Create(name.c_str(), 64 * 48 * 3, 3));
+		FillFrame(takeover.BeginWrite(), small, 3);
+		takeover.EndWrite(small);
+		CHECK(reader.Read(frame.data(), frame.size(), sequence, 10, format));
+		CHECK(sequence == 3 && IsWholeFrame(frame.data(), small, 3));
+
+		// the producer going closes the ring for its readers, and there's nothing to open until the next one
+		takeover.Close();
+		CHECK(!reader.Read(frame.data(), frame.size(), sequence, 10, format));
+		CHECK(!reader.IsOpen());
+		CHECK(!reader.Open(name.c_str()));
+		SharedFrameRing next;
+		CHECK(next.Create(name.c_str(), 64 * 48 * 3, 3));
+		FillFrame(next.BeginWrite(), small, 1);
+		next.EndWrite(small);
+		CHECK(reader.Open(name.c_str()));
+		CHECK(reader.Read(frame.data(), frame.size(), sequence, 10, format));
+		CHECK(sequence == 1 && IsWholeFrame(frame.data(), small, 1));
+
+		// the producer creating the same ring again keeps it open for the readers
+		CHECK(next.Create(name.c_str(), 64 * 48 * 3, 3));
+		FillFrame(next.BeginWrite(), small, 2);
+		next.EndWrite(small);
+		CHECK(reader.Read(frame.data(), frame.size(), sequence, 10, format));
+		CHECK(sequence == 2 && reader.IsOpen());
+	}
+#ifndef _WIN32
+	// nothing left behind in /dev/shm
+	CHECK(shm_open(("/" + name).c_str(), O_RDONLY, 0) < 0);
+#endif
+	RemoveRing(name);
+}
+
+static void TestProducerLock()
+{
+	std::string name = RingName("lock");
+	{
+		SharedFrameRing first, second;
+		CHECK(first.TryLockProducer(name.c_str()));
+		CHECK(first.IsProducer());
+		CHECK(first.TryLockProducer(name.c_str()));		// already ours
+		CHECK(!second.TryLockProducer(name.c_str()));
+		first.UnlockProducer();
+		CHECK(!first.IsProducer());
+		CHECK(second.TryLockProducer(name.c_str()));
+	}
+	RemoveRing(name);
+}
+
+struct ReaderStats
+{
+	int frames = 0;
+	int torn = 0;
+	int backwards = 0;
+	double averageLatencyMicroseconds = 0.0;
+	double maxLatencyMicroseconds = 0.0;
+};
+
+// readers on their own threads (each with its own mapping, as separate processes would have) until stop
+static void ReadUntil(const std::string& name, size_t maxFrameBytes, const std::atomic<bool>& stop, ReaderStats& stats)
+{
+	SharedFrameRing reader;
+	while (!reader.Open(name.c_str()))
+		std::this_thread::yield();
+	std::vector<unsigned char> frame(maxFrameBytes);
+	uint64_t sequence = 0;
+	while (!stop)
+	{
+		uint64_t previous = sequence;
+		SharedFrameFormat format;
+		if (!reader.Read(frame.data(), frame.size(), sequence, 20, format))
+			continue;
+		stats.frames++;
+		if (!IsWholeFrame(frame.data(), format, sequence))
+			stats.torn++;
+		if (sequence <= previous)
+			stats.backwards++;
+	}
+	stats.averageLatencyMicroseconds = reader.GetAverageLatencyMicroseconds();
+	stats.maxLatencyMicroseconds = reader.GetMaxLatencyMicroseconds();
+}
+
+// the producer alternates between width x height RGBA frames and half size RGB ones, every frameInterval (or flat out
+// if 0) for duration
+static void RunReaders(const char* test, int readerCount, int width, int height, std::chrono::microseconds frameInterval, std::chrono::milliseconds duration, std::vector<ReaderStats>& stats, uint64_t& published)
+{
+	std::string name = RingName(test);
+	{
+		SharedFrameFormat formats[2] = { { (uint32_t)width, (uint32_t)height, 4 }, { (uint32_t)width / 2, (uint32_t)height / 2, 3 } };
+		SharedFrameRing producer;
+		CHECK(producer.Create(name.c_str(), formats[0].GetBytes(), 3));
+
+		std::atomic<bool> stop(false);
+		stats.assign(readerCount, ReaderStats());
+		std::vector<std::thread> readers;
+		for (int r = 0; r < readerCount; r++)
+			readers.emplace_back(ReadUntil, name, formats[0].GetBytes(), std::cref(stop), std::ref(stats[r]));
+
+		auto end = std::chrono::steady_clock::now() + duration;
+		auto nextFrame = std::chrono::steady_clock::now();
+		published = 0;
+		while (std::chrono::steady_clock::now() < end)
+		{
+			const SharedFrameFormat& format = formats[published % 2];
+			unsigned char* slot = producer.BeginWrite();
+			published++;
+			FillFrame(slot, format, published);
+			producer.EndWrite(format);
+			if (frameInterval.count() > 0)
+			{
+				nextFrame += frameInterval;
+				std::this_thread::sleep_until(nextFrame);
+			}
+		}
+		stop = true;
+		for (auto& reader : readers)
+			reader.join();
+	}
+	RemoveRing(name);
+}
+
+static void TestReadersAtFrameRate()
+{
+	// 4 readers at 60 fps: each sees (nearly) every frame, whole, soon after it's published
+	std::vector<ReaderStats> stats;
+	uint64_t published = 0;
+	RunReaders("latency", 4, 320, 240, std::chrono::microseconds(16667), std::chrono::milliseconds(1000), stats, published);
+	for (size_t r = 0; r < stats.size(); r++)
+	{
+		printf("reader %d: %d of %d frames, latency %.0f us average, %.0f us max\n", (int)r, stats[r].frames, (int)published, stats[r].averageLatencyMicroseconds, stats[r].maxLatencyMicroseconds);
+		CHECK(stats[r].torn == 0);
+		CHECK(stats[r].backwards == 0);
+		CHECK(stats[r].frames >= (int)published / 2);
+		// readers poll every 0.5 ms (or wait on an event on Windows), so anything near a frame interval is a stall
+		CHECK(stats[r].averageLatencyMicroseconds < 8000.0);
+	}
+}
+
+static void TestReadersFlatOut()
+{
+	// the producer lapping the 3 slots as fast as it can: readers must throw away every copy it overwrote. The frames
+	// are big so that copies often get caught out, even on one core
+	std::vector<ReaderStats> stats;
+	uint64_t published = 0;
+	RunReaders("torn", 3, 640, 480, std::chrono::microseconds(0), std::chrono::milliseconds(500), stats, published);
+	int frames = 0;
+	for (const ReaderStats& readerStats : stats)
+	{
+		CHECK(readerStats.torn == 0);
+		CHECK(readerStats.backwards == 0);
+		frames += readerStats.frames;
+	}
+	printf("flat out: %d frames published, %d read\n", (int)published, frames);
+	CHECK(frames > 0);
+}
+
+int main()
+{
+	TestFormats();
+	TestProducerLock();
+	TestReadersAtFrameRate();
+	TestReadersFlatOut();
+	return TestResult("SharedFrameRingTest");
+}
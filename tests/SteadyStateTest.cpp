@@ -0,0 +1,227 @@
+// The steady-state allocation check: with global operator new hooked, a capture-like loop over the per-frame
+// components (the thread pool splitting rows, the pixel kernels, the frame arena's buffers and the shared frame ring)
+// must not touch the heap once everything has been set up, which is what the FrameArena counters assume. Where the
+// CPU point cloud renderer is built (VCAM_HAVE_RENDERER) its DrawFrame, RedrawFrame and ReadFrame loop is checked too.
+
+#include "FrameArena.h"
+#include "PixelKernels.h"
+#include "SharedFrameRing.h"
+#include "ThreadPool.h"
+#include "TestCheck.h"
+#ifdef VCAM_HAVE_RENDERER
+#include "CpuPointCloudRenderer.h"
+#include "SyntheticScene.h"
+#include <vector>
+#endif
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static std::atomic<unsigned int> g_HeapAllocations(0);
+
+void* operator new(size_t bytes)
+{
+	g_HeapAllocations++;
+	void* block = malloc(bytes ? bytes : 1);
+	if (!block)
+		throw std::bad_alloc();
+	return block;
+}
+
+void* operator new[](size_t bytes)
+{
+	return operator new(bytes);
+}
+
+void operator delete(void* block) noexcept
+{
+	free(block);
+}
+
+void operator delete[](void* block) noexcept
+{
+	free(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+	free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept
+{
+	free(block);
+}
+
+static const int Width = 640;
+static const int Height = 480;
+static const int RowsPerTask = 16;
+
+// what Init sets up: the thread pool, the arena's buffers and both ends of the ring
+struct Capture
+{
+	ThreadPool threadPool;
+	FrameArena frameArena;
+	SharedFrameRing producer;
+	SharedFrameRing reader;
+	const PixelKernels* kernels = &PixelKernels::GetBest();
+	unsigned char* rgba = nullptr;		// the "sensor" frame
+	unsigned char* bgr = nullptr;		// converted
+	unsigned char* output = nullptr;	// what the reader copies out
+	uint64_t sequence = 0;
+	int frameNumber = 0;
+
+	bool Init(const std::string& ringName, int threadCount)
+	{
+		threadPool.Start(threadCount, false);
+		frameArena.Reserve((size_t)10 * Width * Height);
+		rgba = frameArena.Allocate(4 * Width * Height);
+		bgr = frameArena.Allocate(3 * Width * Height);
+		output = frameArena.Allocate(3 * Width * Height);
+		frameArena.Seal();
+		return producer.Create(ringName.c_str(), 3 * Width * Height, 3) && reader.Open(ringName.c_str());
+	}
+
+	// one frame: convert in row bands on the pool, turn it round into a ring slot, publish and read it back
+	bool Frame()
+	{
+		frameNumber++;
+		for (int i = 0; i < 4 * Width * Height; i += 4096)
+			rgba[i] = (unsigned char)(frameNumber + i);
+		threadPool.ParallelFor(0, Height, RowsPerTask, [this](int begin, int end)
+			{
+				kernels->RgbaToBgr(bgr + 3 * begin * Width, rgba + 4 * begin * Width, (end - begin) * Width);
+			});
+
+		const int rowBytes = 3 * Width;
+		unsigned char* slot = producer.BeginWrite();
+		threadPool.ParallelFor(0, Height, RowsPerTask, [=](int begin, int end)
+			{
+				kernels->ReverseBytes(slot + begin * rowBytes, bgr + (Height - end) * rowBytes, (end - begin) * rowBytes);
+			});
+		SharedFrameFormat format = { Width, Height, 3 };
+		producer.EndWrite(format);
+
+		SharedFrameFormat readFormat;
+		return reader.Read(output, 3 * Width * Height, sequence, 100, readFormat) && readFormat == format;
+	}
+};
+
+static void TestNoHeapAfterInit(int threadCount)
+{
+#ifdef _WIN32
+	std::string ringName = "vcam-steady-state-test-" + std::to_string(GetCurrentProcessId());
+#else
+	std::string ringName = "vcam-steady-state-test-" + std::to_string(getpid());
+#endif
+	{
+		Capture capture;
+		CHECK(capture.Init(ringName, threadCount));
+
+		// the first frames may still settle things (thread start up etc.), after that nothing may allocate
+		for (int frame = 0; frame < 3; frame++)
+			CHECK(capture.Frame());
+		unsigned int before = g_HeapAllocations;
+		bool allRead = true;
+		for (int frame = 0; frame < 200; frame++)
+			allRead = capture.Frame() && allRead;
+		unsigned int allocations = g_HeapAllocations - before;
+
+		CHECK(allRead);
+		CHECK(allocations == 0);
+		CHECK(capture.frameArena.GetSteadyStateAllocationCount() == 0);
+		CHECK(capture.frameArena.GetHeapAllocationCount() == 1);
+		printf("%d threads: %u heap allocations in 200 frames\n", capture.threadPool.GetThreadCount(), allocations);
+		capture.threadPool.Stop();
+	}
+#ifndef _WIN32
+	shm_unlink(("/" + ringName).c_str());
+#endif
+}
+
+#ifdef VCAM_HAVE_RENDERER
+// the point cloud path's per-frame work as RealSenseCam does it: the renderer set up from the frame arena at Init and
+// the arena sealed, then each sensor frame drawn and read out, with a redraw of the moving camera in between
+static void TestRendererNoHeapAfterInit(const char* mode, int threadCount)
+{
+	const int pointCount = SyntheticScene::DepthWidth * SyntheticScene::DepthHeight;
+	const int frameCount = 4;
+	std::vector<float> xyz[frameCount], uv[frameCount];
+	std::vector<unsigned char> infrared[frameCount];
+	for (int i = 0; i < frameCount; i++)
+	{
+		xyz[i].resize(3 * pointCount);
+		uv[i].resize(2 * pointCount);
+		infrared[i].resize(pointCount);
+		SyntheticScene::FillPoints(xyz[i].data(), uv[i].data(), false, i);
+		SyntheticScene::FillInfrared(infrared[i].data(), i);
+	}
+
+	PointCloudRendererOptions options;
+	options.levelOfDetail = true;
+	options.splatting = std::string(mode) == "splats";
+	options.mesh = std::string(mode) == "mesh";
+	options.supersample = std::string(mode) == "supersampled" ? 2 : 1;
+	ThreadPool threadPool;
+	threadPool.Start(threadCount, false);
+	FrameArena frameArena;
+	frameArena.Reserve((size_t)16 << 20);
+	CpuPointCloudRenderer renderer;
+	CHECK(renderer.Init(SyntheticScene::DepthWidth, SyntheticScene::DepthHeight, SyntheticScene::DepthWidth, SyntheticScene::DepthHeight, TextureFormat::Y8, Width, Height, 1.3f, options, &threadPool, &frameArena) == S_OK);
+	renderer.SetDepthFocalLength(SyntheticScene::DepthFocalLength);
+	frameArena.Seal();
+	std::vector<BYTE> output(3 * Width * Height);
+
+	auto frame = [&](int i)
+		{
+			renderer.DrawFrame(pointCount, xyz[i % frameCount].data(), uv[i % frameCount].data(), infrared[i % frameCount].data(), pointCount);
+			renderer.ReadFrame(output.data(), (int)output.size());
+			renderer.RedrawFrame();
+			renderer.ReadFrame(output.data(), (int)output.size());
+		};
+	for (int i = 0; i < 3; i++)
+		frame(i);
+	unsigned int before = g_HeapAllocations;
+	for (int i = 0; i < 50; i++)
+		frame(i);
+	unsigned int allocations = g_HeapAllocations - before;
+
+	CHECK(allocations == 0);
+	CHECK(frameArena.GetSteadyStateAllocationCount() == 0);
+	printf("renderer %s, %d threads: %u heap allocations in 50 frames\n", mode, threadPool.GetThreadCount(), allocations);
+	renderer.UnInit();
+	threadPool.Stop();
+}
+#endif
+
+// and the hook does see allocations, so a 0 above means something
+static void TestHookCounts()
+{
+	unsigned int before = g_HeapAllocations;
+	std::string* text = new std::string("long enough to need the heap, whatever the small string buffer");
+	CHECK(g_HeapAllocations - before >= 1);
+	delete text;
+}
+
+int main()
+{
+	TestHookCounts();
+	TestNoHeapAfterInit(1);
+	TestNoHeapAfterInit(4);
+#ifdef VCAM_HAVE_RENDERER
+	for (const char* mode : { "points", "splats", "mesh", "supersampled" })
+	{
+		TestRendererNoHeapAfterInit(mode, 1);
+		TestRendererNoHeapAfterInit(mode, 4);
+	}
+#endif
+	return TestResult("SteadyStateTest");
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdio>
+
+// Just enough of a test framework for the test programs: a failed CHECK is printed and counted, and each program's
+// main returns the count, which ctest takes as a failure when it isn't 0.
+static int g_Failures = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			g_Failures++; \
+		} \
+	} while (0)
+
+static int TestResult(const char* name)
+{
+	printf("%s: %s (%d failures)\n", name, g_Failures ? "FAILED" : "passed", g_Failures);
+	return g_Failures;
+}
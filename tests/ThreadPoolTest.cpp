@@ -0,0 +1,113 @@
+// ThreadPool::ParallelFor hands every row of a range to exactly one call, whatever the thread count and task size,
+// and carries on correctly when two threads submit at once or the pool is restarted.
+
+#include "ThreadPool.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// each row of [rowBegin, rowEnd) is visited exactly once, in calls no smaller than minRowsPerTask (bar the last)
+static void CheckEveryRowOnce(ThreadPool& threadPool, int rowBegin, int rowEnd, int minRowsPerTask)
+{
+	int rowCount = rowEnd - rowBegin;
+	std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[rowCount > 0 ? rowCount : 1]);
+	for (int row = 0; row < rowCount; row++)
+		visits[row] = 0;
+	std::atomic<int> calls(0), shortCalls(0), badRanges(0);
+
+	threadPool.ParallelFor(rowBegin, rowEnd, minRowsPerTask, [&](int begin, int end)
+		{
+			calls++;
+			if (begin < rowBegin || end > rowEnd || begin >= end)
+				badRanges++;
+			else if (end - begin < minRowsPerTask)
+				shortCalls++;
+			for (int row = std::max(begin, rowBegin); row < std::min(end, rowEnd); row++)
+				visits[row - rowBegin]++;
+		});
+
+	CHECK(badRanges == 0);
+	CHECK(shortCalls <= 1);		// only the one with the range's last rows can come up short
+	int wrongRows = 0;
+	for (int row = 0; row < rowCount; row++)
+	{
+		if (visits[row] != 1)
+			wrongRows++;
+	}
+	CHECK(wrongRows == 0);
+	if (rowCount <= 0)
+		CHECK(calls == 0);
+}
+
+static void TestRanges()
+{
+	static const int ThreadCounts[] = { 1, 2, 3, 4, 8, 0 };
+	for (int threadCount : ThreadCounts)
+	{
+		ThreadPool threadPool;
+		threadPool.Start(threadCount, false);
+		CHECK(threadPool.GetThreadCount() >= 1);
+		if (threadCount > 0)
+			CHECK(threadPool.GetThreadCount() == threadCount);
+
+		CheckEveryRowOnce(threadPool, 0, 0, 1);
+		CheckEveryRowOnce(threadPool, 5, 5, 1);
+		CheckEveryRowOnce(threadPool, 0, 1, 1);
+		CheckEveryRowOnce(threadPool, 0, 480, 1);
+		CheckEveryRowOnce(threadPool, 0, 480, 7);
+		CheckEveryRowOnce(threadPool, 0, 480, 1000);
+		CheckEveryRowOnce(threadPool, 17, 1097, 16);
+		CheckEveryRowOnce(threadPool, -40, 40, 3);
+		// many more tasks than the queues hold at once
+		CheckEveryRowOnce(threadPool, 0, 100000, 1);
+
+		// the same pool job after job, as the capture path uses it
+		for (int job = 0; job < 200; job++)
+			CheckEveryRowOnce(threadPool, 0, 64 + job, 4);
+		threadPool.Stop();
+	}
+}
+
+// a second ParallelFor while one is running falls back to the calling thread, but still covers its rows
+static void TestConcurrentSubmitters()
+{
+	ThreadPool threadPool;
+	threadPool.Start(4, false);
+	std::thread other([&]()
+		{
+			for (int job = 0; job < 100; job++)
+				CheckEveryRowOnce(threadPool, 0, 1000, 8);
+		});
+	for (int job = 0; job < 100; job++)
+		CheckEveryRowOnce(threadPool, 0, 777, 5);
+	other.join();
+	threadPool.Stop();
+}
+
+static void TestRestartAndPinning()
+{
+	ThreadPool threadPool;
+	threadPool.Start(2, false);
+	CheckEveryRowOnce(threadPool, 0, 100, 1);
+	threadPool.Stop();
+
+	// pinned workers only change where the rows run
+	threadPool.Start(4, true);
+	CHECK(threadPool.GetThreadCount() == 4);
+	CheckEveryRowOnce(threadPool, 0, 1000, 1);
+	threadPool.Stop();
+
+	// a stopped pool runs everything on the caller
+	CheckEveryRowOnce(threadPool, 0, 100, 1);
+}
+
+int main()
+{
+	TestRanges();
+	TestConcurrentSubmitters();
+	TestRestartAndPinning();
+	return TestResult("ThreadPoolTest");
+}